@@ -8,6 +8,7 @@
 #include <faux/faux.h>
 #include <faux/buf.h>
 #include <faux/sched.h>
+#include <faux/eloop.h>
 
 #define FAUX_ASYNC_UNLIMITED 0
 
@@ -15,16 +16,59 @@
 #define FAUX_ASYNC_OUT_OVERFLOW FAUX_BUF_UNLIMITED
 // Default overflow limit for in buffer
 #define FAUX_ASYNC_IN_OVERFLOW FAUX_BUF_UNLIMITED
+// The faux_async_out_easy() writes single data chunk per call
+#define FAUX_ASYNC_BURST_CHUNK 0
+// Default max number of packets per system call in datagram mode
+#define FAUX_ASYNC_DGRAM_BATCH 64
+// Default max length of received packet in datagram mode
+#define FAUX_ASYNC_DGRAM_MTU 2048
 
 
 typedef struct faux_async_s faux_async_t;
 
+// Byte order of frame length field
+typedef enum {
+	FAUX_ASYNC_BIG_ENDIAN = 0, // Network byte order
+	FAUX_ASYNC_LITTLE_ENDIAN = 1
+} faux_async_endian_e;
+
+
+// Number of buckets within histogram of write drain latency
+#define FAUX_ASYNC_LATENCY_BUCKETS 24
+
+// I/O statistics of async object (see faux_async_stat())
+typedef struct {
+	size_t bytes_in; // Received bytes
+	size_t bytes_out; // Sent bytes
+	size_t calls_in; // Read system calls or completion operations
+	size_t calls_out; // Write system calls or completion operations
+	size_t eagain_in; // Reads finished with EAGAIN
+	size_t eagain_out; // Writes finished with EAGAIN
+	size_t stalls; // Stall events (executions of stall callback)
+	size_t ibuf_peak; // Peak length of input buffer
+	size_t obuf_peak; // Peak length of output buffer
+	struct timespec obuf_busy; // Total time output buffer was not empty
+	// Histogram of write drain latency. Drain is a period while output
+	// buffer is not empty. Bucket "i" counts drains shorter than 2^i
+	// microseconds. The last bucket counts longer drains too.
+	size_t latency[FAUX_ASYNC_LATENCY_BUCKETS];
+} faux_async_stat_t;
+
+// Statistics of zero-copy send (see faux_async_set_zerocopy())
+typedef struct {
+	size_t zerocopy; // Bytes sent without copying
+	size_t copied; // Bytes copied: short data, fallbacks, copied by kernel
+	size_t pending; // Bytes waiting for completion notification
+} faux_async_zerocopy_stat_t;
+
 
 // Callback function prototypes
 typedef bool_t (*faux_async_read_cb_fn)(faux_async_t *async,
 	faux_buf_t *buf, size_t len, void *user_data);
 typedef bool_t (*faux_async_stall_cb_fn)(faux_async_t *async,
 	size_t len, void *user_data);
+typedef bool_t (*faux_async_dgram_cb_fn)(faux_async_t *async,
+	const struct iovec *pkts, size_t pkt_num, void *user_data);
 
 
 C_DECL_BEGIN
@@ -37,13 +81,45 @@ faux_buf_t *faux_async_obuf(const faux_async_t *async);
 void faux_async_set_read_cb(faux_async_t *async,
 	faux_async_read_cb_fn read_cb, void *user_data);
 bool_t faux_async_set_read_limits(faux_async_t *async, size_t min, size_t max);
+bool_t faux_async_set_frame_len(faux_async_t *async, size_t offset,
+	size_t width, faux_async_endian_e endian, ssize_t adjust);
+bool_t faux_async_set_frame_delim(faux_async_t *async,
+	const void *delim, size_t delim_len);
+bool_t faux_async_set_frame_msg(faux_async_t *async);
+bool_t faux_async_set_chunk_policy(faux_async_t *async,
+	size_t size, size_t min, size_t max);
+bool_t faux_async_set_budget(faux_async_t *async, faux_buf_budget_t *budget);
+bool_t faux_async_set_eloop(faux_async_t *async, faux_eloop_t *eloop);
+bool_t faux_async_set_read_watermarks(faux_async_t *async,
+	size_t high, size_t low);
+void faux_async_set_read_queued(faux_async_t *async, bool_t enable);
+void faux_async_set_write_burst(faux_async_t *async, size_t burst);
+bool_t faux_async_set_deferred_flush(faux_async_t *async,
+	bool_t enable, bool_t cork);
 void faux_async_set_stall_cb(faux_async_t *async,
 	faux_async_stall_cb_fn stall_cb, void *user_data);
 void faux_async_set_write_overflow(faux_async_t *async, size_t overflow);
 void faux_async_set_read_overflow(faux_async_t *async, size_t overflow);
+bool_t faux_async_set_zerocopy(faux_async_t *async, size_t threshold);
+bool_t faux_async_zerocopy_stat(const faux_async_t *async,
+	faux_async_zerocopy_stat_t *stat);
+bool_t faux_async_stat(const faux_async_t *async, faux_async_stat_t *stat);
+void faux_async_stat_reset(faux_async_t *async);
+void faux_async_set_latency_hist(faux_async_t *async, bool_t enable);
+bool_t faux_async_set_dgram(faux_async_t *async, size_t batch, size_t mtu);
+void faux_async_set_dgram_cb(faux_async_t *async,
+	faux_async_dgram_cb_fn dgram_cb, void *user_data);
 ssize_t faux_async_write(faux_async_t *async, void *data, size_t len);
+ssize_t faux_async_vprintf(faux_async_t *async, const char *fmt, va_list ap);
+ssize_t faux_async_printf(faux_async_t *async, const char *fmt, ...);
 ssize_t faux_async_writev(faux_async_t *async,
 	const struct iovec *iov, int iovcnt);
+ssize_t faux_async_write_seg(faux_async_t *async, faux_buf_seg_t *seg);
+ssize_t faux_async_sendfile(faux_async_t *async, int file_fd,
+	off_t offset, size_t len);
+ssize_t faux_async_writev_ref(faux_async_t *async,
+	const struct iovec *iov, int iovcnt,
+	faux_buf_seg_free_fn free_fn, void *user_data);
 ssize_t faux_async_out(faux_async_t *async);
 ssize_t faux_async_out_easy(faux_async_t *async);
 ssize_t faux_async_in(faux_async_t *async);
@@ -27,25 +27,230 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <assert.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef HAVE_MSG_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <syslog.h>
 
 #include "faux/faux.h"
 #include "faux/str.h"
+#include "faux/time.h"
 #include "faux/buf.h"
 #include "faux/net.h"
 #include "faux/async.h"
+#include "faux/msg.h"
 
 #include "private.h"
 
+static bool_t faux_async_io_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static void faux_async_obuf_watermark(faux_buf_t *buf, bool_t high,
+	void *user_data);
+static void faux_async_zc_reap(faux_async_t *async);
+static void faux_async_zc_drain(faux_async_t *async);
+static size_t faux_async_pending(const faux_async_t *async);
+static void faux_async_flush(faux_async_t *async);
+static bool_t faux_async_flush_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+
+#define FAUX_ASYNC_DEFERRED(async) ((async)->flush_deferred && (async)->eloop)
+
+
+/** @brief Counts result of read operation.
+ *
+ * Static internal function. The read system calls are counted by caller
+ * because failed operation can do no system call at all.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] res Length of readed data or -EAGAIN or another error.
+ */
+static void faux_async_count_in(faux_async_t *async, ssize_t res)
+{
+	if (res > 0) {
+		async->stat.bytes_in += res;
+		if ((size_t)faux_buf_len(async->ibuf) > async->stat.ibuf_peak)
+			async->stat.ibuf_peak = faux_buf_len(async->ibuf);
+	} else if (-EAGAIN == res) {
+		async->stat.eagain_in++;
+	}
+}
+
+
+/** @brief Accounts output buffer drain.
+ *
+ * Static internal function. Output buffer became empty. Time since it became
+ * non-empty is added to statistics.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ */
+static void faux_async_drained(faux_async_t *async)
+{
+	struct timespec now = {};
+	struct timespec busy = {};
+	uint64_t usec = 0;
+	unsigned int i = 0;
+
+	faux_timespec_now_monotonic(&now);
+	faux_timespec_diff(&busy, &now, &async->obuf_since);
+	faux_timespec_sum(&async->stat.obuf_busy, &async->stat.obuf_busy,
+		&busy);
+	if (!async->latency_hist)
+		return;
+
+	usec = faux_timespec_to_nsec(&busy) / 1000;
+	while ((i < (FAUX_ASYNC_LATENCY_BUCKETS - 1)) && ((usec >> i) != 0))
+		i++;
+	async->stat.latency[i]++;
+}
+
+
+/** @brief Informs about data that can't be written now.
+ *
+ * Internal function. Stall event is counted and "stall" callback is
+ * executed.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] len Length of pending data.
+ */
+void faux_async_stall(faux_async_t *async, size_t len)
+{
+	async->stat.stalls++;
+	if ((size_t)faux_buf_len(async->obuf) > async->stat.obuf_peak)
+		async->stat.obuf_peak = faux_buf_len(async->obuf);
+
+	if (async->stall_cb)
+		async->stall_cb(async, len, async->stall_udata);
+}
+
+
+/** @brief Posts read operation to event loop.
+ *
+ * Static internal function. It's used with io_uring backend of event loop.
+ * Kernel reads data directly to locked space of input buffer. If operation
+ * can't be posted then reading is returned to fd events.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ */
+static void faux_async_io_read(faux_async_t *async)
+{
+	void *data = NULL;
+	ssize_t len = 0;
+
+	if (!async->eloop || !async->io_mode || async->io_read_off ||
+		async->io_read || async->read_paused)
+		return;
+
+	len = faux_buf_dwrite_lock_easy(async->ibuf, &data);
+	if (len > 0) {
+		if (faux_eloop_io_read(async->eloop, async->fd, data, len,
+			faux_async_io_cb, async)) {
+			async->io_read = BOOL_TRUE;
+			return;
+		}
+		faux_buf_dwrite_unlock_easy(async->ibuf, 0);
+	}
+	async->io_read_off = BOOL_TRUE;
+	faux_eloop_include_fd_event(async->eloop, async->fd, POLLIN);
+}
+
+
+/** @brief Posts write operation to event loop.
+ *
+ * Static internal function. It's used with io_uring backend of event loop.
+ * Kernel writes data directly from locked output buffer. Queued file segments
+ * are written on POLLOUT event to keep data order.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ */
+static void faux_async_io_write(faux_async_t *async)
+{
+	struct iovec iov[IOV_NUM_MAX];
+	size_t iov_num = IOV_NUM_MAX;
+	ssize_t len = 0;
+
+	if (!async->eloop || async->io_write)
+		return;
+	if (!async->io_mode || async->io_write_off ||
+		!faux_list_is_empty(async->files)) {
+		faux_eloop_include_fd_event(async->eloop, async->fd, POLLOUT);
+		return;
+	}
+	if (faux_buf_len(async->obuf) == 0)
+		return;
+
+	len = faux_buf_dread_lock_iov(async->obuf, faux_buf_len(async->obuf),
+		iov, &iov_num);
+	if (len > 0) {
+		if (faux_eloop_io_writev(async->eloop, async->fd,
+			iov, iov_num, faux_async_io_cb, async)) {
+			async->io_write = BOOL_TRUE;
+			return;
+		}
+		faux_buf_dread_unlock(async->obuf, 0, NULL);
+	}
+	async->io_write_off = BOOL_TRUE;
+	faux_eloop_include_fd_event(async->eloop, async->fd, POLLOUT);
+}
+
+
+/** @brief Cancels completion operations.
+ *
+ * Static internal function. Function waits for operations so buffers are
+ * unlocked after it.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ */
+static void faux_async_io_detach(faux_async_t *async)
+{
+	faux_eloop_t *eloop = async->eloop;
+
+	if (!eloop || (!async->io_read && !async->io_write))
+		return;
+	// Callbacks see detached object and don't post new operations
+	async->eloop = NULL;
+	faux_eloop_io_cancel(eloop, async->fd);
+	async->eloop = eloop;
+}
+
+
+/** @brief Frees file segment.
+ *
+ * Static internal function. It's a free function for list of files.
+ *
+ * @param [in] data File segment.
+ */
+static void faux_async_file_free(void *data)
+{
+	faux_async_file_t *file = (faux_async_file_t *)data;
+
+	if (!file)
+		return;
+	close(file->fd);
+	faux_free(file);
+}
+
+
 /** @brief Create new async I/O object.
  *
  * Constructor gets associated file descriptor to operate on it. File
@@ -75,6 +280,12 @@ faux_async_t *faux_async_new(int fd)
 
 	// Init
 	async->fd = fd;
+	async->eloop = NULL;
+	async->io_mode = BOOL_FALSE;
+	async->io_read = BOOL_FALSE;
+	async->io_write = BOOL_FALSE;
+	async->io_read_off = BOOL_FALSE;
+	async->io_write_off = BOOL_FALSE;
 
 	// Read (Input)
 	async->read_cb = NULL;
@@ -83,18 +294,70 @@ faux_async_t *faux_async_new(int fd)
 	async->max = FAUX_ASYNC_UNLIMITED;
 	async->ibuf = faux_buf_new(DATA_CHUNK);
 	faux_buf_set_limit(async->ibuf, FAUX_ASYNC_IN_OVERFLOW);
+	async->frame = FAUX_ASYNC_FRAME_NONE;
+	async->frame_offset = 0;
+	async->frame_width = 0;
+	async->frame_endian = FAUX_ASYNC_BIG_ENDIAN;
+	async->frame_adjust = 0;
+	async->frame_delim = NULL;
+	async->frame_delim_len = 0;
+	async->frame_scanned = 0;
+	async->read_high = 0;
+	async->read_low = 0;
+	async->read_paused = BOOL_FALSE;
+	async->read_queued = BOOL_FALSE;
 
 	// Write (Output)
 	async->stall_cb = NULL;
 	async->stall_udata = NULL;
+	async->write_burst = FAUX_ASYNC_BURST_CHUNK;
 	async->obuf = faux_buf_new(DATA_CHUNK);
 	faux_buf_set_limit(async->obuf, FAUX_ASYNC_OUT_OVERFLOW);
+	async->files = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, faux_async_file_free);
+	async->files_buffered = 0;
+	async->zc_threshold = 0;
+	async->zc_id = 0;
+	async->zc_sends = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, faux_free);
+	memset(&async->zc_stat, 0, sizeof(async->zc_stat));
+	async->flush_deferred = BOOL_FALSE;
+	async->flush_cork = BOOL_FALSE;
+	async->flush_pending = BOOL_FALSE;
+
+	// Statistics
+	memset(&async->stat, 0, sizeof(async->stat));
+	async->latency_hist = BOOL_FALSE;
+	async->obuf_busy = BOOL_FALSE;
+	// Drain time is measured by watermarks of output buffer
+	faux_buf_set_owner_watermarks(async->obuf, 1, 0,
+		faux_async_obuf_watermark, async);
+
+	// Datagram mode
+	async->dgram = BOOL_FALSE;
+	async->dgram_eof = BOOL_FALSE;
+	async->dgram_batch = 0;
+	async->dgram_mtu = 0;
+	async->dgram_cb = NULL;
+	async->dgram_udata = NULL;
+	async->dgram_rdata = NULL;
+	async->dgram_msgs = NULL;
+	async->dgram_iov = NULL;
+	async->dgram_lens = NULL;
+	async->dgram_cap = 0;
+	async->dgram_head = 0;
+	async->dgram_num = 0;
 
 	return async;
 }
 
 
 /** @brief Free async I/O object.
+ *
+ * Memory of output buffer can be used by kernel for zero-copy sends (see
+ * faux_async_set_zerocopy()). So function waits (ZC_DRAIN_TIMEOUT at most)
+ * for completions of such sends before it frees output buffer. Don't close
+ * fd before faux_async_free() if zero-copy send is used.
  *
  * @param [in] Async I/O object.
  */
@@ -103,8 +366,22 @@ void faux_async_free(faux_async_t *async)
 	if (!async)
 		return;
 
+	// Wait for completion operations that use buffers
+	faux_async_io_detach(async);
+	if (async->flush_pending)
+		faux_eloop_del_deferred(async->eloop,
+			faux_async_flush_cb, async);
+	// Kernel can use memory of output buffer
+	faux_async_zc_drain(async);
 	faux_buf_free(async->ibuf);
 	faux_buf_free(async->obuf);
+	faux_list_free(async->files);
+	faux_list_free(async->zc_sends);
+	faux_free(async->dgram_rdata);
+	faux_free(async->dgram_msgs);
+	faux_free(async->dgram_iov);
+	faux_free(async->dgram_lens);
+	faux_free(async->frame_delim);
 
 	faux_free(async);
 }
@@ -141,6 +418,11 @@ faux_buf_t *faux_async_ibuf(const faux_async_t *async)
 
 
 /** @brief Get output buffer from async I/O object.
+ *
+ * Async object uses owner's watermarks of output buffer (see
+ * faux_buf_set_owner_watermarks()) to manage POLLOUT event and to account
+ * the time while buffer is busy. User can set own watermarks by
+ * faux_buf_set_watermarks(). They are independent.
  *
  * @param [in] async Allocated and initialized async I/O object.
  * @return faux_buf_t object.
@@ -182,6 +464,7 @@ void faux_async_set_read_cb(faux_async_t *async,
  * will not get data amount greater than "max" value. If min == max then
  * callback will be executed with fixed data size. The "max" value can be "0".
  * It means indefinite i.e. data transferred to callback can be really large.
+ * Function disables frame decoder.
  *
  * @param [in] async Allocated and initialized async I/O object.
  * @param [in] min Minimal data amount.
@@ -200,188 +483,1480 @@ bool_t faux_async_set_read_limits(faux_async_t *async, size_t min, size_t max)
 
 	async->min = min;
 	async->max = max;
+	async->frame = FAUX_ASYNC_FRAME_NONE;
 
 	return BOOL_TRUE;
 }
 
 
-/** @brief Set stall callback and associated user data.
+/** @brief Set frame decoder with length field.
+ *
+ * Frame has header that contains length field. Field is located at "offset"
+ * from the beginning of frame and has "width" bytes (1, 2, 4 or 8). The full
+ * length of frame is calculated as "offset + width + value + adjust". For
+ * example if field contains length of the whole frame then "adjust" is
+ * "-(offset + width)". The read callback is executed once per complete frame.
+ * Frame is continuous within buffer (see faux_buf_linearize()). Callback
+ * must read frame or frame will be dropped after callback.
  *
  * @param [in] async Allocated and initialized async I/O object.
- * @param [in] stall_cb Stall callback.
- * @param [in] user_data Associated user data.
+ * @param [in] offset Offset of length field.
+ * @param [in] width Width of length field.
+ * @param [in] endian Byte order of length field.
+ * @param [in] adjust Adjustment of frame length.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
  */
-void faux_async_set_stall_cb(faux_async_t *async,
-	faux_async_stall_cb_fn stall_cb, void *user_data)
+bool_t faux_async_set_frame_len(faux_async_t *async, size_t offset,
+	size_t width, faux_async_endian_e endian, ssize_t adjust)
 {
 	assert(async);
 	if (!async)
-		return;
+		return BOOL_FALSE;
+	if ((width != 1) && (width != 2) && (width != 4) && (width != 8))
+		return BOOL_FALSE;
 
-	async->stall_cb = stall_cb;
-	async->stall_udata = user_data;
+	async->frame = FAUX_ASYNC_FRAME_LEN;
+	async->frame_offset = offset;
+	async->frame_width = width;
+	async->frame_endian = endian;
+	async->frame_adjust = adjust;
+
+	return BOOL_TRUE;
 }
 
 
-/** @brief Set write overflow value.
+/** @brief Set frame decoder with delimiter.
  *
- * "Overflow" is a value when engine consider data consumer as a stalled.
- * Data gets into the async I/O object buffer but object can't write it to
- * serviced fd for too long time. So it accumulates great amount of data.
+ * Frame is terminated by delimiter. Delimiter is a part of frame. The read
+ * callback is executed once per complete frame like in
+ * faux_async_set_frame_len().
  *
  * @param [in] async Allocated and initialized async I/O object.
- * @param [in] overflow Overflow value.
+ * @param [in] delim Delimiter.
+ * @param [in] delim_len Length of delimiter.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
  */
-void faux_async_set_write_overflow(faux_async_t *async, size_t overflow)
+bool_t faux_async_set_frame_delim(faux_async_t *async,
+	const void *delim, size_t delim_len)
 {
+	char *new_delim = NULL;
+
 	assert(async);
 	if (!async)
-		return;
+		return BOOL_FALSE;
+	assert(delim);
+	if (!delim || (0 == delim_len))
+		return BOOL_FALSE;
 
-	faux_buf_set_limit(async->obuf, overflow);
+	new_delim = faux_malloc(delim_len);
+	assert(new_delim);
+	if (!new_delim)
+		return BOOL_FALSE;
+	memcpy(new_delim, delim, delim_len);
+	faux_free(async->frame_delim);
+
+	async->frame = FAUX_ASYNC_FRAME_DELIM;
+	async->frame_delim = new_delim;
+	async->frame_delim_len = delim_len;
+	async->frame_scanned = 0;
+
+	return BOOL_TRUE;
 }
 
 
-/** @brief Set read overflow value.
+/** @brief Set frame decoder for faux_msg_t messages.
  *
- * "Overflow" is a value when engine consider data consumer as a stalled.
- * Data gets into the async I/O object buffer but object can't write it to
- * serviced fd for too long time. So it accumulates great amount of data.
+ * Frame is a message with faux_hdr_t header. Header's length field contains
+ * length of the whole message.
  *
  * @param [in] async Allocated and initialized async I/O object.
- * @param [in] overflow Overflow value.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
  */
-void faux_async_set_read_overflow(faux_async_t *async, size_t overflow)
+bool_t faux_async_set_frame_msg(faux_async_t *async)
+{
+	const size_t offset = offsetof(faux_hdr_t, len);
+	const size_t width = sizeof(((faux_hdr_t *)NULL)->len);
+
+	return faux_async_set_frame_len(async, offset, width,
+		FAUX_ASYNC_BIG_ENDIAN, -(ssize_t)(offset + width));
+}
+
+
+/** @brief Set chunk sizing policy for input and output buffers.
+ *
+ * By default buffers use fixed chunks of DATA_CHUNK size. Mostly idle
+ * connections can use small chunks to save memory. With adaptive policy
+ * ("min" < "max") chunks grow for bulk transfers and shrink back when
+ * connection becomes idle. See faux_buf_set_chunk_policy().
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] size Initial chunk size.
+ * @param [in] min Min chunk size.
+ * @param [in] max Max chunk size. If "0" then chunk size is fixed.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_async_set_chunk_policy(faux_async_t *async,
+	size_t size, size_t min, size_t max)
 {
 	assert(async);
 	if (!async)
-		return;
+		return BOOL_FALSE;
+	if (0 == size)
+		return BOOL_FALSE;
 
-	faux_buf_set_limit(async->ibuf, overflow);
+	if (!faux_buf_set_chunk_policy(async->ibuf, size, min, max))
+		return BOOL_FALSE;
+	if (!faux_buf_set_chunk_policy(async->obuf, size, min, max))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
 }
 
 
-/** @brief Async data write.
+/** @brief Attaches input and output buffers to shared memory budget.
  *
- * All given data will be stored to internal buffer (list of data chunks).
- * Then function will try to write stored data to file descriptor in
- * non-blocking mode. Note some data can be left within buffer. In this case
- * the "stall" callback will be executed to inform about it. To try to write
- * the rest of the data user can be call faux_async_out() function. Both
- * functions will not block.
+ * Many async objects can share single budget to limit total memory used by
+ * buffers. The NULL "budget" detaches buffers. See faux_buf_set_budget().
  *
  * @param [in] async Allocated and initialized async I/O object.
- * @param [in] data Data buffer to write.
- * @param [in] len Data length to write.
- * @return Length of stored/writed data or < 0 on error.
+ * @param [in] budget Budget object or NULL.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
  */
-ssize_t faux_async_write(faux_async_t *async, void *data, size_t len)
+bool_t faux_async_set_budget(faux_async_t *async, faux_buf_budget_t *budget)
 {
-	ssize_t data_written = len;
-
 	assert(async);
 	if (!async)
-		return -1;
-	assert(data);
-	if (!data)
-		return -1;
+		return BOOL_FALSE;
 
-	data_written = faux_buf_write(async->obuf, data, len);
-	if (data_written < 0)
-		return -1;
+	if (!faux_buf_set_budget(async->ibuf, budget))
+		return BOOL_FALSE;
+	if (!faux_buf_set_budget(async->obuf, budget))
+		return BOOL_FALSE;
 
-	// Try to real write data to fd in nonblocked mode
-	faux_async_out(async);
+	return BOOL_TRUE;
+}
 
-	return len;
+
+/** @brief Input buffer watermark callback.
+ *
+ * Static internal function. Stops reading of fd when input buffer reaches
+ * high watermark and resumes it on low watermark.
+ *
+ * @param [in] buf Input buffer.
+ * @param [in] high Watermark.
+ * @param [in] user_data Async object.
+ */
+static void faux_async_ibuf_watermark(faux_buf_t *buf, bool_t high,
+	void *user_data)
+{
+	faux_async_t *async = (faux_async_t *)user_data;
+
+	async->read_paused = high;
+	if (!async->eloop)
+		return;
+	if (high)
+		faux_eloop_exclude_fd_event(async->eloop, async->fd, POLLIN);
+	else if (async->io_mode && !async->io_read_off)
+		faux_async_io_read(async);
+	else
+		faux_eloop_include_fd_event(async->eloop, async->fd, POLLIN);
+
+	buf = buf; // Happy compiler
 }
 
 
-/** @brief Async "struct iovec" write.
+/** @brief Output buffer watermark callback.
  *
- * This function is like a faux_async_write() function but uses scatter/gather.
+ * Static internal function. Output buffer has high watermark "1" and low
+ * watermark "0". So fd is polled for writing while output buffer is not
+ * empty. Callback measures time of output buffer drain too.
  *
- * @see faux_async_write().
- * @param [in] async Allocated and initialized async I/O object.
- * @param [in] iov Array of "struct iovec" structures.
- * @param [in] iovcnt Number of iov array members.
- * @return Length of stored/writed data or < 0 on error.
+ * @param [in] buf Output buffer.
+ * @param [in] high Watermark.
+ * @param [in] user_data Async object.
  */
-ssize_t faux_async_writev(faux_async_t *async,
-	const struct iovec *iov, int iovcnt)
+static void faux_async_obuf_watermark(faux_buf_t *buf, bool_t high,
+	void *user_data)
 {
-	size_t total_written = 0;
-	int i = 0;
+	faux_async_t *async = (faux_async_t *)user_data;
+
+	if (high && !async->obuf_busy) {
+		async->obuf_busy = BOOL_TRUE;
+		faux_timespec_now_monotonic(&async->obuf_since);
+	} else if (!high && async->obuf_busy) {
+		async->obuf_busy = BOOL_FALSE;
+		faux_async_drained(async);
+	}
+
+	if (!async->eloop)
+		return;
+	// Deferred flush starts writing at the end of eloop iteration
+	if (high && !async->flush_deferred)
+		faux_async_io_write(async);
+	// Queued file segments are written on POLLOUT too
+	else if (faux_list_is_empty(async->files))
+		faux_eloop_exclude_fd_event(async->eloop, async->fd, POLLOUT);
+
+	buf = buf; // Happy compiler
+}
+
 
+/** @brief Set event loop to manage fd events automatically.
+ *
+ * The fd must be added to event loop by user. Then async object includes
+ * POLLOUT event while output buffer is not empty and excludes it when all
+ * data is written. So user doesn't need to do it within "stall" callback.
+ * Also POLLIN event is excluded when input buffer reaches high watermark
+ * (see faux_async_set_read_watermarks()). So event loop doesn't spin on
+ * readiness that can't be consumed. The NULL "eloop" disables automatic
+ * management.
+ *
+ * If event loop uses io_uring backend then async object posts completion
+ * operations. Kernel reads data directly to input buffer and writes data
+ * directly from output buffer. So POLLIN is excluded and read callback is
+ * executed without user's fd callback. On EOF or error reading is returned
+ * to fd events. So user's fd callback gets POLLIN and faux_async_in() reports
+ * EOF or error as usual. Writing errors are reported the same way by
+ * faux_async_out() on POLLOUT.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] eloop Event loop or NULL.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_async_set_eloop(faux_async_t *async, faux_eloop_t *eloop)
+{
 	assert(async);
 	if (!async)
-		return -1;
-	if (!iov)
-		return -1;
-	if (iovcnt == 0)
-		return 0;
+		return BOOL_FALSE;
 
-	for (i = 0; i < iovcnt; i++) {
-		ssize_t bytes_written = 0;
-		if (iov[i].iov_len == 0)
-			continue;
-		bytes_written = faux_buf_write(async->obuf,
-			iov[i].iov_base, iov[i].iov_len);
-		if (bytes_written < 0) { // Error
-			if (total_written != 0)
-				break;
-			return -1;
-		}
-		if (0 == bytes_written) // Insufficient space
-			break;
-		total_written += bytes_written;
+	// Return fd events of previous event loop to user
+	if (async->eloop && async->io_mode) {
+		faux_async_io_detach(async);
+		if (!async->read_paused)
+			faux_eloop_include_fd_event(async->eloop, async->fd,
+				POLLIN);
+		if (faux_buf_len(async->obuf) > 0)
+			faux_eloop_include_fd_event(async->eloop, async->fd,
+				POLLOUT);
 	}
 
-	// Try to real write data to fd in nonblocked mode
-	if (total_written > 0)
-		faux_async_out(async);
+	if (async->flush_pending) {
+		faux_eloop_del_deferred(async->eloop,
+			faux_async_flush_cb, async);
+		async->flush_pending = BOOL_FALSE;
+	}
 
-	return total_written;
+	async->eloop = eloop;
+	async->io_mode = BOOL_FALSE;
+	async->io_read_off = BOOL_FALSE;
+	async->io_write_off = BOOL_FALSE;
+	if (!eloop)
+		return BOOL_TRUE;
+
+	// Completion operations read data instead of user's fd callback
+	if ((faux_eloop_backend(eloop) == FAUX_ELOOP_BACKEND_URING) &&
+		!async->dgram) {
+		async->io_mode = BOOL_TRUE;
+		faux_eloop_exclude_fd_event(eloop, async->fd, POLLIN);
+	}
+
+	// Callback is executed at once if output buffer is not empty
+	if (faux_buf_len(async->obuf) == 0)
+		faux_eloop_exclude_fd_event(eloop, async->fd, POLLOUT);
+	faux_buf_set_owner_watermarks(async->obuf, 1, 0,
+		faux_async_obuf_watermark, async);
+	if (FAUX_ASYNC_DEFERRED(async) && (faux_async_pending(async) > 0))
+		faux_async_flush(async);
+
+	return faux_async_set_read_watermarks(async,
+		async->read_high, async->read_low);
 }
 
 
-/** @brief Write output buffer to fd in non-blocking mode.
+/** @brief Set watermarks of input buffer.
  *
- * Previously data must be written to internal buffer by faux_async_write()
- * function. But some data can be left within internal buffer because can't be
- * written to fd in non-blocking mode. This function tries to write the rest of
- * data to fd in non-blocking mode. So function doesn't block. It can be called
- * after select() or poll() if fd is ready to be written to. If function can't
- * to write all buffer to fd it executes "stall" callback to inform about it.
+ * When input buffer reaches high watermark the POLLIN event of fd is excluded
+ * from event loop (see faux_async_set_eloop()). Reading is resumed when user
+ * reads data from input buffer down to low watermark. The "0" high watermark
+ * disables it. High watermark must be greater than low watermark.
  *
  * @param [in] async Allocated and initialized async I/O object.
- * @return Length of data actually written or < 0 on error.
+ * @param [in] high High watermark.
+ * @param [in] low Low watermark.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
  */
-static ssize_t faux_async_out_internal(faux_async_t *async,
-	bool_t process_all_data)
+bool_t faux_async_set_read_watermarks(faux_async_t *async,
+	size_t high, size_t low)
 {
-	ssize_t total_written = 0;
+	assert(async);
+	if (!async)
+		return BOOL_FALSE;
+	if ((high != 0) && (low >= high))
+		return BOOL_FALSE;
+
+	async->read_high = high;
+	async->read_low = low;
+	// Resume reading. Callback is executed at once if input buffer is
+	// still above high watermark
+	if (async->eloop && async->read_paused && !async->io_mode)
+		faux_eloop_include_fd_event(async->eloop, async->fd, POLLIN);
+	async->read_paused = BOOL_FALSE;
+	if (!faux_buf_set_owner_watermarks(async->ibuf, high, low,
+		faux_async_ibuf_watermark, async))
+		return BOOL_FALSE;
+	faux_async_io_read(async);
+
+	return BOOL_TRUE;
+}
+
 
+/** @brief Set max length of data written by single faux_async_out_easy().
+ *
+ * By default (FAUX_ASYNC_BURST_CHUNK) faux_async_out_easy() writes single data
+ * chunk per call. So program can be more responsive. But bulk connections
+ * need a lot of syscalls. Non-default burst allows to gather many chunks (up
+ * to IOV_MAX) into single writev() call. The "burst" limits length of data
+ * written per call.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] burst Max length of data to write per call.
+ */
+void faux_async_set_write_burst(faux_async_t *async, size_t burst)
+{
 	assert(async);
 	if (!async)
-		return -1;
+		return;
 
-	while (faux_buf_len(async->obuf) > 0) {
-		ssize_t data_to_write = 0;
-		ssize_t bytes_written = 0;
-		bool_t postpone = BOOL_FALSE;
-		void *data = NULL;
+	async->write_burst = burst;
+}
 
-		data_to_write = faux_buf_dread_lock_easy(async->obuf, &data);
-		if (data_to_write <= 0)
-			return -1;
 
-		bytes_written = write(async->fd, data, data_to_write);
-		if (bytes_written > 0) {
-			total_written += bytes_written;
-			faux_buf_dread_unlock_easy(async->obuf, bytes_written);
+/** @brief Enables reads sized by length of queued data.
+ *
+ * By default the first read is limited by single data chunk and next reads
+ * reserve several chunks. So a large backlog costs many read() calls and
+ * many checks of read limits. In this mode function asks the kernel how many
+ * bytes are queued (FIONREAD), reserves that much space within input buffer
+ * and fills it with single readv(). The read callback is executed once per
+ * batch instead of once per read() call. The input overflow limit is still
+ * applied.
+ *
+ * The mode is useful for sockets, pipes and terminals. If fd doesn't support
+ * FIONREAD then reads fall back to default sizing.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] enable BOOL_TRUE - enable, BOOL_FALSE - disable.
+ */
+void faux_async_set_read_queued(faux_async_t *async, bool_t enable)
+{
+	assert(async);
+	if (!async)
+		return;
+
+	async->read_queued = enable;
+}
+
+
+/** @brief Enables deferred flush of output.
+ *
+ * By default each write function tries to write data to fd at once. So the
+ * handler that writes five small messages produces five syscalls and five
+ * TCP segments. In deferred mode write functions only append data to output
+ * buffer. The event loop (see faux_async_set_eloop()) flushes output once at
+ * the end of loop iteration by single vectored write. The "cork" flag makes
+ * flush to cork TCP socket while writing. So buffered data and queued file
+ * segments (see faux_async_sendfile()) are sent by full-sized segments.
+ *
+ * The mode has no effect while async object has no event loop. Disabling of
+ * mode flushes pending data at once.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] enable BOOL_TRUE - enable, BOOL_FALSE - disable.
+ * @param [in] cork Cork TCP socket while flushing.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_async_set_deferred_flush(faux_async_t *async,
+	bool_t enable, bool_t cork)
+{
+	assert(async);
+	if (!async)
+		return BOOL_FALSE;
+#ifndef TCP_CORK
+	if (cork)
+		return BOOL_FALSE;
+#endif
+
+	async->flush_deferred = enable;
+	async->flush_cork = cork;
+	if (enable || !async->flush_pending)
+		return BOOL_TRUE;
+
+	faux_eloop_del_deferred(async->eloop, faux_async_flush_cb, async);
+	faux_async_flush_cb(async->eloop, FAUX_ELOOP_DEFERRED, NULL, async);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Set stall callback and associated user data.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] stall_cb Stall callback.
+ * @param [in] user_data Associated user data.
+ */
+void faux_async_set_stall_cb(faux_async_t *async,
+	faux_async_stall_cb_fn stall_cb, void *user_data)
+{
+	assert(async);
+	if (!async)
+		return;
+
+	async->stall_cb = stall_cb;
+	async->stall_udata = user_data;
+}
+
+
+/** @brief Set write overflow value.
+ *
+ * "Overflow" is a value when engine consider data consumer as a stalled.
+ * Data gets into the async I/O object buffer but object can't write it to
+ * serviced fd for too long time. So it accumulates great amount of data.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] overflow Overflow value.
+ */
+void faux_async_set_write_overflow(faux_async_t *async, size_t overflow)
+{
+	assert(async);
+	if (!async)
+		return;
+
+	faux_buf_set_limit(async->obuf, overflow);
+}
+
+
+/** @brief Set read overflow value.
+ *
+ * "Overflow" is a value when engine consider data consumer as a stalled.
+ * Data gets into the async I/O object buffer but object can't write it to
+ * serviced fd for too long time. So it accumulates great amount of data.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] overflow Overflow value.
+ */
+void faux_async_set_read_overflow(faux_async_t *async, size_t overflow)
+{
+	assert(async);
+	if (!async)
+		return;
+
+	faux_buf_set_limit(async->ibuf, overflow);
+}
+
+
+/** @brief Enables zero-copy send of large data.
+ *
+ * Buffered data those length is greater or equal to threshold is sent by
+ * sendmsg() with MSG_ZEROCOPY flag. Kernel doesn't copy data but uses memory
+ * of output buffer. So chunks of output buffer stay pinned until kernel
+ * reports completion. Shorter data is copied as usual. Large data is not
+ * written directly from user's memory because that memory can't be pinned.
+ *
+ * Completion notifications are received from socket's error queue by
+ * faux_async_out(). Notification makes fd ready with POLLERR event. So fd
+ * callback of event loop must call faux_async_out() on POLLERR event.
+ *
+ * Only TCP and UDP sockets support zero-copy send. Completion operations of
+ * io_uring backend (see faux_async_set_eloop()) don't use it. The "0"
+ * threshold disables zero-copy send.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] threshold Min length of data to send without copying.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error or not supported.
+ */
+bool_t faux_async_set_zerocopy(faux_async_t *async, size_t threshold)
+{
+#ifdef HAVE_MSG_ZEROCOPY
+	int opt = 1;
+#endif
+
+	assert(async);
+	if (!async)
+		return BOOL_FALSE;
+
+	// Already sent data stays pinned until completion
+	if (0 == threshold) {
+		async->zc_threshold = 0;
+		return BOOL_TRUE;
+	}
+
+#ifdef HAVE_MSG_ZEROCOPY
+	if (setsockopt(async->fd, SOL_SOCKET, SO_ZEROCOPY,
+		&opt, sizeof(opt)) < 0)
+		return BOOL_FALSE;
+	async->zc_threshold = threshold;
+
+	return BOOL_TRUE;
+#else
+	return BOOL_FALSE;
+#endif
+}
+
+
+/** @brief Gets statistics of zero-copy send.
+ *
+ * Bytes are counted as zero-copy or copied when completion is received.
+ * Data written by copying functions is counted as copied even if zero-copy
+ * send is disabled. The sendfile() data is not counted.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [out] stat Statistics.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_async_zerocopy_stat(const faux_async_t *async,
+	faux_async_zerocopy_stat_t *stat)
+{
+	assert(async);
+	if (!async)
+		return BOOL_FALSE;
+	assert(stat);
+	if (!stat)
+		return BOOL_FALSE;
+
+	*stat = async->zc_stat;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets I/O statistics.
+ *
+ * Counters are always collected. They are updated by plain increments so
+ * they don't slow down input and output. If output buffer is not empty now
+ * then current drain time is included to "obuf_busy" time. Histogram of
+ * write drain latency is collected if it's enabled by
+ * faux_async_set_latency_hist().
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [out] stat Statistics snapshot.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_async_stat(const faux_async_t *async, faux_async_stat_t *stat)
+{
+	assert(async);
+	if (!async)
+		return BOOL_FALSE;
+	assert(stat);
+	if (!stat)
+		return BOOL_FALSE;
+
+	*stat = async->stat;
+	if (async->obuf_busy) {
+		struct timespec now = {};
+		struct timespec busy = {};
+		faux_timespec_now_monotonic(&now);
+		faux_timespec_diff(&busy, &now, &async->obuf_since);
+		faux_timespec_sum(&stat->obuf_busy, &stat->obuf_busy, &busy);
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Resets I/O statistics.
+ *
+ * Peak values are set to current lengths of buffers.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ */
+void faux_async_stat_reset(faux_async_t *async)
+{
+	assert(async);
+	if (!async)
+		return;
+
+	memset(&async->stat, 0, sizeof(async->stat));
+	async->stat.ibuf_peak = faux_buf_len(async->ibuf);
+	async->stat.obuf_peak = faux_buf_len(async->obuf);
+	if (async->obuf_busy)
+		faux_timespec_now_monotonic(&async->obuf_since);
+}
+
+
+/** @brief Enables histogram of write drain latency.
+ *
+ * Drain is a period while output buffer is not empty. Its length shows how
+ * long written data waits for consumer. See faux_async_stat_t.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] enable BOOL_TRUE - enable, BOOL_FALSE - disable.
+ */
+void faux_async_set_latency_hist(faux_async_t *async, bool_t enable)
+{
+	assert(async);
+	if (!async)
+		return;
+
+	async->latency_hist = enable;
+}
+
+
+/** @brief Writes data to fd directly if output buffer is empty.
+ *
+ * Static internal function. Data is not copied to output buffer if fd can
+ * accept it. Direct write is not used when output buffer is not empty or
+ * file segments or packets are queued (data order) or when data will not
+ * fit into output buffer anyway.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] iov Array of "struct iovec" structures.
+ * @param [in] iovcnt Number of iov array members.
+ * @param [in] len Total length of data.
+ * @return Length of data written directly or < 0 if direct write was not
+ * used.
+ */
+static ssize_t faux_async_write_direct(faux_async_t *async,
+	const struct iovec *iov, int iovcnt, size_t len)
+{
+	ssize_t bytes_written = 0;
+
+	if (FAUX_ASYNC_DEFERRED(async))
+		return -1;
+	// Queued zero-length packets don't take space within buffer
+	if ((faux_buf_len(async->obuf) > 0) || (async->dgram_num > 0) ||
+		!faux_list_is_empty(async->files) ||
+		faux_buf_is_rlocked(async->obuf) ||
+		faux_buf_will_be_overflow(async->obuf, len))
+		return -1;
+	if (iovcnt > IOV_NUM_MAX)
+		return -1;
+	// The writev() doesn't send zero-length packet (except SOCK_SEQPACKET)
+	// and "0" result is ambiguous. The sendmmsg() sends it.
+	if (async->dgram && (0 == len))
+		return -1;
+	// User's memory can't be pinned for zero-copy send
+	if ((async->zc_threshold != 0) && (len >= async->zc_threshold))
+		return -1;
+
+	bytes_written = writev(async->fd, iov, iovcnt);
+	async->stat.calls_out++;
+	if (bytes_written < 0) {
+		if ( // Something went wrong. Let faux_async_out() report it
+			(errno != EINTR) &&
+			(errno != EAGAIN) &&
+			(errno != EWOULDBLOCK)
+			)
+			return -1;
+		if (errno != EINTR)
+			async->stat.eagain_out++;
+		return 0;
+	}
+	async->zc_stat.copied += bytes_written;
+	async->stat.bytes_out += bytes_written;
+
+	return bytes_written;
+}
+
+
+/** @brief Stores the rest of data after direct write.
+ *
+ * Static internal function. Data that was not written directly is stored to
+ * output buffer. Then function executes "stall" callback because fd can't
+ * accept more data now.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] iov Array of "struct iovec" structures.
+ * @param [in] iovcnt Number of iov array members.
+ * @param [in] skip Length of data written directly.
+ * @return Length of stored data or < 0 on error. Stored data immediately
+ * follows directly written data even if it's shorter than the rest.
+ */
+static ssize_t faux_async_store_rest(faux_async_t *async,
+	const struct iovec *iov, int iovcnt, size_t skip)
+{
+	int i = 0;
+	size_t stored = 0;
+
+	if (async->dgram && !faux_async_dgram_reserve(async))
+		return -1;
+	for (i = 0; i < iovcnt; i++) {
+		const char *base = (const char *)iov[i].iov_base;
+		size_t len = iov[i].iov_len;
+		ssize_t bytes_written = 0;
+		if (skip >= len) {
+			skip -= len;
+			continue;
+		}
+		bytes_written = faux_buf_write(async->obuf, base + skip,
+			len - skip);
+		if (bytes_written > 0)
+			stored += bytes_written;
+		if (bytes_written != (ssize_t)(len - skip))
+			break;
+		skip = 0;
+	}
+	// Datagram is never written partially
+	if (async->dgram)
+		faux_async_dgram_queue(async, stored);
+
+	faux_async_stall(async, faux_buf_len(async->obuf));
+
+	return stored;
+}
+
+
+/** @brief Gets result of write with partial direct write.
+ *
+ * Static internal function. Directly written data can't be taken back. So if
+ * the rest of data can't be stored function reports length of data those
+ * will be written actually. Then caller doesn't duplicate data on retry.
+ *
+ * @param [in] direct_written Length of data written directly.
+ * @param [in] stored Length of stored data or < 0 on error.
+ * @return Length of written and stored data or < 0 if nothing was written.
+ */
+static ssize_t faux_async_partial(size_t direct_written, ssize_t stored)
+{
+	if (stored < 0)
+		stored = 0;
+	if (0 == (direct_written + stored))
+		return -1;
+
+	return direct_written + stored;
+}
+
+
+/** @brief Async data write.
+ *
+ * If output buffer is empty then function tries to write data to file
+ * descriptor directly without copying. Else all given data will be stored to
+ * internal buffer (list of data chunks).
+ * Then function will try to write stored data to file descriptor in
+ * non-blocking mode. Note some data can be left within buffer. In this case
+ * the "stall" callback will be executed to inform about it. To try to write
+ * the rest of the data user can be call faux_async_out() function. Both
+ * functions will not block.
+ *
+ * In datagram mode (see faux_async_set_dgram()) each call of write functions
+ * writes single packet.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] data Data buffer to write.
+ * @param [in] len Data length to write.
+ * @return Length of stored/writed data or < 0 on error. If part of data was
+ * written directly but the rest can't be stored then length of data actually
+ * written and stored is returned. It's less than "len". Only the data after
+ * this length can be written again.
+ */
+ssize_t faux_async_write(faux_async_t *async, void *data, size_t len)
+{
+	ssize_t data_written = len;
+	struct iovec iov = {};
+
+	assert(async);
+	if (!async)
+		return -1;
+	assert(data);
+	if (!data)
+		return -1;
+
+	// Output buffer is empty. Try to write directly
+	iov.iov_base = data;
+	iov.iov_len = len;
+	data_written = faux_async_write_direct(async, &iov, 1, len);
+	if (data_written >= 0) {
+		if ((size_t)data_written == len)
+			return len;
+		return faux_async_partial(data_written,
+			faux_async_store_rest(async, &iov, 1, data_written));
+	}
+
+	if (async->dgram && !faux_async_dgram_reserve(async))
+		return -1;
+	data_written = faux_buf_write(async->obuf, data, len);
+	if (data_written < 0)
+		return -1;
+	if (async->dgram)
+		faux_async_dgram_queue(async, len);
+
+	// Try to real write data to fd in nonblocked mode
+	faux_async_flush(async);
+
+	return len;
+}
+
+
+/** @brief Async formatted write.
+ *
+ * String is formatted directly into output buffer. See faux_buf_vprintf().
+ *
+ * @see faux_async_write().
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] fmt Format string like printf() uses.
+ * @param [in] ap Arguments.
+ * @return Length of stored/writed data or < 0 on error.
+ */
+ssize_t faux_async_vprintf(faux_async_t *async, const char *fmt, va_list ap)
+{
+	ssize_t data_written = 0;
+
+	assert(async);
+	if (!async)
+		return -1;
+
+	if (async->dgram && !faux_async_dgram_reserve(async))
+		return -1;
+	data_written = faux_buf_vprintf(async->obuf, fmt, ap);
+	if (data_written < 0)
+		return -1;
+	if (async->dgram)
+		faux_async_dgram_queue(async, data_written);
+
+	// Try to real write data to fd in nonblocked mode
+	faux_async_flush(async);
+
+	return data_written;
+}
+
+
+/** @brief Async formatted write.
+ *
+ * @see faux_async_vprintf().
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] fmt Format string like printf() uses.
+ * @return Length of stored/writed data or < 0 on error.
+ */
+ssize_t faux_async_printf(faux_async_t *async, const char *fmt, ...)
+{
+	va_list ap;
+	ssize_t ret = 0;
+
+	va_start(ap, fmt);
+	ret = faux_async_vprintf(async, fmt, ap);
+	va_end(ap);
+
+	return ret;
+}
+
+
+/** @brief Async "struct iovec" write.
+ *
+ * This function is like a faux_async_write() function but uses scatter/gather.
+ *
+ * @see faux_async_write().
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] iov Array of "struct iovec" structures.
+ * @param [in] iovcnt Number of iov array members.
+ * @return Length of stored/writed data or < 0 on error. See
+ * faux_async_write() about partially stored data.
+ */
+ssize_t faux_async_writev(faux_async_t *async,
+	const struct iovec *iov, int iovcnt)
+{
+	size_t total_written = 0;
+	size_t len = 0;
+	ssize_t direct_written = 0;
+	int i = 0;
+
+	assert(async);
+	if (!async)
+		return -1;
+	if (!iov)
+		return -1;
+	if (iovcnt == 0)
+		return 0;
+
+	// Output buffer is empty. Try to write directly
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	if ((0 == len) && !async->dgram)
+		return 0;
+	direct_written = faux_async_write_direct(async, iov, iovcnt, len);
+	if (direct_written >= 0) {
+		if ((size_t)direct_written == len)
+			return len;
+		return faux_async_partial(direct_written,
+			faux_async_store_rest(async, iov, iovcnt,
+			direct_written));
+	}
+	// Datagram can't be stored partially
+	if (async->dgram && (faux_buf_will_be_overflow(async->obuf, len) ||
+		!faux_async_dgram_reserve(async)))
+		return -1;
+
+	for (i = 0; i < iovcnt; i++) {
+		ssize_t bytes_written = 0;
+		if (iov[i].iov_len == 0)
+			continue;
+		bytes_written = faux_buf_write(async->obuf,
+			iov[i].iov_base, iov[i].iov_len);
+		if (bytes_written < 0) { // Error
+			if (total_written != 0)
+				break;
+			return -1;
+		}
+		if (0 == bytes_written) // Insufficient space
+			break;
+		total_written += bytes_written;
+	}
+	if (async->dgram)
+		faux_async_dgram_queue(async, total_written);
+
+	// Try to real write data to fd in nonblocked mode
+	if ((total_written > 0) || async->dgram)
+		faux_async_flush(async);
+
+	return total_written;
+}
+
+
+/** @brief Async "struct iovec" write by reference.
+ *
+ * Data is not copied. If output buffer is empty then function tries to write
+ * data directly. The rest of data is referenced by output buffer and will be
+ * written later by faux_async_out(). The release callback is executed once
+ * when all data is written (or async object is freed). It can be executed
+ * before function returns. Caller must keep data unchanged until callback is
+ * executed. It's suitable for large payloads that application keeps anyway,
+ * for example cached files.
+ *
+ * @see faux_async_writev().
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] iov Array of "struct iovec" structures.
+ * @param [in] iovcnt Number of iov array members.
+ * @param [in] free_fn Release callback. Can be NULL.
+ * @param [in] user_data User data to pass to callback.
+ * @return Length of stored/writed data or < 0 on error. Callback is not
+ * executed on error. If part of data was written directly but the rest can't
+ * be referenced then length of written data is returned (see
+ * faux_async_write()). Callback is not executed in this case too.
+ */
+ssize_t faux_async_writev_ref(faux_async_t *async,
+	const struct iovec *iov, int iovcnt,
+	faux_buf_seg_free_fn free_fn, void *user_data)
+{
+	size_t len = 0;
+	ssize_t direct_written = 0;
+	struct iovec *rest = NULL;
+	int rest_num = 0;
+	size_t skip = 0;
+	ssize_t ret = 0;
+	int i = 0;
+
+	assert(async);
+	if (!async)
+		return -1;
+	if (!iov || (iovcnt < 0))
+		return -1;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	// Output buffer is empty. Try to write directly
+	direct_written = faux_async_write_direct(async, iov, iovcnt, len);
+	if (direct_written < 0) {
+		if (async->dgram && !faux_async_dgram_reserve(async))
+			return -1;
+		ret = faux_buf_append_ref(async->obuf, iov, iovcnt,
+			free_fn, user_data);
+		if (ret < 0)
+			return -1;
+		if (async->dgram)
+			faux_async_dgram_queue(async, ret);
+		// Try to real write data to fd in nonblocked mode
+		if (ret > 0)
+			faux_async_flush(async);
+		return ret;
+	}
+	if ((size_t)direct_written == len) {
+		if (free_fn)
+			free_fn(user_data);
+		return len;
+	}
+
+	// Reference the rest of data
+	rest = faux_zmalloc(iovcnt * sizeof(*rest));
+	assert(rest);
+	if (!rest)
+		return faux_async_partial(direct_written, -1);
+	skip = direct_written;
+	for (i = 0; i < iovcnt; i++) {
+		if (skip >= iov[i].iov_len) {
+			skip -= iov[i].iov_len;
+			continue;
+		}
+		rest[rest_num].iov_base = (char *)iov[i].iov_base + skip;
+		rest[rest_num].iov_len = iov[i].iov_len - skip;
+		rest_num++;
+		skip = 0;
+	}
+	if (async->dgram && !faux_async_dgram_reserve(async)) {
+		faux_free(rest);
+		return faux_async_partial(direct_written, -1);
+	}
+	ret = faux_buf_append_ref(async->obuf, rest, rest_num,
+		free_fn, user_data);
+	faux_free(rest);
+	if (ret < 0)
+		return faux_async_partial(direct_written, -1);
+	// Datagram is never written partially
+	if (async->dgram)
+		faux_async_dgram_queue(async, ret);
+
+	faux_async_stall(async, faux_buf_len(async->obuf));
+
+	return len;
+}
+
+
+/** @brief Asynchronous write of file segment.
+ *
+ * File segment is queued to output stream after data that is already
+ * buffered. Data written later follows file segment. File data is sent by
+ * sendfile() so it doesn't pass user-space memory. If sendfile() can't be
+ * used then data is copied by small portions. File descriptor is duplicated
+ * so caller can close it. File data must not be changed until it's written.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] file_fd File descriptor of file to send.
+ * @param [in] offset Offset of data within file.
+ * @param [in] len Length of data to send.
+ * @return Length of queued data or < 0 on error.
+ */
+ssize_t faux_async_sendfile(faux_async_t *async, int file_fd,
+	off_t offset, size_t len)
+{
+	faux_async_file_t *file = NULL;
+
+	assert(async);
+	if (!async)
+		return -1;
+	if ((file_fd < 0) || (offset < 0))
+		return -1;
+	// File can't be split to datagrams
+	if (async->dgram)
+		return -1;
+	if (0 == len)
+		return 0;
+
+	file = faux_zmalloc(sizeof(*file));
+	assert(file);
+	if (!file)
+		return -1;
+	file->fd = dup(file_fd);
+	if (file->fd < 0) {
+		faux_free(file);
+		return -1;
+	}
+	file->offset = offset;
+	file->len = len;
+	file->preceding = faux_buf_len(async->obuf) - async->files_buffered;
+	if (!faux_list_add(async->files, file)) {
+		faux_async_file_free(file);
+		return -1;
+	}
+	async->files_buffered += file->preceding;
+
+	// File segments are written on POLLOUT
+	if (!FAUX_ASYNC_DEFERRED(async))
+		faux_async_io_write(async);
+
+	// Try to real write data to fd in nonblocked mode
+	faux_async_flush(async);
+
+	return len;
+}
+
+
+/** @brief Asynchronous write of shared segment.
+ *
+ * Segment is appended to output buffer without copying. So the same data can
+ * be sent to many connections with single copy in memory. The caller keeps
+ * its own reference to segment.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] seg Shared segment.
+ * @return Length of stored data or < 0 on error.
+ */
+ssize_t faux_async_write_seg(faux_async_t *async, faux_buf_seg_t *seg)
+{
+	ssize_t data_written = 0;
+
+	assert(async);
+	if (!async)
+		return -1;
+	assert(seg);
+	if (!seg)
+		return -1;
+
+	if (async->dgram && !faux_async_dgram_reserve(async))
+		return -1;
+	data_written = faux_buf_append_seg(async->obuf, seg);
+	if (data_written < 0)
+		return -1;
+	if (async->dgram)
+		faux_async_dgram_queue(async, data_written);
+
+	// Try to real write data to fd in nonblocked mode
+	if ((data_written > 0) || async->dgram)
+		faux_async_flush(async);
+
+	return data_written;
+}
+
+
+/** @brief Gets length of data waiting to be written.
+ *
+ * Static internal function. It includes buffered data and queued file
+ * segments.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @return Length of pending data.
+ */
+static size_t faux_async_pending(const faux_async_t *async)
+{
+	size_t len = faux_buf_len(async->obuf);
+	faux_list_node_t *iter = faux_list_head(async->files);
+	faux_async_file_t *file = NULL;
+
+	while ((file = (faux_async_file_t *)faux_list_each(&iter)))
+		len += file->len;
+
+	return len;
+}
+
+
+/** @brief Writes part of file segment to fd.
+ *
+ * Static internal function. It uses sendfile(). If sendfile() is not
+ * available or doesn't support file type then data is copied by pread() and
+ * write().
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] file File segment.
+ * @param [in] len Length of data to write.
+ * @return Length of written data or < 0 on error.
+ */
+static ssize_t faux_async_write_file(faux_async_t *async,
+	faux_async_file_t *file, size_t len)
+{
+	char data[FILE_COPY_CHUNK];
+	ssize_t bytes_readed = 0;
+	ssize_t bytes_written = 0;
+
+#ifdef HAVE_SENDFILE
+	bytes_written = sendfile(async->fd, file->fd, &file->offset, len);
+	async->stat.calls_out++;
+	if ((bytes_written >= 0) || ((errno != EINVAL) && (errno != ENOSYS)))
+		return bytes_written;
+#endif
+
+	// Copy data
+	if (len > sizeof(data))
+		len = sizeof(data);
+	bytes_readed = pread(file->fd, data, len, file->offset);
+	if (bytes_readed <= 0)
+		return bytes_readed;
+	bytes_written = write(async->fd, data, bytes_readed);
+	async->stat.calls_out++;
+	if (bytes_written > 0)
+		file->offset += bytes_written;
+
+	return bytes_written;
+}
+
+
+/** @brief Sends buffered data without copying.
+ *
+ * Static internal function. Data is sent by sendmsg() with MSG_ZEROCOPY flag.
+ * Memory of sent data is pinned until completion. When kernel can't
+ * allocate notification (ENOBUFS) data is copied.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] len Length of data to send.
+ * @return Length of sent data or < 0 on error.
+ */
+static ssize_t faux_async_zc_send(faux_async_t *async, size_t len)
+{
+#ifdef HAVE_MSG_ZEROCOPY
+	struct iovec iov[IOV_NUM_MAX];
+	size_t iov_num = IOV_NUM_MAX;
+	struct msghdr msg = {};
+	faux_async_zc_t *zc = NULL;
+	ssize_t bytes_written = 0;
+
+	zc = faux_zmalloc(sizeof(*zc));
+	assert(zc);
+	if (!zc)
+		return -1;
+	if (faux_buf_dread_lock_iov(async->obuf, len, iov, &iov_num) <= 0) {
+		faux_free(zc);
+		return -1;
+	}
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iov_num;
+	bytes_written = sendmsg(async->fd, &msg, MSG_ZEROCOPY);
+	async->stat.calls_out++;
+	if (bytes_written <= 0) {
+		int saved_errno = errno;
+		faux_buf_dread_unlock(async->obuf, 0, NULL);
+		faux_free(zc);
+		if ((bytes_written < 0) && (ENOBUFS == saved_errno)) {
+			bytes_written = faux_buf_write_to_fd(async->obuf,
+				async->fd, len, &async->stat.calls_out);
+			if (bytes_written > 0)
+				async->zc_stat.copied += bytes_written;
+			return bytes_written;
+		}
+		errno = saved_errno;
+		return bytes_written;
+	}
+
+	// Kernel numbers successful zero-copy sends sequentially
+	zc->id = async->zc_id++;
+	zc->len = bytes_written;
+	faux_list_add(async->zc_sends, zc);
+	async->zc_stat.pending += bytes_written;
+	faux_buf_dread_unlock_pin(async->obuf, bytes_written, NULL, zc->id);
+
+	return bytes_written;
+#else
+	return faux_buf_write_to_fd(async->obuf, async->fd, len,
+		&async->stat.calls_out);
+#endif
+}
+
+
+/** @brief Receives completion notifications of zero-copy sends.
+ *
+ * Static internal function. Notifications are read from socket's error queue.
+ * Single notification reports range of completed send identifiers. Chunks of
+ * output buffer are unpinned when all preceding sends are completed too.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ */
+static void faux_async_zc_reap(faux_async_t *async)
+{
+#ifdef HAVE_MSG_ZEROCOPY
+	faux_list_node_t *node = NULL;
+	faux_async_zc_t *zc = NULL;
+	bool_t completed = BOOL_FALSE;
+	unsigned int last_id = 0;
+
+	while (!faux_list_is_empty(async->zc_sends)) {
+		char control[128];
+		struct msghdr msg = {};
+		struct cmsghdr *cm = NULL;
+
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(async->fd, &msg, MSG_ERRQUEUE) < 0)
+			break; // Error queue is empty
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err *serr = NULL;
+			faux_list_node_t *iter = NULL;
+
+			if (!((SOL_IP == cm->cmsg_level) &&
+				(IP_RECVERR == cm->cmsg_type)) &&
+				!((SOL_IPV6 == cm->cmsg_level) &&
+				(IPV6_RECVERR == cm->cmsg_type)))
+				continue;
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if ((serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) ||
+				(serr->ee_errno != 0))
+				continue;
+			// Range [ee_info, ee_data] of send identifiers
+			iter = faux_list_head(async->zc_sends);
+			while ((zc = (faux_async_zc_t *)faux_list_each(&iter))) {
+				if (((int)(zc->id - serr->ee_info) < 0) ||
+					((int)(zc->id - serr->ee_data) > 0))
+					continue;
+				zc->done = BOOL_TRUE;
+				zc->copied = (serr->ee_code &
+					SO_EE_CODE_ZEROCOPY_COPIED) ?
+					BOOL_TRUE : BOOL_FALSE;
+			}
+		}
+	}
+
+	while ((node = faux_list_head(async->zc_sends))) {
+		zc = (faux_async_zc_t *)faux_list_data(node);
+		if (!zc->done)
+			break;
+		if (zc->copied)
+			async->zc_stat.copied += zc->len;
+		else
+			async->zc_stat.zerocopy += zc->len;
+		async->zc_stat.pending -= zc->len;
+		last_id = zc->id;
+		completed = BOOL_TRUE;
+		faux_list_del(async->zc_sends, node);
+	}
+	if (completed)
+		faux_buf_unpin(async->obuf, last_id);
+#else
+	async = async; // Happy compiler
+#endif
+}
+
+
+/** @brief Waits for completions of all zero-copy sends.
+ *
+ * Static internal function. Completion notification makes fd ready with
+ * POLLERR event. Function waits for ZC_DRAIN_TIMEOUT at most.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ */
+static void faux_async_zc_drain(faux_async_t *async)
+{
+	struct timespec now = {};
+	uint64_t deadline = 0;
+	uint64_t msec = 0;
+	struct pollfd pfd = {};
+
+	faux_async_zc_reap(async);
+	if (faux_list_is_empty(async->zc_sends))
+		return;
+
+	faux_timespec_now_monotonic(&now);
+	deadline = faux_timespec_to_nsec(&now) / 1000000l + ZC_DRAIN_TIMEOUT;
+	pfd.fd = async->fd;
+	pfd.events = 0; // POLLERR is reported anyway
+	while (!faux_list_is_empty(async->zc_sends)) {
+		faux_timespec_now_monotonic(&now);
+		msec = faux_timespec_to_nsec(&now) / 1000000l;
+		if (msec >= deadline)
+			break;
+		if ((poll(&pfd, 1, deadline - msec) < 0) && (errno != EINTR))
+			break;
+		if (pfd.revents & POLLNVAL) // Closed fd
+			break;
+		faux_async_zc_reap(async);
+	}
+}
+
+
+/** @brief Write output buffer to fd in non-blocking mode.
+ *
+ * Previously data must be written to internal buffer by faux_async_write()
+ * function. But some data can be left within internal buffer because can't be
+ * written to fd in non-blocking mode. This function tries to write the rest of
+ * data to fd in non-blocking mode. So function doesn't block. It can be called
+ * after select() or poll() if fd is ready to be written to. If function can't
+ * to write all buffer to fd it executes "stall" callback to inform about it.
+ *
+ * When all data must be processed the whole buffer is handed to writev()
+ * (up to IOV_MAX chunks per call). Else the single data chunk is written or
+ * data chunks within "write burst" are gathered into single writev().
+ *
+ * File segments queued by faux_async_sendfile() are written in order with
+ * buffered data.
+ *
+ * Function receives completion notifications of zero-copy sends (see
+ * faux_async_set_zerocopy()). Data is sent without copying if its length is
+ * not less than zero-copy threshold.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @return Length of data actually written or < 0 on error.
+ */
+static ssize_t faux_async_out_internal(faux_async_t *async,
+	bool_t process_all_data)
+{
+	ssize_t total_written = 0;
+
+	assert(async);
+	if (!async)
+		return -1;
+
+	faux_async_zc_reap(async);
+	if ((size_t)faux_buf_len(async->obuf) > async->stat.obuf_peak)
+		async->stat.obuf_peak = faux_buf_len(async->obuf);
+
+	// Output buffer is locked by write operation of event loop
+	if (async->io_write)
+		return 0;
+
+	if (async->dgram)
+		return faux_async_dgram_out(async, process_all_data);
+
+	while ((faux_buf_len(async->obuf) > 0) ||
+		!faux_list_is_empty(async->files)) {
+		ssize_t data_to_write = 0;
+		ssize_t bytes_written = 0;
+		bool_t postpone = BOOL_FALSE;
+		faux_list_node_t *node = faux_list_head(async->files);
+		faux_async_file_t *file = NULL;
+		size_t limit = faux_buf_len(async->obuf);
+
+		if (node) {
+			file = (faux_async_file_t *)faux_list_data(node);
+			limit = file->preceding;
+		}
+
+		// File segment
+		if (file && (0 == limit)) {
+			data_to_write = file->len;
+			if (!process_all_data) {
+				size_t burst = (async->write_burst !=
+					FAUX_ASYNC_BURST_CHUNK) ?
+					async->write_burst :
+					(size_t)faux_buf_chunk_size(async->obuf);
+				if ((size_t)data_to_write > burst)
+					data_to_write = burst;
+			}
+			bytes_written = faux_async_write_file(async, file,
+				data_to_write);
+			// File is shorter than expected
+			if (0 == bytes_written) {
+				faux_list_del(async->files, node);
+				errno = EIO;
+				return -1;
+			}
+			if (bytes_written > 0) {
+				file->len -= bytes_written;
+				if (0 == file->len)
+					faux_list_del(async->files, node);
+			}
+		} else if (process_all_data ||
+			(async->write_burst != FAUX_ASYNC_BURST_CHUNK)) {
+			data_to_write = limit;
+			if (!process_all_data &&
+				((size_t)data_to_write > async->write_burst))
+				data_to_write = async->write_burst;
+			if ((async->zc_threshold != 0) &&
+				((size_t)data_to_write >= async->zc_threshold)) {
+				bytes_written = faux_async_zc_send(async,
+					data_to_write);
+			} else {
+				bytes_written = faux_buf_write_to_fd(
+					async->obuf, async->fd, data_to_write,
+					&async->stat.calls_out);
+				if (bytes_written > 0)
+					async->zc_stat.copied += bytes_written;
+			}
 		} else {
-			faux_buf_dread_unlock_easy(async->obuf, 0);
+			void *data = NULL;
+			data_to_write = faux_buf_dread_lock_easy(async->obuf,
+				&data);
+			if (data_to_write <= 0)
+				return -1;
+			if ((size_t)data_to_write > limit)
+				data_to_write = limit;
+			bytes_written = write(async->fd, data, data_to_write);
+			async->stat.calls_out++;
+			faux_buf_dread_unlock_easy(async->obuf,
+				(bytes_written > 0) ? bytes_written : 0);
+			if (bytes_written > 0)
+				async->zc_stat.copied += bytes_written;
+		}
+		// Buffered data that precedes file segment was written
+		if (file && (limit > 0) && (bytes_written > 0)) {
+			file->preceding -= bytes_written;
+			async->files_buffered -= bytes_written;
+		}
+		if (bytes_written > 0) {
+			total_written += bytes_written;
+			async->stat.bytes_out += bytes_written;
 		}
 		if (bytes_written < 0) {
 			if ( // Something went wrong
@@ -390,6 +1965,8 @@ static ssize_t faux_async_out_internal(faux_async_t *async,
 				(errno != EWOULDBLOCK)
 				)
 				return -1;
+			if (errno != EINTR)
+				async->stat.eagain_out++;
 			// Postpone next read
 			postpone = BOOL_TRUE;
 		// Not whole data block was written
@@ -399,21 +1976,23 @@ static ssize_t faux_async_out_internal(faux_async_t *async,
 		// Write only one data block and buffer is not empty
 		// Programm can be more responsive if to write only one data
 		// block and then allow other events to be processed
-		} else if (!process_all_data && (faux_buf_len(async->obuf) > 0)) {
+		} else if (!process_all_data &&
+			(faux_async_pending(async) > 0)) {
 			postpone = BOOL_TRUE;
 		}
 
 		// Postponed
 		if (postpone) {
-			// Execute callback
-			if (async->stall_cb)
-				async->stall_cb(async,
-					faux_buf_len(async->obuf),
-					async->stall_udata);
+			faux_async_stall(async, faux_async_pending(async));
 			break;
 		}
 	}
 
+	// The last file segment is written and output buffer is empty
+	if (async->eloop && (0 == faux_buf_len(async->obuf)) &&
+		faux_list_is_empty(async->files))
+		faux_eloop_exclude_fd_event(async->eloop, async->fd, POLLOUT);
+
 	return total_written;
 }
 
@@ -430,6 +2009,307 @@ ssize_t faux_async_out_easy(faux_async_t *async)
 }
 
 
+/** @brief Corks or uncorks TCP socket.
+ *
+ * Static internal function. Error is ignored because fd can be not a TCP
+ * socket.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] cork BOOL_TRUE - cork, BOOL_FALSE - uncork.
+ */
+static void faux_async_cork(faux_async_t *async, bool_t cork)
+{
+#ifdef TCP_CORK
+	int val = cork ? 1 : 0;
+
+	setsockopt(async->fd, IPPROTO_TCP, TCP_CORK, &val, sizeof(val));
+#else
+	async = async; // Happy compiler
+	cork = cork; // Happy compiler
+#endif
+}
+
+
+/** @brief Deferred flush of output buffer.
+ *
+ * Static internal function. It's a deferred callback of event loop. All data
+ * written within loop iteration is flushed by single vectored write (or by
+ * single completion operation of io_uring backend). If fd can't accept all
+ * data then the rest is written on POLLOUT as usual.
+ *
+ * @param [in] eloop Event loop.
+ * @param [in] type Event type.
+ * @param [in] associated_data Unused.
+ * @param [in] user_data Async object.
+ * @return BOOL_TRUE.
+ */
+static bool_t faux_async_flush_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_async_t *async = (faux_async_t *)user_data;
+
+	async->flush_pending = BOOL_FALSE;
+	if (async->io_mode) {
+		faux_async_io_write(async);
+		return BOOL_TRUE;
+	}
+
+	if (async->flush_cork)
+		faux_async_cork(async, BOOL_TRUE);
+	// Error is reported by user's faux_async_out() on POLLOUT
+	if ((faux_async_out(async) < 0) || (faux_async_pending(async) > 0))
+		faux_eloop_include_fd_event(eloop, async->fd, POLLOUT);
+	if (async->flush_cork)
+		faux_async_cork(async, BOOL_FALSE);
+
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Flushes output after write.
+ *
+ * Static internal function. Data is written at once or flush is deferred to
+ * the end of event loop iteration (see faux_async_set_deferred_flush()).
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ */
+static void faux_async_flush(faux_async_t *async)
+{
+	if (!FAUX_ASYNC_DEFERRED(async)) {
+		faux_async_out(async);
+		return;
+	}
+	if (async->flush_pending)
+		return;
+	if (faux_eloop_add_deferred(async->eloop, faux_async_flush_cb, async))
+		async->flush_pending = BOOL_TRUE;
+	else
+		faux_async_out(async);
+}
+
+
+/** @brief Gets length of the first complete frame within input buffer.
+ *
+ * Static internal function.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [out] frame_len Length of frame.
+ * @return 1 - complete frame, 0 - frame is incomplete, < 0 - broken frame.
+ */
+static int faux_async_frame_len(faux_async_t *async, size_t *frame_len)
+{
+	size_t len = faux_buf_len(async->ibuf);
+
+	if (FAUX_ASYNC_FRAME_LEN == async->frame) {
+		unsigned char field[8] = {};
+		size_t field_end = async->frame_offset + async->frame_width;
+		uint64_t value = 0;
+		ssize_t full_len = 0;
+		size_t i = 0;
+
+		if (len < field_end) {
+			*frame_len = field_end;
+			return 0;
+		}
+		faux_buf_peek(async->ibuf, async->frame_offset,
+			field, async->frame_width);
+		for (i = 0; i < async->frame_width; i++) {
+			size_t pos = (FAUX_ASYNC_BIG_ENDIAN == async->frame_endian) ?
+				i : (async->frame_width - i - 1);
+			value = (value << 8) | field[pos];
+		}
+		if (value > (SSIZE_MAX / 2))
+			return -1;
+		full_len = field_end + (ssize_t)value + async->frame_adjust;
+		if (full_len < (ssize_t)field_end)
+			return -1;
+		*frame_len = full_len;
+		if (len < (size_t)full_len)
+			return 0;
+		return 1;
+	}
+
+	if (FAUX_ASYNC_FRAME_DELIM == async->frame) {
+		size_t offset = 0;
+		ssize_t found = 0;
+
+		// Don't scan the same data again
+		if (async->frame_scanned >= async->frame_delim_len)
+			offset = async->frame_scanned -
+				async->frame_delim_len + 1;
+		found = faux_buf_find_seq(async->ibuf, offset,
+			async->frame_delim, async->frame_delim_len);
+		if (found < 0) {
+			async->frame_scanned = len;
+			*frame_len = len + 1; // Unknown yet
+			return 0;
+		}
+		*frame_len = found + async->frame_delim_len;
+		return 1;
+	}
+
+	return -1;
+}
+
+
+/** @brief Executes read callback for each complete frame.
+ *
+ * Static internal function.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @return 0 - success, < 0 - broken frame or frame is too long (errno is
+ * EMSGSIZE) or frame can't be made continuous (errno is ENOMEM).
+ */
+static int faux_async_frames(faux_async_t *async)
+{
+	size_t frame_len = 0;
+	ssize_t limit = faux_buf_limit(async->ibuf);
+	int r = 0;
+
+	while ((r = faux_async_frame_len(async, &frame_len)) > 0) {
+		size_t len_before = faux_buf_len(async->ibuf);
+		size_t consumed = 0;
+
+		async->frame_scanned = 0;
+		if (!faux_buf_linearize(async->ibuf, frame_len)) {
+			errno = ENOMEM;
+			return -1;
+		}
+		async->read_cb(async, async->ibuf, frame_len,
+			async->read_udata);
+
+		// Drop frame if callback didn't read it
+		consumed = len_before - faux_buf_len(async->ibuf);
+		while (consumed < frame_len) {
+			struct iovec iov = {};
+			size_t iov_num = 1;
+			ssize_t locked = faux_buf_dread_lock_iov(async->ibuf,
+				frame_len - consumed, &iov, &iov_num);
+			if (locked <= 0)
+				break;
+			faux_buf_dread_unlock(async->ibuf, locked, NULL);
+			consumed += locked;
+		}
+	}
+
+	// Incomplete frame will never fit into input buffer. The shared budget
+	// is not checked because its shortage is temporary
+	if ((0 == r) && (limit > 0) && (frame_len > (size_t)limit))
+		r = -1;
+	if (r < 0) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/** @brief Executes read callback for received data.
+ *
+ * Static internal function. Data is passed to callback by blocks according
+ * to frame decoder or to min/max read limits.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @return 0 - success, < 0 on error.
+ */
+static int faux_async_process_input(faux_async_t *async)
+{
+	size_t bytes_stored = 0;
+
+	if (!async->read_cb)
+		return 0;
+
+	if (async->frame != FAUX_ASYNC_FRAME_NONE)
+		return faux_async_frames(async);
+
+	// Check for amount of stored data
+	while ((bytes_stored = faux_buf_len(async->ibuf)) >= async->min) {
+		size_t copy_len = 0;
+
+		// Calculate length of user-requested block
+		if (FAUX_ASYNC_UNLIMITED == async->max) { // Indefinite
+			copy_len = bytes_stored; // Take all data
+		} else {
+			copy_len = (bytes_stored < async->max) ?
+				bytes_stored : async->max;
+		}
+
+		// Execute callback
+		async->read_cb(async, async->ibuf, copy_len, async->read_udata);
+	}
+
+	return 0;
+}
+
+
+/** @brief Completion callback for operations posted to event loop.
+ *
+ * Static internal function. Buffers are unlocked and next operation is
+ * posted. On EOF or error I/O is returned to fd events so user gets it by
+ * faux_async_in() or faux_async_out().
+ *
+ * @param [in] eloop Event loop.
+ * @param [in] type Event type (FAUX_ELOOP_IO).
+ * @param [in] associated_data Information about completion.
+ * @param [in] user_data Async object.
+ * @return BOOL_TRUE.
+ */
+static bool_t faux_async_io_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_async_t *async = (faux_async_t *)user_data;
+	faux_eloop_info_io_t *info = (faux_eloop_info_io_t *)associated_data;
+	ssize_t res = info->res;
+	bool_t again = ((-EINTR == res) || (-EAGAIN == res)) ?
+		BOOL_TRUE : BOOL_FALSE;
+
+	if (FAUX_ELOOP_IO_READ == info->op) {
+		async->io_read = BOOL_FALSE;
+		faux_buf_dwrite_unlock_easy(async->ibuf, (res > 0) ? res : 0);
+		async->stat.calls_in++;
+		faux_async_count_in(async, res);
+		// Object is being detached from event loop
+		if (async->eloop != eloop)
+			return BOOL_TRUE;
+		if (((res > 0) && (faux_async_process_input(async) == 0)) ||
+			again) {
+			faux_async_io_read(async);
+		} else {
+			async->io_read_off = BOOL_TRUE;
+			faux_eloop_include_fd_event(eloop, async->fd, POLLIN);
+		}
+
+	} else if (FAUX_ELOOP_IO_WRITEV == info->op) {
+		async->io_write = BOOL_FALSE;
+		faux_buf_dread_unlock(async->obuf, (res > 0) ? res : 0, NULL);
+		async->stat.calls_out++;
+		if (res > 0) {
+			async->zc_stat.copied += res;
+			async->stat.bytes_out += res;
+		} else if (-EAGAIN == res) {
+			async->stat.eagain_out++;
+		}
+		// Object is being detached from event loop
+		if (async->eloop != eloop)
+			return BOOL_TRUE;
+		if ((res < 0) && !again) {
+			async->io_write_off = BOOL_TRUE;
+			faux_eloop_include_fd_event(eloop, async->fd, POLLOUT);
+		} else {
+			faux_async_io_write(async);
+		}
+	}
+
+	type = type; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
 /** @brief Read data and store it to internal buffer in non-blocking mode.
  *
  * Reads fd and puts data to internal buffer. It can't be blocked. If length of
@@ -438,6 +2318,15 @@ ssize_t faux_async_out_easy(faux_async_t *async)
  * If "max" limit is "0"
  * (it means indefinite) then function will pass all available data to callback.
  *
+ * Frame decoder (see faux_async_set_frame_len()) executes callback once per
+ * complete frame instead of read limits. Function returns error if frame is
+ * broken or it can't fit into input buffer.
+ *
+ * The first read is limited by single data chunk. If it fills the whole
+ * reserved space then next reads reserve several chunks for single readv().
+ * See faux_async_set_read_queued() for reads sized by FIONREAD. In this mode
+ * the input is processed once after all reads.
+ *
  * @param [in] async Allocated and initialized async I/O object.
  * @return Length of data actually readed or < 0 on error.
  */
@@ -446,53 +2335,69 @@ static ssize_t faux_async_in_internal(faux_async_t *async,
 {
 	ssize_t total_readed = 0;
 	ssize_t bytes_readed = 0;
-	ssize_t locked_len = 0;
+	size_t read_len = 0;
+	bool_t readed = BOOL_FALSE; // At least one read() was successful
 
 	assert(async);
 	if (!async)
 		return -1;
 
-	do {
-		void *data = NULL;
-		size_t bytes_stored = 0;
+	// Input buffer is locked by read operation of event loop
+	if (async->io_read)
+		return 0;
+
+	if (async->dgram)
+		return faux_async_dgram_in(async, process_all_data);
+
+	// Read size follows chunk size of input buffer
+	read_len = faux_buf_chunk_size(async->ibuf);
 
-		locked_len = faux_buf_dwrite_lock_easy(async->ibuf, &data);
-		if (locked_len <= 0)
-			break; // May be buffer is full
+	do {
+		// Ask the kernel about length of queued data
+		if (async->read_queued) {
+			int queued = 0;
+			if ((ioctl(async->fd, FIONREAD, &queued) == 0) &&
+				(queued >= 0)) {
+				// Nothing to read. The first read() is
+				// needed anyway to get EOF
+				if ((0 == queued) && readed)
+					break;
+				if ((size_t)queued > read_len)
+					read_len = queued;
+			}
+		}
 		// Read data
-		bytes_readed = read(async->fd, data, locked_len);
+		bytes_readed = faux_buf_read_from_fd(async->ibuf, async->fd,
+			read_len, &async->stat.calls_in);
+		faux_async_count_in(async,
+			((bytes_readed < 0) && ((EAGAIN == errno) ||
+			(EWOULDBLOCK == errno))) ? -EAGAIN : bytes_readed);
 		if (bytes_readed < 0) {
-			faux_buf_dwrite_unlock_easy(async->ibuf, 0);
 			if ( // Something went wrong
 				(errno != EINTR) &&
 				(errno != EAGAIN) &&
-				(errno != EWOULDBLOCK)
+				(errno != EWOULDBLOCK) &&
+				(errno != ENOBUFS) // May be buffer is full
 			)
 				return -1;
 			break;
 		}
-		faux_buf_dwrite_unlock_easy(async->ibuf, bytes_readed);
 		total_readed += bytes_readed;
+		readed = BOOL_TRUE;
+		if (!async->read_queued &&
+			(faux_async_process_input(async) < 0))
+			return -1;
 
-		if (!async->read_cb) // No read callback
-			continue;
-		// Check for amount of stored data
-		while ((bytes_stored = faux_buf_len(async->ibuf)) >= async->min) {
-			size_t copy_len = 0;
-
-			// Calculate length of user-requested block
-			if (FAUX_ASYNC_UNLIMITED == async->max) { // Indefinite
-				copy_len = bytes_stored; // Take all data
-			} else {
-				copy_len = (bytes_stored < async->max) ?
-					bytes_stored : async->max;
-			}
+		// Reserved space was fully filled. So there is more data.
+		if ((size_t)bytes_readed != read_len)
+			break;
+		read_len = faux_buf_chunk_size(async->ibuf) * READ_CHUNKS;
+	} while (process_all_data);
 
-			// Execute callback
-			async->read_cb(async, async->ibuf,
-				copy_len, async->read_udata);
-		}
-	} while ((bytes_readed == locked_len) && process_all_data);
+	// Single batch for all reads
+	if (async->read_queued && readed &&
+		(faux_async_process_input(async) < 0))
+		return -1;
 
 	return total_readed;
 }
@@ -0,0 +1,433 @@
+/** @file dgram.c
+ * @brief Datagram mode of asynchronous I/O.
+ *
+ * Stream mode loses message boundaries because data is stored to input
+ * buffer by read(). Datagram mode keeps boundaries so async object can be
+ * used with SOCK_DGRAM and SOCK_SEQPACKET sockets.
+ *
+ * Packets are received by recvmmsg() to receive area of async object. Single
+ * system call receives up to "batch" packets. Then "datagram" callback gets
+ * array of received packets. Packets are not copied so they are valid within
+ * callback only.
+ *
+ * Outgoing packets are stored to output buffer one after another. Queue of
+ * packet lengths keeps boundaries. The sendmmsg() sends up to "batch"
+ * packets per call directly from chunks of output buffer. Write overflow
+ * limit restricts length of queued data as in stream mode.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "faux/faux.h"
+#include "faux/buf.h"
+#include "faux/async.h"
+
+#include "private.h"
+
+// Initial length of packet queue
+#define DGRAM_QUEUE_MIN 64
+
+
+/** @brief Switches async object to datagram mode.
+ *
+ * Function must be called before faux_async_set_eloop() and before any data
+ * is written. Socket must be SOCK_DGRAM, SOCK_SEQPACKET or SOCK_RAW. For
+ * SOCK_SEQPACKET socket the zero-length packet means EOF.
+ *
+ * Received packet longer than "mtu" is truncated by kernel. Such packet is
+ * dropped. Datagram mode doesn't use frame decoders, read limits and read
+ * callback. See faux_async_set_dgram_cb(). The faux_async_sendfile() can't
+ * be used.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] batch Max number of packets per system call. The "0" means
+ * FAUX_ASYNC_DGRAM_BATCH.
+ * @param [in] mtu Max length of received packet. The "0" means
+ * FAUX_ASYNC_DGRAM_MTU.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_async_set_dgram(faux_async_t *async, size_t batch, size_t mtu)
+{
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+	int type = 0;
+	socklen_t type_len = sizeof(type);
+
+	assert(async);
+	if (!async)
+		return BOOL_FALSE;
+
+	if (async->eloop || (faux_buf_len(async->obuf) > 0) ||
+		!faux_list_is_empty(async->files))
+		return BOOL_FALSE;
+	if (getsockopt(async->fd, SOL_SOCKET, SO_TYPE, &type, &type_len) < 0)
+		return BOOL_FALSE;
+	if ((type != SOCK_DGRAM) && (type != SOCK_SEQPACKET) &&
+		(type != SOCK_RAW))
+		return BOOL_FALSE;
+	if (0 == batch)
+		batch = FAUX_ASYNC_DGRAM_BATCH;
+	if (0 == mtu)
+		mtu = FAUX_ASYNC_DGRAM_MTU;
+
+	faux_free(async->dgram_rdata);
+	faux_free(async->dgram_msgs);
+	faux_free(async->dgram_iov);
+	async->dgram_rdata = faux_malloc(batch * mtu);
+	async->dgram_msgs = faux_zmalloc(batch * sizeof(*async->dgram_msgs));
+	// Sent packet can be split by chunk boundaries
+	async->dgram_iov = faux_zmalloc((batch + IOV_NUM_MAX) *
+		sizeof(*async->dgram_iov));
+	assert(async->dgram_rdata);
+	assert(async->dgram_msgs);
+	assert(async->dgram_iov);
+	if (!async->dgram_rdata || !async->dgram_msgs || !async->dgram_iov) {
+		async->dgram = BOOL_FALSE;
+		return BOOL_FALSE;
+	}
+
+	async->dgram = BOOL_TRUE;
+	async->dgram_eof = (SOCK_SEQPACKET == type) ? BOOL_TRUE : BOOL_FALSE;
+	async->dgram_batch = batch;
+	async->dgram_mtu = mtu;
+
+	return BOOL_TRUE;
+#else
+	async = async; // Happy compiler
+	batch = batch; // Happy compiler
+	mtu = mtu; // Happy compiler
+
+	return BOOL_FALSE;
+#endif
+}
+
+
+/** @brief Set datagram callback.
+ *
+ * Callback gets array of received packets. Packets are valid within
+ * callback only. If callback returns BOOL_FALSE then faux_async_in() stops
+ * receiving. The rest of packets stay within socket.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] dgram_cb Datagram callback.
+ * @param [in] user_data Aux data to pass to callback.
+ */
+void faux_async_set_dgram_cb(faux_async_t *async,
+	faux_async_dgram_cb_fn dgram_cb, void *user_data)
+{
+	assert(async);
+	if (!async)
+		return;
+
+	async->dgram_cb = dgram_cb;
+	async->dgram_udata = user_data;
+}
+
+
+/** @brief Reserves place for one more packet within outgoing queue.
+ *
+ * Internal function. Queue grows when it's full. It must be called before
+ * packet data is stored to output buffer. So failed allocation doesn't
+ * leave data without packet boundary within buffer.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_async_dgram_reserve(faux_async_t *async)
+{
+	if (async->dgram_num == async->dgram_cap) {
+		size_t cap = async->dgram_cap ?
+			(async->dgram_cap * 2) : DGRAM_QUEUE_MIN;
+		size_t *lens = NULL;
+		size_t i = 0;
+
+		lens = faux_zmalloc(cap * sizeof(*lens));
+		assert(lens);
+		if (!lens)
+			return BOOL_FALSE;
+		for (i = 0; i < async->dgram_num; i++)
+			lens[i] = async->dgram_lens[(async->dgram_head + i) &
+				(async->dgram_cap - 1)];
+		faux_free(async->dgram_lens);
+		async->dgram_lens = lens;
+		async->dgram_cap = cap;
+		async->dgram_head = 0;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Adds packet to the queue of outgoing packets.
+ *
+ * Internal function. Packet data must be already stored to output buffer.
+ * The place within queue must be reserved by faux_async_dgram_reserve().
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] len Length of packet.
+ */
+void faux_async_dgram_queue(faux_async_t *async, size_t len)
+{
+	assert(async->dgram_num < async->dgram_cap);
+
+	async->dgram_lens[(async->dgram_head + async->dgram_num) &
+		(async->dgram_cap - 1)] = len;
+	async->dgram_num++;
+}
+
+
+/** @brief Removes packets from the head of queue.
+ *
+ * Static internal function.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] num Number of packets to remove.
+ * @return Total length of removed packets.
+ */
+static size_t faux_async_dgram_pop(faux_async_t *async, size_t num)
+{
+	size_t len = 0;
+
+	while ((num-- > 0) && (async->dgram_num > 0)) {
+		len += async->dgram_lens[async->dgram_head];
+		async->dgram_head = (async->dgram_head + 1) &
+			(async->dgram_cap - 1);
+		async->dgram_num--;
+	}
+
+	return len;
+}
+
+
+/** @brief Drops the first packet of queue.
+ *
+ * Static internal function. Output buffer must not be locked.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ */
+static void faux_async_dgram_drop(faux_async_t *async)
+{
+	size_t len = faux_async_dgram_pop(async, 1);
+	struct iovec *iov = NULL;
+	size_t iov_num = 0;
+
+	if (0 == len)
+		return;
+	if (faux_buf_dread_lock(async->obuf, len, &iov, &iov_num) > 0)
+		faux_buf_dread_unlock(async->obuf, len, iov);
+}
+
+
+/** @brief Receives packets in non-blocking mode.
+ *
+ * Internal function. It's used by faux_async_in() in datagram mode. Each
+ * recvmmsg() call receives up to "batch" packets.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] process_all_data Receive while socket has packets. Else single
+ * batch is received.
+ * @return Length of received data or < 0 on error.
+ */
+ssize_t faux_async_dgram_in(faux_async_t *async, bool_t process_all_data)
+{
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+	ssize_t total_readed = 0;
+	struct iovec *iov = async->dgram_iov;
+	struct mmsghdr *msgs = async->dgram_msgs;
+
+	do {
+		size_t pkt_num = 0;
+		size_t i = 0;
+		bool_t eof = BOOL_FALSE;
+		int n = 0;
+
+		memset(msgs, 0, async->dgram_batch * sizeof(*msgs));
+		for (i = 0; i < async->dgram_batch; i++) {
+			iov[i].iov_base = async->dgram_rdata +
+				(i * async->dgram_mtu);
+			iov[i].iov_len = async->dgram_mtu;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		n = recvmmsg(async->fd, msgs, async->dgram_batch, 0, NULL);
+		async->stat.calls_in++;
+		if (n < 0) {
+			if ( // Something went wrong
+				(errno != EINTR) &&
+				(errno != EAGAIN) &&
+				(errno != EWOULDBLOCK)
+			)
+				return -1;
+			if (errno != EINTR)
+				async->stat.eagain_in++;
+			break;
+		}
+
+		// Compact array of packets
+		for (i = 0; i < (size_t)n; i++) {
+			size_t len = msgs[i].msg_len;
+			if ((0 == len) && async->dgram_eof) {
+				eof = BOOL_TRUE;
+				break;
+			}
+			// Packet doesn't fit into receive area
+			if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+				continue;
+			iov[pkt_num].iov_base = iov[i].iov_base;
+			iov[pkt_num].iov_len = len;
+			pkt_num++;
+			total_readed += len;
+			async->stat.bytes_in += len;
+		}
+
+		if ((pkt_num > 0) && async->dgram_cb &&
+			!async->dgram_cb(async, iov, pkt_num, async->dgram_udata))
+			break;
+		if (eof || ((size_t)n < async->dgram_batch))
+			break;
+	} while (process_all_data);
+
+	return total_readed;
+#else
+	async = async; // Happy compiler
+	process_all_data = process_all_data; // Happy compiler
+
+	return -1;
+#endif
+}
+
+
+/** @brief Sends queued packets in non-blocking mode.
+ *
+ * Internal function. It's used by faux_async_out() in datagram mode. Each
+ * sendmmsg() call sends up to "batch" packets directly from output buffer.
+ * Packet that can't be sent because of error (not EAGAIN) is dropped and
+ * error is returned. So next call continues with the next packet.
+ *
+ * @param [in] async Allocated and initialized async I/O object.
+ * @param [in] process_all_data Send all queued packets. Else single batch is
+ * sent.
+ * @return Length of sent data or < 0 on error.
+ */
+ssize_t faux_async_dgram_out(faux_async_t *async, bool_t process_all_data)
+{
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+	ssize_t total_written = 0;
+	struct mmsghdr *msgs = async->dgram_msgs;
+	struct iovec *piov = async->dgram_iov;
+
+	while (async->dgram_num > 0) {
+		struct iovec iov[IOV_NUM_MAX];
+		size_t iov_num = IOV_NUM_MAX;
+		size_t mask = async->dgram_cap - 1;
+		size_t pkt_num = async->dgram_num;
+		size_t len = 0;
+		ssize_t locked = 0;
+		size_t i = 0;
+		size_t j = 0; // Index within locked iov
+		size_t k = 0; // Index within packets' iov
+		size_t off = 0; // Offset within iov[j]
+		size_t written = 0;
+		int n = 0;
+
+		if (pkt_num > async->dgram_batch)
+			pkt_num = async->dgram_batch;
+		for (i = 0; i < pkt_num; i++)
+			len += async->dgram_lens[(async->dgram_head + i) & mask];
+		locked = faux_buf_dread_lock_iov(async->obuf, len,
+			iov, &iov_num);
+		if (locked < 0)
+			return -1;
+
+		// Split locked data to packets
+		memset(msgs, 0, pkt_num * sizeof(*msgs));
+		for (i = 0; i < pkt_num; i++) {
+			size_t rest = async->dgram_lens[
+				(async->dgram_head + i) & mask];
+			// Packet is not locked completely (too many chunks)
+			if (rest > (size_t)locked)
+				break;
+			locked -= rest;
+			msgs[i].msg_hdr.msg_iov = &piov[k];
+			while (rest > 0) {
+				size_t part = iov[j].iov_len - off;
+				if (part > rest)
+					part = rest;
+				piov[k].iov_base = (char *)iov[j].iov_base + off;
+				piov[k].iov_len = part;
+				k++;
+				off += part;
+				rest -= part;
+				if (off == iov[j].iov_len) {
+					j++;
+					off = 0;
+				}
+			}
+			msgs[i].msg_hdr.msg_iovlen =
+				&piov[k] - msgs[i].msg_hdr.msg_iov;
+		}
+		pkt_num = i;
+		if (0 == pkt_num) {
+			faux_buf_dread_unlock(async->obuf, 0, NULL);
+			faux_async_dgram_drop(async);
+			errno = EMSGSIZE;
+			return -1;
+		}
+
+		n = sendmmsg(async->fd, msgs, pkt_num, 0);
+		async->stat.calls_out++;
+		if (n < 0) {
+			int saved_errno = errno;
+			if (len > 0)
+				faux_buf_dread_unlock(async->obuf, 0, NULL);
+			if ((EINTR == saved_errno) || (EAGAIN == saved_errno) ||
+				(EWOULDBLOCK == saved_errno)) {
+				if (saved_errno != EINTR)
+					async->stat.eagain_out++;
+				faux_async_stall(async,
+					faux_buf_len(async->obuf));
+				break;
+			}
+			// Drop packet that can't be sent
+			faux_async_dgram_drop(async);
+			errno = saved_errno;
+			return -1;
+		}
+
+		written = faux_async_dgram_pop(async, n);
+		if (len > 0)
+			faux_buf_dread_unlock(async->obuf, written, NULL);
+		total_written += written;
+		async->zc_stat.copied += written;
+		async->stat.bytes_out += written;
+
+		// Postpone the rest of packets
+		if (((size_t)n < pkt_num) ||
+			(!process_all_data && (async->dgram_num > 0))) {
+			faux_async_stall(async, faux_buf_len(async->obuf));
+			break;
+		}
+	}
+
+	// All packets are sent
+	if (async->eloop && (0 == async->dgram_num))
+		faux_eloop_exclude_fd_event(async->eloop, async->fd, POLLOUT);
+
+	return total_written;
+#else
+	async = async; // Happy compiler
+	process_all_data = process_all_data; // Happy compiler
+
+	return -1;
+#endif
+}
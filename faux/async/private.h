@@ -1,11 +1,57 @@
 #include "faux/faux.h"
 #include "faux/buf.h"
 #include "faux/net.h"
+#include "faux/eloop.h"
+#include "faux/list.h"
 
 #define DATA_CHUNK 4096
+// Number of chunks to reserve for single readv() while bulk reading
+#define READ_CHUNKS 16
+
+// Max number of "struct iovec" entries for single writev()
+#ifdef IOV_MAX
+#define IOV_NUM_MAX IOV_MAX
+#else
+#define IOV_NUM_MAX 1024
+#endif
+
+// Max length of file data to copy per call when sendfile() is not available
+#define FILE_COPY_CHUNK 16384
+
+// Max time to wait for zero-copy completions on free (milliseconds)
+#define ZC_DRAIN_TIMEOUT 1000
+
+// File segment within output stream. It's written by sendfile()
+typedef struct faux_async_file_s {
+	int fd; // Duplicated file descriptor
+	off_t offset; // Current offset within file
+	size_t len; // Length of data left to write
+	size_t preceding; // Length of buffered data to write before file
+} faux_async_file_t;
+
+// Zero-copy send waiting for completion notification
+typedef struct faux_async_zc_s {
+	unsigned int id; // Kernel's identifier of send
+	size_t len; // Length of sent data
+	bool_t done; // Completion is received
+	bool_t copied; // Kernel copied data anyway
+} faux_async_zc_t;
+
+// Frame decoder of read path
+typedef enum {
+	FAUX_ASYNC_FRAME_NONE = 0, // Min/max read limits
+	FAUX_ASYNC_FRAME_LEN = 1, // Length field within header
+	FAUX_ASYNC_FRAME_DELIM = 2 // Delimiter-terminated frames
+} faux_async_frame_e;
 
 struct faux_async_s {
 	int fd;
+	faux_eloop_t *eloop; // Event loop to manage fd events. Can be NULL
+	bool_t io_mode; // Use completion operations of io_uring backend
+	bool_t io_read; // Read operation is in progress
+	bool_t io_write; // Write operation is in progress
+	bool_t io_read_off; // Reading is returned to fd events (EOF, error)
+	bool_t io_write_off; // Writing is returned to fd events (error)
 
 	// Read
 	faux_async_read_cb_fn read_cb; // Read callback
@@ -13,9 +59,58 @@ struct faux_async_s {
 	size_t min;
 	size_t max;
 	faux_buf_t *ibuf;
+	faux_async_frame_e frame; // Frame decoder
+	size_t frame_offset; // Offset of length field
+	size_t frame_width; // Width of length field (1, 2, 4, 8)
+	faux_async_endian_e frame_endian; // Byte order of length field
+	ssize_t frame_adjust; // Frame length = field end + field value + adjust
+	char *frame_delim; // Delimiter
+	size_t frame_delim_len;
+	size_t frame_scanned; // Length of data already scanned for delimiter
+	size_t read_high; // High watermark of input buffer to stop reading
+	size_t read_low; // Low watermark of input buffer to resume reading
+	bool_t read_paused; // POLLIN is excluded because of high watermark
+	bool_t read_queued; // Size reads by length of queued data (FIONREAD)
 
 	// Write
 	faux_async_stall_cb_fn stall_cb; // Stall callback
 	void *stall_udata;
+	size_t write_burst; // Max length of data for faux_async_out_easy()
 	faux_buf_t *obuf;
+	faux_list_t *files; // Queue of file segments (faux_async_file_t)
+	size_t files_buffered; // Buffered data that precedes queued files
+	size_t zc_threshold; // Min length for zero-copy send. The "0" - disabled
+	unsigned int zc_id; // Identifier of the next zero-copy send
+	faux_list_t *zc_sends; // Sends waiting for completion (faux_async_zc_t)
+	faux_async_zerocopy_stat_t zc_stat;
+	bool_t flush_deferred; // Flush output at the end of eloop iteration
+	bool_t flush_cork; // Cork TCP socket while flushing
+	bool_t flush_pending; // Deferred flush is registered within eloop
+
+	// Statistics
+	faux_async_stat_t stat;
+	bool_t latency_hist; // Collect histogram of write drain latency
+	bool_t obuf_busy; // Output buffer is not empty
+	struct timespec obuf_since; // Time when output buffer became non-empty
+
+	// Datagram mode
+	bool_t dgram; // Datagram mode. Packet boundaries are kept
+	bool_t dgram_eof; // Zero-length packet means EOF (SOCK_SEQPACKET)
+	size_t dgram_batch; // Max number of packets per system call
+	size_t dgram_mtu; // Max length of received packet
+	faux_async_dgram_cb_fn dgram_cb; // Datagram callback
+	void *dgram_udata;
+	char *dgram_rdata; // Receive area for batch of packets
+	struct mmsghdr *dgram_msgs;
+	struct iovec *dgram_iov;
+	size_t *dgram_lens; // Circular queue of outgoing packet lengths
+	size_t dgram_cap; // Size of queue (power of two)
+	size_t dgram_head; // Index of the first packet within queue
+	size_t dgram_num; // Number of queued packets
 };
+
+void faux_async_stall(faux_async_t *async, size_t len);
+bool_t faux_async_dgram_reserve(faux_async_t *async);
+void faux_async_dgram_queue(faux_async_t *async, size_t len);
+ssize_t faux_async_dgram_in(faux_async_t *async, bool_t process_all_data);
+ssize_t faux_async_dgram_out(faux_async_t *async, bool_t process_all_data);
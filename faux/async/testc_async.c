@@ -1,12 +1,19 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
 
 #include "faux/str.h"
 #include "faux/async.h"
+#include "faux/msg.h"
 #include "faux/testc_helpers.h"
 
 
@@ -189,3 +196,1391 @@ parse_error:
 
 	return ret;
 }
+
+
+static ssize_t drain_pipe(int fd, char *dst, size_t len)
+{
+	ssize_t readed = 0;
+	ssize_t r = 0;
+
+	while ((size_t)readed < len) {
+		r = read(fd, dst + readed, len - readed);
+		if (r <= 0)
+			break;
+		readed += r;
+	}
+
+	return readed;
+}
+
+
+int testc_faux_async_burst(void)
+{
+	const size_t len = 200000;
+	const size_t burst = 32768;
+	char *src = NULL;
+	char *dst = NULL;
+	size_t readed = 0;
+	ssize_t r = 0;
+	int ret = -1; // Pessimistic return value
+	faux_async_t *out = NULL;
+	bool_t o_flag = BOOL_FALSE;
+	int pipefd[2] = {-1, -1};
+
+	src = faux_testc_rnd_buf(len);
+	dst = faux_malloc(len);
+	if (pipe(pipefd) < 0)
+		goto error;
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	out = faux_async_new(pipefd[1]);
+	faux_async_set_stall_cb(out, stall_cb, &o_flag);
+
+	// Empty output buffer. Data is written directly
+	printf("Direct write\n");
+	if ((faux_async_write(out, src, 100) != 100) ||
+		(faux_buf_len(faux_async_obuf(out)) != 0) || o_flag) {
+		fprintf(stderr, "Data is not written directly\n");
+		goto error;
+	}
+	if ((faux_async_write(out, src + 100, len - 100) != (ssize_t)(len - 100)) ||
+		!o_flag) {
+		fprintf(stderr, "faux_async_write() error\n");
+		goto error;
+	}
+	readed += drain_pipe(pipefd[0], dst + readed, len - readed);
+
+	// Single chunk by default
+	printf("faux_async_out_easy()\n");
+	r = faux_async_out_easy(out);
+	if ((r <= 0) || (r > 4096)) {
+		fprintf(stderr, "Wrong length %ld\n", r);
+		goto error;
+	}
+	readed += drain_pipe(pipefd[0], dst + readed, len - readed);
+
+	// Many chunks within single call
+	printf("faux_async_set_write_burst()\n");
+	faux_async_set_write_burst(out, burst);
+	r = faux_async_out_easy(out);
+	if (r != (ssize_t)burst) {
+		fprintf(stderr, "Wrong burst length %ld\n", r);
+		goto error;
+	}
+	readed += drain_pipe(pipefd[0], dst + readed, len - readed);
+
+	while (faux_buf_len(faux_async_obuf(out)) > 0) {
+		if (faux_async_out_easy(out) < 0)
+			break;
+		readed += drain_pipe(pipefd[0], dst + readed, len - readed);
+	}
+	if ((readed != len) || (memcmp(src, dst, len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	if (pipefd[0] >= 0)
+		close(pipefd[0]);
+	if (pipefd[1] >= 0)
+		close(pipefd[1]);
+	faux_async_free(out);
+	faux_free(src);
+	faux_free(dst);
+
+	return ret;
+}
+
+
+static void release_cb(void *user_data)
+{
+	bool_t *released = (bool_t *)user_data;
+
+	*released = BOOL_TRUE;
+}
+
+
+int testc_faux_async_writev_ref(void)
+{
+	const size_t len = 200000;
+	char *src = NULL;
+	char *dst = NULL;
+	size_t readed = 0;
+	int ret = -1; // Pessimistic return value
+	faux_async_t *out = NULL;
+	bool_t o_flag = BOOL_FALSE;
+	bool_t released = BOOL_FALSE;
+	struct iovec iov[2] = {};
+	int pipefd[2] = {-1, -1};
+
+	src = faux_testc_rnd_buf(len);
+	dst = faux_malloc(len);
+	if (pipe(pipefd) < 0)
+		goto error;
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	out = faux_async_new(pipefd[1]);
+	faux_async_set_stall_cb(out, stall_cb, &o_flag);
+
+	iov[0].iov_base = src;
+	iov[0].iov_len = 1000;
+	iov[1].iov_base = src + 1000;
+	iov[1].iov_len = len - 1000;
+	printf("faux_async_writev_ref()\n");
+	if ((faux_async_writev_ref(out, iov, 2, release_cb, &released) !=
+		(ssize_t)len) || released || !o_flag) {
+		fprintf(stderr, "faux_async_writev_ref() error\n");
+		goto error;
+	}
+
+	printf("faux_async_out()\n");
+	while (faux_buf_len(faux_async_obuf(out)) > 0) {
+		readed += drain_pipe(pipefd[0], dst + readed, len - readed);
+		if (faux_async_out(out) < 0)
+			break;
+	}
+	readed += drain_pipe(pipefd[0], dst + readed, len - readed);
+	if (!released) {
+		fprintf(stderr, "Data is not released\n");
+		goto error;
+	}
+	if ((readed != len) || (memcmp(src, dst, len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	if (pipefd[0] >= 0)
+		close(pipefd[0]);
+	if (pipefd[1] >= 0)
+		close(pipefd[1]);
+	faux_async_free(out);
+	faux_free(src);
+	faux_free(dst);
+
+	return ret;
+}
+
+
+int testc_faux_async_sendfile(void)
+{
+	const size_t head_len = 100000;
+	const size_t file_len = 150000;
+	const size_t tail_len = 50000;
+	const size_t len = head_len + file_len + tail_len;
+	const off_t offset = 1000;
+	char *src = NULL;
+	char *dst = NULL;
+	char *fn = NULL;
+	int file_fd = -1;
+	size_t readed = 0;
+	unsigned int iter = 0;
+	int ret = -1; // Pessimistic return value
+	faux_async_t *out = NULL;
+	int pipefd[2] = {-1, -1};
+
+	src = faux_testc_rnd_buf(len + offset);
+	dst = faux_malloc(len);
+	// File contains the middle part of data
+	fn = faux_testc_tmpfile_deploy(src + head_len, file_len + offset);
+	if (!fn)
+		goto error;
+	memmove(src + head_len, src + head_len + offset, file_len + tail_len);
+	file_fd = open(fn, O_RDONLY);
+	if (file_fd < 0)
+		goto error;
+	if (pipe(pipefd) < 0)
+		goto error;
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	out = faux_async_new(pipefd[1]);
+
+	printf("faux_async_write() + faux_async_sendfile()\n");
+	if ((faux_async_write(out, src, head_len) != (ssize_t)head_len) ||
+		(faux_async_sendfile(out, file_fd, offset, file_len) !=
+		(ssize_t)file_len) ||
+		(faux_async_write(out, src + head_len + file_len, tail_len) !=
+		(ssize_t)tail_len)) {
+		fprintf(stderr, "Write error\n");
+		goto error;
+	}
+	// File descriptor is duplicated
+	close(file_fd);
+	file_fd = -1;
+
+	printf("faux_async_out()\n");
+	while ((readed < len) && (iter++ < 1000)) {
+		readed += drain_pipe(pipefd[0], dst + readed, len - readed);
+		if (faux_async_out(out) < 0) {
+			fprintf(stderr, "faux_async_out() error\n");
+			goto error;
+		}
+	}
+	if ((readed != len) || (memcmp(src, dst, len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	if (pipefd[0] >= 0)
+		close(pipefd[0]);
+	if (pipefd[1] >= 0)
+		close(pipefd[1]);
+	if (file_fd >= 0)
+		close(file_fd);
+	faux_async_free(out);
+	if (fn)
+		unlink(fn);
+	faux_str_free(fn);
+	faux_free(src);
+	faux_free(dst);
+
+	return ret;
+}
+
+
+int testc_faux_async_zerocopy(void)
+{
+	const size_t len = 500000;
+	const size_t small_len = 100;
+	char *src = NULL;
+	char *dst = NULL;
+	size_t readed = 0;
+	unsigned int iter = 0;
+	int ret = -1; // Pessimistic return value
+	faux_async_t *out = NULL;
+	int lsock = -1;
+	int s[2] = {-1, -1};
+	struct sockaddr_in addr = {};
+	socklen_t addr_len = sizeof(addr);
+	faux_async_zerocopy_stat_t stat = {};
+	struct pollfd pfd = {};
+
+	src = faux_testc_rnd_buf(len + small_len);
+	dst = faux_malloc(len + small_len);
+
+	// Zero-copy send needs TCP socket
+	lsock = socket(AF_INET, SOCK_STREAM, 0);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+		(listen(lsock, 1) < 0) ||
+		(getsockname(lsock, (struct sockaddr *)&addr, &addr_len) < 0))
+		goto error;
+	s[0] = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(s[0], (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto error;
+	s[1] = accept(lsock, NULL, NULL);
+	if (s[1] < 0)
+		goto error;
+	fcntl(s[1], F_SETFL, O_NONBLOCK);
+	out = faux_async_new(s[0]);
+
+	printf("faux_async_set_zerocopy()\n");
+	if (!faux_async_set_zerocopy(out, 64 * 1024)) {
+		printf("Zero-copy send is not supported. Skip test\n");
+		ret = 0;
+		goto error;
+	}
+
+	printf("faux_async_write()\n");
+	if ((faux_async_write(out, src, small_len) != (ssize_t)small_len) ||
+		(faux_async_write(out, src + small_len, len) != (ssize_t)len)) {
+		fprintf(stderr, "Write error\n");
+		goto error;
+	}
+
+	printf("faux_async_out()\n");
+	pfd.fd = s[1];
+	pfd.events = POLLIN;
+	while ((readed < (len + small_len)) && (iter++ < 1000)) {
+		poll(&pfd, 1, 10);
+		readed += drain_pipe(s[1], dst + readed,
+			len + small_len - readed);
+		if (faux_async_out(out) < 0) {
+			fprintf(stderr, "faux_async_out() error\n");
+			goto error;
+		}
+	}
+	if ((readed != (len + small_len)) ||
+		(memcmp(src, dst, len + small_len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+
+	// Completions are reported by POLLERR event
+	printf("Completions\n");
+	pfd.fd = s[0];
+	pfd.events = 0; // POLLERR is reported anyway
+	iter = 0;
+	do {
+		poll(&pfd, 1, 10);
+		faux_async_out(out);
+		faux_async_zerocopy_stat(out, &stat);
+	} while ((stat.pending > 0) && (iter++ < 100));
+
+	printf("faux_async_zerocopy_stat()\n");
+	// Loopback copies data anyway
+	if ((stat.pending != 0) ||
+		(stat.zerocopy + stat.copied != len + small_len)) {
+		fprintf(stderr, "Wrong statistics: zerocopy %lu, copied %lu, "
+			"pending %lu\n", stat.zerocopy, stat.copied,
+			stat.pending);
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_async_free(out);
+	if (lsock >= 0)
+		close(lsock);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+	faux_free(src);
+	faux_free(dst);
+
+	return ret;
+}
+
+
+int testc_faux_async_zerocopy_free(void)
+{
+	const size_t len = 100000; // Kernel can send it without reader
+	int rcvbuf = 1024 * 1024;
+	char *src = NULL;
+	char *dst = NULL;
+	char *garbage = NULL;
+	size_t readed = 0;
+	size_t sent = 0;
+	unsigned int iter = 0;
+	int ret = -1; // Pessimistic return value
+	faux_async_t *out = NULL;
+	faux_buf_t *buf = NULL;
+	int lsock = -1;
+	int s[2] = {-1, -1};
+	struct sockaddr_in addr = {};
+	socklen_t addr_len = sizeof(addr);
+	faux_async_stat_t stat = {};
+	faux_async_zerocopy_stat_t zc_stat = {};
+	struct pollfd pfd = {};
+
+	src = faux_testc_rnd_buf(len);
+	dst = faux_malloc(len);
+	garbage = faux_zmalloc(len);
+	// Freed chunks will be reused at once
+	faux_buf_pool_set_limit(len * 2);
+
+	lsock = socket(AF_INET, SOCK_STREAM, 0);
+	// Receive window must accept all sent data. Else kernel keeps data
+	// and completions are not reported until peer reads it.
+	setsockopt(lsock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+		(listen(lsock, 1) < 0) ||
+		(getsockname(lsock, (struct sockaddr *)&addr, &addr_len) < 0))
+		goto error;
+	s[0] = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(s[0], (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto error;
+	s[1] = accept(lsock, NULL, NULL);
+	if (s[1] < 0)
+		goto error;
+	fcntl(s[0], F_SETFL, O_NONBLOCK);
+	fcntl(s[1], F_SETFL, O_NONBLOCK);
+	out = faux_async_new(s[0]);
+	if (!faux_async_set_zerocopy(out, 4096)) {
+		printf("Zero-copy send is not supported. Skip test\n");
+		ret = 0;
+		goto error;
+	}
+
+	printf("Free with pending zero-copy sends\n");
+	if (faux_async_write(out, src, len) != (ssize_t)len) {
+		fprintf(stderr, "Write error\n");
+		goto error;
+	}
+	faux_async_stat(out, &stat);
+	faux_async_zerocopy_stat(out, &zc_stat);
+	sent = stat.bytes_out;
+	printf("Sent %lu bytes, pending %lu bytes\n", sent, zc_stat.pending);
+	faux_async_free(out);
+	out = NULL;
+
+	// Another buffer takes freed chunks and overwrites them
+	buf = faux_buf_new(0);
+	faux_buf_write(buf, garbage, len);
+
+	pfd.fd = s[1];
+	pfd.events = POLLIN;
+	while ((readed < sent) && (iter++ < 1000)) {
+		poll(&pfd, 1, 10);
+		readed += drain_pipe(s[1], dst + readed, sent - readed);
+	}
+	if ((readed != sent) || (memcmp(src, dst, sent) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_async_free(out);
+	faux_buf_free(buf);
+	faux_buf_pool_set_limit(0);
+	if (lsock >= 0)
+		close(lsock);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+	faux_free(src);
+	faux_free(dst);
+	faux_free(garbage);
+
+	return ret;
+}
+
+
+static void user_watermark_cb(faux_buf_t *buf, bool_t high, void *user_data)
+{
+	unsigned int *calls = (unsigned int *)user_data;
+
+	(*calls)++;
+
+	buf = buf; // Happy compiler
+	high = high; // Happy compiler
+}
+
+
+int testc_faux_async_stat(void)
+{
+	const size_t len = 200000; // Greater than pipe buffer
+	char *src = NULL;
+	char *dst = NULL;
+	size_t readed = 0;
+	size_t drains = 0;
+	unsigned int iter = 0;
+	unsigned int i = 0;
+	int ret = -1; // Pessimistic return value
+	faux_async_t *out = NULL;
+	faux_async_t *in = NULL;
+	int pipefd[2] = {-1, -1};
+	faux_async_stat_t stat = {};
+	unsigned int wm_calls = 0;
+
+	src = faux_testc_rnd_buf(len);
+	dst = faux_malloc(len);
+	if (pipe(pipefd) < 0)
+		goto error;
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	out = faux_async_new(pipefd[1]);
+	faux_async_set_latency_hist(out, BOOL_TRUE);
+	// User's watermarks don't break async's own ones
+	faux_buf_set_watermarks(faux_async_obuf(out), 1000, 10,
+		user_watermark_cb, &wm_calls);
+
+	printf("faux_async_write()\n");
+	if (faux_async_write(out, src, len) != (ssize_t)len) {
+		fprintf(stderr, "Write error\n");
+		goto error;
+	}
+	// Pipe is full
+	faux_async_out(out);
+	while ((readed < len) && (iter++ < 1000)) {
+		readed += drain_pipe(pipefd[0], dst + readed, len - readed);
+		faux_async_out(out);
+	}
+	if ((readed != len) || (memcmp(src, dst, len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+
+	printf("faux_async_stat()\n");
+	faux_async_stat(out, &stat);
+	for (i = 0; i < FAUX_ASYNC_LATENCY_BUCKETS; i++)
+		drains += stat.latency[i];
+	if ((stat.bytes_out != len) || (stat.calls_out < 2) ||
+		(stat.eagain_out < 1) || (stat.stalls < 1) ||
+		(stat.obuf_peak == 0) || (stat.obuf_peak >= len) ||
+		((0 == stat.obuf_busy.tv_sec) && (0 == stat.obuf_busy.tv_nsec)) ||
+		(drains != 1) || (stat.bytes_in != 0)) {
+		fprintf(stderr, "Wrong output statistics\n");
+		goto error;
+	}
+	if (wm_calls != 2) {
+		fprintf(stderr, "User's watermark callback: %u calls\n",
+			wm_calls);
+		goto error;
+	}
+
+	// Input. Data stays within input buffer without read callback
+	in = faux_async_new(pipefd[0]);
+	if (write(pipefd[1], src, 1000) != 1000)
+		goto error;
+	faux_async_in(in);
+	faux_async_in(in);
+	faux_async_stat(in, &stat);
+	if ((stat.bytes_in != 1000) || (stat.calls_in < 2) ||
+		(stat.eagain_in < 1) || (stat.ibuf_peak != 1000)) {
+		fprintf(stderr, "Wrong input statistics\n");
+		goto error;
+	}
+
+	printf("faux_async_stat_reset()\n");
+	faux_async_stat_reset(in);
+	faux_async_stat(in, &stat);
+	if ((stat.bytes_in != 0) || (stat.ibuf_peak != 1000)) {
+		fprintf(stderr, "Statistics is not reset\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_async_free(out);
+	faux_async_free(in);
+	if (pipefd[0] >= 0)
+		close(pipefd[0]);
+	if (pipefd[1] >= 0)
+		close(pipefd[1]);
+	faux_free(src);
+	faux_free(dst);
+
+	return ret;
+}
+
+
+typedef struct {
+	unsigned int pkts; // Number of received packets
+	unsigned int calls; // Number of callback executions
+	size_t max_batch; // Max number of packets per callback
+	bool_t broken;
+} dgram_t;
+
+
+typedef struct {
+	char *data;
+	size_t len;
+	unsigned int calls;
+} queued_test_t;
+
+
+static bool_t queued_cb(faux_async_t *async, faux_buf_t *buf, size_t len,
+	void *user_data)
+{
+	queued_test_t *t = (queued_test_t *)user_data;
+
+	faux_buf_read(buf, t->data + t->len, len);
+	t->len += len;
+	t->calls++;
+
+	async = async; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static int queued_check(bool_t enable)
+{
+	const size_t len = 60000; // Fits into socket buffer
+	char *src = NULL;
+	int ret = -1; // Pessimistic return value
+	faux_async_t *in = NULL;
+	int s[2] = {-1, -1};
+	faux_async_stat_t stat = {};
+	queued_test_t t = {};
+
+	src = faux_testc_rnd_buf(len);
+	t.data = faux_malloc(len);
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, s) < 0)
+		goto error;
+	fcntl(s[1], F_SETFL, O_NONBLOCK);
+	if (faux_write_block(s[0], src, len) != (ssize_t)len)
+		goto error;
+	in = faux_async_new(s[1]);
+	faux_async_set_read_cb(in, queued_cb, &t);
+	faux_async_set_read_queued(in, enable);
+
+	if (faux_async_in(in) != (ssize_t)len) {
+		fprintf(stderr, "Read error\n");
+		goto error;
+	}
+	if ((t.len != len) || (memcmp(src, t.data, len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+	faux_async_stat(in, &stat);
+	printf("read() calls: %lu, callbacks: %u\n", stat.calls_in, t.calls);
+	if (enable && ((stat.calls_in != 1) || (t.calls != 1))) {
+		fprintf(stderr, "Data is not read by single batch\n");
+		goto error;
+	}
+	if (!enable && (t.calls < 2)) {
+		fprintf(stderr, "Wrong number of callbacks\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_async_free(in);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+	faux_free(src);
+	faux_free(t.data);
+
+	return ret;
+}
+
+
+int testc_faux_async_read_queued(void)
+{
+	printf("Default read sizing\n");
+	if (queued_check(BOOL_FALSE) < 0)
+		return -1;
+
+	printf("faux_async_set_read_queued()\n");
+	if (queued_check(BOOL_TRUE) < 0)
+		return -1;
+
+	return 0;
+}
+
+
+int testc_faux_async_budget(void)
+{
+	const size_t limit = 1024 * 1024;
+	char *fill = NULL;
+	int ret = -1; // Pessimistic return value
+	faux_async_t *in = NULL;
+	faux_buf_t *other = NULL;
+	faux_buf_budget_t *budget = NULL;
+	int s[2] = {-1, -1};
+	queued_test_t t = {};
+	ssize_t r = 0;
+	faux_async_stat_t stat = {};
+	size_t calls = 0;
+
+	fill = faux_zmalloc(limit);
+	t.data = faux_malloc(limit);
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, s) < 0)
+		goto error;
+	budget = faux_buf_budget_new();
+	faux_buf_budget_set_limit(budget, limit);
+	// Another buffer takes almost whole budget
+	other = faux_buf_new(0);
+	faux_buf_set_budget(other, budget);
+	if (faux_buf_write(other, fill, limit - 3000) != (ssize_t)(limit - 3000))
+		goto error;
+	in = faux_async_new(s[1]);
+	faux_async_set_budget(in, budget);
+	faux_async_set_read_cb(in, queued_cb, &t);
+
+	printf("Read with nearly full budget\n");
+	if (faux_write_block(s[0], fill, 100) != 100)
+		goto error;
+	r = faux_async_in(in);
+	if ((r != 100) || (t.len != 100)) {
+		fprintf(stderr, "Read error: %ld\n", r);
+		goto error;
+	}
+
+	printf("Read with full budget\n");
+	if (faux_buf_write(other, fill, 3000) != 3000)
+		goto error;
+	if (faux_write_block(s[0], fill, 10) != 10)
+		goto error;
+	faux_async_stat(in, &stat);
+	calls = stat.calls_in;
+	errno = 0;
+	r = faux_async_in(in);
+	if (r != 0) {
+		fprintf(stderr, "Full budget is not a backpressure: %ld\n", r);
+		goto error;
+	}
+	faux_async_stat(in, &stat);
+	if (stat.calls_in != calls) {
+		fprintf(stderr, "Read without read() call is counted\n");
+		goto error;
+	}
+
+	printf("Read after budget release\n");
+	faux_buf_free(other);
+	other = NULL;
+	r = faux_async_in(in);
+	if ((r != 10) || (t.len != 110)) {
+		fprintf(stderr, "Read error: %ld\n", r);
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_async_free(in);
+	faux_buf_free(other);
+	faux_buf_budget_free(budget);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+	faux_free(fill);
+	faux_free(t.data);
+
+	return ret;
+}
+
+
+static bool_t dgram_cb(faux_async_t *async, const struct iovec *pkts,
+	size_t pkt_num, void *user_data)
+{
+	dgram_t *d = (dgram_t *)user_data;
+	size_t i = 0;
+
+	d->calls++;
+	if (pkt_num > d->max_batch)
+		d->max_batch = pkt_num;
+	for (i = 0; i < pkt_num; i++) {
+		const char *data = (const char *)pkts[i].iov_base;
+		unsigned int n = d->pkts++;
+		// The long packet is dropped by receiver
+		if (n >= 100)
+			n++;
+		if ((pkts[i].iov_len != ((n % 50) + 1)) ||
+			(data[0] != (char)n) ||
+			(data[pkts[i].iov_len - 1] != (char)n))
+			d->broken = BOOL_TRUE;
+	}
+
+	async = async; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+int testc_faux_async_dgram(void)
+{
+	const unsigned int num = 300;
+	int ret = -1; // Pessimistic return value
+	int s[2] = {-1, -1};
+	faux_async_t *out = NULL;
+	faux_async_t *in = NULL;
+	dgram_t d = {};
+	char data[100] = {};
+	unsigned int i = 0;
+	unsigned int iter = 0;
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, s) < 0)
+		goto error;
+	out = faux_async_new(s[0]);
+	in = faux_async_new(s[1]);
+
+	printf("faux_async_set_dgram()\n");
+	if (!faux_async_set_dgram(out, 16, 0) ||
+		!faux_async_set_dgram(in, 8, 64)) {
+		fprintf(stderr, "faux_async_set_dgram() error\n");
+		goto error;
+	}
+	faux_async_set_dgram_cb(in, dgram_cb, &d);
+
+	printf("faux_async_write()\n");
+	for (i = 0; i < num; i++) {
+		size_t len = (i % 50) + 1;
+		memset(data, i, sizeof(data));
+		// Packet is longer than receiver's MTU
+		if (100 == i)
+			len = sizeof(data);
+		if (faux_async_write(out, data, len) != (ssize_t)len) {
+			fprintf(stderr, "faux_async_write() error\n");
+			goto error;
+		}
+		// Don't overflow receiver's socket queue
+		if ((i % 8) == 0)
+			faux_async_in(in);
+	}
+
+	printf("faux_async_out() + faux_async_in()\n");
+	while ((d.pkts < (num - 1)) && (iter++ < 1000)) {
+		if (faux_async_out(out) < 0) {
+			fprintf(stderr, "faux_async_out() error\n");
+			goto error;
+		}
+		if (faux_async_in(in) < 0) {
+			fprintf(stderr, "faux_async_in() error\n");
+			goto error;
+		}
+	}
+	if ((d.pkts != (num - 1)) || d.broken) {
+		fprintf(stderr, "Wrong packets: %u received\n", d.pkts);
+		goto error;
+	}
+	if ((d.max_batch > 8) || (d.calls >= d.pkts)) {
+		fprintf(stderr, "Packets are not batched\n");
+		goto error;
+	}
+
+	// Stream functions
+	if (faux_async_sendfile(out, 0, 0, 10) >= 0) {
+		fprintf(stderr, "faux_async_sendfile() must fail\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_async_free(out);
+	faux_async_free(in);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+
+	return ret;
+}
+
+
+int testc_faux_async_dgram_empty(void)
+{
+	int ret = -1; // Pessimistic return value
+	int s[2] = {-1, -1};
+	faux_async_t *out = NULL;
+	char data[100] = {};
+	unsigned int num = 0;
+	unsigned int i = 0;
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, s) < 0)
+		goto error;
+	fcntl(s[0], F_SETFL, O_NONBLOCK);
+	fcntl(s[1], F_SETFL, O_NONBLOCK);
+	out = faux_async_new(s[0]);
+	if (!faux_async_set_dgram(out, 16, 0)) {
+		fprintf(stderr, "faux_async_set_dgram() error\n");
+		goto error;
+	}
+
+	// Fill receiver's socket queue
+	while (send(s[0], "x", 1, 0) == 1)
+		num++;
+
+	printf("Zero-length packet is queued\n");
+	if (faux_async_write(out, data, 0) != 0) {
+		fprintf(stderr, "faux_async_write() error\n");
+		goto error;
+	}
+	for (i = 0; i < num; i++)
+		recv(s[1], data, sizeof(data), 0);
+
+	printf("The next packet doesn't overtake it\n");
+	if (faux_async_write(out, "abc", 3) != 3) {
+		fprintf(stderr, "faux_async_write() error\n");
+		goto error;
+	}
+	faux_async_out(out);
+	if (recv(s[1], data, sizeof(data), 0) != 0) {
+		fprintf(stderr, "Zero-length packet is reordered\n");
+		goto error;
+	}
+	if (recv(s[1], data, sizeof(data), 0) != 3) {
+		fprintf(stderr, "Packet is lost\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_async_free(out);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+
+	return ret;
+}
+
+
+typedef struct {
+	unsigned int num;
+	size_t len[8];
+	char data[1000];
+	size_t data_len;
+} frames_t;
+
+
+static bool_t frame_cb(faux_async_t *async, faux_buf_t *buf, size_t len,
+	void *user_data)
+{
+	frames_t *frames = (frames_t *)user_data;
+	void *data = NULL;
+
+	// Frame is continuous
+	data = faux_buf_linearize(buf, len);
+	if (frames->num < 8)
+		frames->len[frames->num] = len;
+	frames->num++;
+	memcpy(frames->data + frames->data_len, data, len);
+	frames->data_len += len;
+	// The third frame is not read. So it will be dropped
+	if (frames->num != 3)
+		faux_buf_read(buf, frames->data + frames->data_len - len, len);
+
+	async = async; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static int frames_feed(int fd, faux_async_t *async, const char *data,
+	size_t len, size_t step)
+{
+	size_t i = 0;
+
+	for (i = 0; i < len; i += step) {
+		size_t l = ((len - i) < step) ? (len - i) : step;
+		if (write(fd, data + i, l) != (ssize_t)l)
+			return -1;
+		if (faux_async_in(async) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+int testc_faux_async_frame(void)
+{
+	int ret = -1; // Pessimistic return value
+	faux_async_t *in = NULL;
+	int pipefd[2] = {-1, -1};
+	frames_t frames = {};
+	const char lf[] = "\x00\x03" "abc" "\x00\x00" "\x00\x05" "hello"
+		"\x00\x01" "z";
+	const char delim[] = "one\r\ntwo\r\n\r\nthree";
+	char msg[100] = {};
+	faux_hdr_t *hdr = (faux_hdr_t *)msg;
+	faux_buf_budget_t *budget = NULL;
+	char tmp[100] = {};
+
+	if (pipe(pipefd) < 0)
+		goto error;
+	in = faux_async_new(pipefd[0]);
+	faux_async_set_read_cb(in, frame_cb, &frames);
+
+	// Length field. Frames are fed by 3 bytes
+	printf("faux_async_set_frame_len()\n");
+	faux_async_set_frame_len(in, 0, 2, FAUX_ASYNC_BIG_ENDIAN, 0);
+	if (frames_feed(pipefd[1], in, lf, sizeof(lf) - 1, 3) < 0)
+		goto error;
+	if ((frames.num != 4) || (frames.len[0] != 5) ||
+		(frames.len[1] != 2) || (frames.len[2] != 7) ||
+		(frames.len[3] != 3) ||
+		(memcmp(frames.data, lf, sizeof(lf) - 1) != 0) ||
+		(faux_buf_len(faux_async_ibuf(in)) != 0)) {
+		fprintf(stderr, "Wrong length-prefixed frames\n");
+		goto error;
+	}
+
+	// Delimiter. The last frame is incomplete
+	printf("faux_async_set_frame_delim()\n");
+	memset(&frames, 0, sizeof(frames));
+	faux_async_set_frame_delim(in, "\r\n", 2);
+	if (frames_feed(pipefd[1], in, delim, sizeof(delim) - 1, 1) < 0)
+		goto error;
+	if ((frames.num != 3) || (frames.len[0] != 5) ||
+		(frames.len[1] != 5) || (frames.len[2] != 2) ||
+		(faux_buf_len(faux_async_ibuf(in)) != 5)) {
+		fprintf(stderr, "Wrong delimited frames\n");
+		goto error;
+	}
+	faux_buf_empty(faux_async_ibuf(in));
+
+	// Message header
+	printf("faux_async_set_frame_msg()\n");
+	memset(&frames, 0, sizeof(frames));
+	faux_async_set_frame_msg(in);
+	faux_hdr_set_len(hdr, sizeof(*hdr) + 10);
+	if (frames_feed(pipefd[1], in, msg, sizeof(*hdr) + 10, 7) < 0)
+		goto error;
+	if ((frames.num != 1) || (frames.len[0] != (sizeof(*hdr) + 10))) {
+		fprintf(stderr, "Wrong message frame\n");
+		goto error;
+	}
+
+	// Budget shortage is temporary. Frame is not broken
+	printf("Frame with exhausted budget\n");
+	memset(&frames, 0, sizeof(frames));
+	faux_async_set_frame_len(in, 0, 2, FAUX_ASYNC_BIG_ENDIAN, 0);
+	budget = faux_buf_budget_new();
+	faux_buf_budget_set_limit(budget, 8);
+	faux_async_set_budget(in, budget);
+	if (write(pipefd[1], "\x00\x14" "0123456789", 12) != 12)
+		goto error;
+	if ((faux_async_in(in) != 8) || (frames.num != 0)) {
+		fprintf(stderr, "Budget shortage breaks frame\n");
+		goto error;
+	}
+	faux_async_set_budget(in, NULL);
+	faux_buf_empty(faux_async_ibuf(in));
+	while (read(pipefd[0], tmp, sizeof(tmp)) > 0);
+
+	// Frame can't fit into input buffer
+	printf("Too long frame\n");
+	faux_async_set_read_overflow(in, 10);
+	if (write(pipefd[1], "\x00\x14" "0123456789", 12) != 12)
+		goto error;
+	if ((faux_async_in(in) >= 0) || (errno != EMSGSIZE)) {
+		fprintf(stderr, "Too long frame is not detected\n");
+		goto error;
+	}
+	faux_async_set_read_overflow(in, FAUX_ASYNC_IN_OVERFLOW);
+	faux_buf_empty(faux_async_ibuf(in));
+	while (read(pipefd[0], tmp, sizeof(tmp)) > 0);
+	faux_async_set_frame_msg(in);
+
+	// Broken frame
+	printf("Broken frame\n");
+	faux_hdr_set_len(hdr, 1);
+	if (frames_feed(pipefd[1], in, msg, sizeof(*hdr), 100) == 0) {
+		fprintf(stderr, "Broken frame is not detected\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	if (pipefd[0] >= 0)
+		close(pipefd[0]);
+	if (pipefd[1] >= 0)
+		close(pipefd[1]);
+	faux_async_free(in);
+	faux_buf_budget_free(budget);
+
+	return ret;
+}
+
+
+typedef struct {
+	faux_async_t *async;
+	unsigned int calls;
+} eloop_test_t;
+
+
+static bool_t eloop_fd_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	eloop_test_t *t = (eloop_test_t *)user_data;
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+
+	t->calls++;
+	if (info->revents & POLLIN)
+		faux_async_in_easy(t->async);
+	if (info->revents & POLLOUT)
+		faux_async_out(t->async);
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t eloop_stop_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+	user_data = user_data; // Happy compiler
+
+	return BOOL_FALSE; // Stop loop
+}
+
+
+static void eloop_run(faux_eloop_t *eloop)
+{
+	struct timespec interval = {0, 100000000}; // 100ms
+
+	faux_eloop_add_sched_once_delayed(eloop, &interval, 1,
+		eloop_stop_cb, NULL);
+	faux_eloop_loop(eloop);
+}
+
+
+static bool_t deferred_write_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	eloop_test_t *t = (eloop_test_t *)user_data;
+	faux_async_stat_t stat = {};
+	unsigned int i = 0;
+
+	// Five small messages. Nothing is written within callback
+	for (i = 0; i < 5; i++)
+		faux_async_printf(t->async, "msg%u;", i);
+	faux_async_stat(t->async, &stat);
+	t->calls = stat.calls_out;
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+int testc_faux_async_deferred(void)
+{
+	int ret = -1; // Pessimistic return value
+	faux_eloop_t *eloop = NULL;
+	int s[2] = {-1, -1};
+	eloop_test_t t = {};
+	faux_async_stat_t stat = {};
+	struct timespec interval = {0, 10000000}; // 10ms
+	const char *etalon = "msg0;msg1;msg2;msg3;msg4;";
+	char buf[100] = {};
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, s) < 0)
+		goto error;
+	fcntl(s[1], F_SETFL, O_NONBLOCK);
+	eloop = faux_eloop_new(NULL);
+	t.async = faux_async_new(s[0]);
+	faux_eloop_add_fd(eloop, s[0], POLLIN, eloop_fd_cb, &t);
+	faux_async_set_eloop(t.async, eloop);
+	// Cork is ignored by UNIX socket
+	faux_async_set_deferred_flush(t.async, BOOL_TRUE, BOOL_TRUE);
+
+	printf("Deferred flush within event loop\n");
+	faux_eloop_add_sched_once_delayed(eloop, &interval, 2,
+		deferred_write_cb, &t);
+	eloop_run(eloop);
+	faux_async_stat(t.async, &stat);
+	if ((t.calls != 0) || (stat.calls_out != 1)) {
+		fprintf(stderr, "Wrong number of write calls: %lu\n",
+			stat.calls_out);
+		goto error;
+	}
+	if ((read(s[1], buf, sizeof(buf)) != (ssize_t)strlen(etalon)) ||
+		(memcmp(buf, etalon, strlen(etalon)) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+
+	printf("faux_async_set_deferred_flush(BOOL_FALSE)\n");
+	faux_async_write(t.async, "abc", 3);
+	if (read(s[1], buf, sizeof(buf)) >= 0) {
+		fprintf(stderr, "Data is written before flush\n");
+		goto error;
+	}
+	faux_async_set_deferred_flush(t.async, BOOL_FALSE, BOOL_FALSE);
+	if ((read(s[1], buf, sizeof(buf)) != 3) ||
+		(memcmp(buf, "abc", 3) != 0)) {
+		fprintf(stderr, "Data is not flushed\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_async_free(t.async);
+	faux_eloop_free(eloop);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+
+	return ret;
+}
+
+
+int testc_faux_async_eloop(void)
+{
+	const size_t len = 20000;
+	char *src = NULL;
+	char *dst = NULL;
+	int ret = -1; // Pessimistic return value
+	int s[2] = {-1, -1};
+	faux_eloop_t *eloop = NULL;
+	eloop_test_t t = {};
+
+	src = faux_testc_rnd_buf(len);
+	dst = faux_malloc(len);
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, s) < 0)
+		goto error;
+	t.async = faux_async_new(s[0]);
+	eloop = faux_eloop_new(NULL);
+	faux_eloop_add_fd(eloop, s[0], POLLIN | POLLOUT, eloop_fd_cb, &t);
+	faux_async_set_read_watermarks(t.async, 1000, 100);
+	faux_async_set_eloop(t.async, eloop);
+
+	// Output buffer is empty. So POLLOUT is excluded
+	printf("Empty output buffer\n");
+	eloop_run(eloop);
+	if (t.calls != 0) {
+		fprintf(stderr, "Loop spins on POLLOUT: %u calls\n", t.calls);
+		goto error;
+	}
+
+	// Input buffer reaches high watermark. So POLLIN is excluded
+	printf("Input buffer high watermark\n");
+	if (write(s[1], src, len) != (ssize_t)len)
+		goto error;
+	eloop_run(eloop);
+	if ((t.calls != 1) ||
+		(faux_buf_len(faux_async_ibuf(t.async)) != 4096)) {
+		fprintf(stderr, "Reading is not stopped: %u calls\n", t.calls);
+		goto error;
+	}
+
+	// Low watermark. Reading is resumed
+	printf("Input buffer low watermark\n");
+	faux_buf_read(faux_async_ibuf(t.async), dst, 4000);
+	eloop_run(eloop);
+	if ((t.calls != 2) ||
+		(faux_buf_len(faux_async_ibuf(t.async)) != (96 + 4096))) {
+		fprintf(stderr, "Reading is not resumed: %u calls\n", t.calls);
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_eloop_free(eloop);
+	faux_async_free(t.async);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+	faux_free(src);
+	faux_free(dst);
+
+	return ret;
+}
+
+
+typedef struct {
+	faux_async_t *async;
+	char *dst;
+	size_t len;
+	bool_t eof;
+	unsigned int fd_calls;
+} uring_test_t;
+
+
+static bool_t uring_read_cb(faux_async_t *async, faux_buf_t *buf, size_t len,
+	void *user_data)
+{
+	uring_test_t *t = (uring_test_t *)user_data;
+
+	faux_buf_read(buf, t->dst + t->len, len);
+	t->len += len;
+
+	async = async; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t uring_fd_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	uring_test_t *t = (uring_test_t *)user_data;
+
+	t->fd_calls++;
+	// Data is readed by completion operations. So it's EOF
+	if (faux_async_in(t->async) == 0) {
+		t->eof = BOOL_TRUE;
+		return BOOL_FALSE; // Stop loop
+	}
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+int testc_faux_async_uring(void)
+{
+	const size_t len = 1000000;
+	char *src = NULL;
+	int ret = -1; // Pessimistic return value
+	int s[2] = {-1, -1};
+	unsigned int i = 0;
+	faux_eloop_t *eloop = NULL;
+	faux_async_t *out = NULL;
+	eloop_test_t o = {};
+	uring_test_t t = {};
+
+	eloop = faux_eloop_new(NULL);
+	if (!faux_eloop_set_backend(eloop, FAUX_ELOOP_BACKEND_URING)) {
+		printf("io_uring backend is not supported. Skip test\n");
+		ret = 0;
+		goto error;
+	}
+	src = faux_testc_rnd_buf(len);
+	t.dst = faux_malloc(len);
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, s) < 0)
+		goto error;
+	out = faux_async_new(s[0]);
+	o.async = out;
+	t.async = faux_async_new(s[1]);
+	faux_async_set_read_cb(t.async, uring_read_cb, &t);
+	faux_eloop_add_fd(eloop, s[0], 0, eloop_fd_cb, &o);
+	faux_eloop_add_fd(eloop, s[1], POLLIN, uring_fd_cb, &t);
+	faux_async_set_eloop(out, eloop);
+	faux_async_set_eloop(t.async, eloop);
+
+	// Re-attach object with read operation in progress
+	printf("faux_async_set_eloop()\n");
+	faux_async_set_eloop(t.async, NULL);
+	faux_async_set_eloop(t.async, eloop);
+
+	printf("faux_async_write()\n");
+	if (faux_async_write(out, src, len) != (ssize_t)len)
+		goto error;
+	if (faux_buf_len(faux_async_obuf(out)) == 0) {
+		fprintf(stderr, "Data is not buffered\n");
+		goto error;
+	}
+	while ((t.len < len) && (i++ < 50))
+		eloop_run(eloop);
+	if ((t.len != len) || (memcmp(src, t.dst, len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+	if ((t.fd_calls != 0) || (o.calls != 0)) {
+		fprintf(stderr, "Data is transferred by fd events\n");
+		goto error;
+	}
+
+	// EOF is returned to fd events
+	printf("EOF\n");
+	shutdown(s[0], SHUT_WR);
+	eloop_run(eloop);
+	if (!t.eof || (t.fd_calls != 1)) {
+		fprintf(stderr, "EOF is not detected\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_async_free(out);
+	faux_async_free(t.async);
+	faux_eloop_free(eloop);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+	faux_free(src);
+	faux_free(t.dst);
+
+	return ret;
+}
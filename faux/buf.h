@@ -5,17 +5,50 @@
 #ifndef _faux_buf_h
 #define _faux_buf_h
 
+#include <stdarg.h>
+
 #include <faux/faux.h>
 #include <faux/sched.h>
 
 #define FAUX_BUF_UNLIMITED 0
+// Chunk cache is disabled
+#define FAUX_BUF_CACHE_NONE 0
 
 typedef struct faux_buf_s faux_buf_t;
+typedef struct faux_buf_seg_s faux_buf_seg_t;
+typedef struct faux_buf_budget_s faux_buf_budget_t;
+
+// Buffer types (backends)
+typedef enum {
+	FAUX_BUF_CHUNKED = 0, // List of chunks
+	FAUX_BUF_RING = 1 // Double-mapped ring. Data is always continuous
+} faux_buf_type_e;
+
+// Statistics of chunk cache or per-thread chunk pool
+typedef struct {
+	size_t hits; // Number of chunks taken from cache
+	size_t misses; // Number of chunk requests not satisfied by cache
+	size_t retained; // Size of free chunks kept within cache (bytes)
+} faux_buf_cache_stat_t;
+
+// Release callback of shared segment that references user's memory
+typedef void (*faux_buf_seg_free_fn)(void *user_data);
+
+// Buffer watermark callback. The "high" is BOOL_TRUE when high watermark is
+// reached and BOOL_FALSE when buffer length falls down to low watermark.
+typedef void (*faux_buf_watermark_cb_fn)(faux_buf_t *buf,
+	bool_t high, void *user_data);
+
+// Budget watermark callback. The "high" is BOOL_TRUE when high watermark is
+// reached and BOOL_FALSE when data length falls down to low watermark.
+typedef void (*faux_buf_budget_cb_fn)(faux_buf_budget_t *budget,
+	bool_t high, void *user_data);
 
 
 C_DECL_BEGIN
 
 faux_buf_t *faux_buf_new(size_t chunk_size);
+faux_buf_t *faux_buf_new_type(size_t size, faux_buf_type_e type);
 void faux_buf_free(faux_buf_t *buf);
 ssize_t faux_buf_len(const faux_buf_t *buf);
 ssize_t faux_buf_limit(const faux_buf_t *buf);
@@ -24,20 +57,78 @@ bool_t faux_buf_will_be_overflow(const faux_buf_t *buf, size_t add_len);
 size_t faux_buf_is_wlocked(const faux_buf_t *buf);
 size_t faux_buf_is_rlocked(const faux_buf_t *buf);
 ssize_t faux_buf_write(faux_buf_t *buf, const void *data, size_t len);
+ssize_t faux_buf_vprintf(faux_buf_t *buf, const char *fmt, va_list ap);
+ssize_t faux_buf_printf(faux_buf_t *buf, const char *fmt, ...);
 ssize_t faux_buf_read(faux_buf_t *buf, void *data, size_t len);
 ssize_t faux_buf_dread_lock(faux_buf_t *buf, size_t len,
 	struct iovec **iov, size_t *iov_num);
+ssize_t faux_buf_dread_lock_iov(faux_buf_t *buf, size_t len,
+	struct iovec *iov, size_t *iov_num);
 ssize_t faux_buf_dread_unlock(faux_buf_t *buf, size_t really_readed,
 	struct iovec *iov);
 ssize_t faux_buf_dwrite_lock(faux_buf_t *buf, size_t len,
 	struct iovec **iov_out, size_t *iov_num_out);
+ssize_t faux_buf_dwrite_lock_iov(faux_buf_t *buf, size_t len,
+	struct iovec *iov, size_t *iov_num);
 ssize_t faux_buf_dwrite_unlock(faux_buf_t *buf, size_t really_written,
 	struct iovec *iov);
 ssize_t faux_buf_dwrite_lock_easy(faux_buf_t *buf, void **data);
 ssize_t faux_buf_dwrite_unlock_easy(faux_buf_t *buf, size_t really_written);
 ssize_t faux_buf_dread_lock_easy(faux_buf_t *buf, void **data);
 ssize_t faux_buf_dread_unlock_easy(faux_buf_t *buf, size_t really_readed);
+ssize_t faux_buf_dread_unlock_pin(faux_buf_t *buf, size_t really_readed,
+	struct iovec *iov, unsigned int pin);
+bool_t faux_buf_unpin(faux_buf_t *buf, unsigned int pin);
 bool_t faux_buf_empty(faux_buf_t *buf);
+ssize_t faux_buf_write_to_fd(faux_buf_t *buf, int fd, size_t len,
+	size_t *calls);
+ssize_t faux_buf_read_from_fd(faux_buf_t *buf, int fd, size_t len,
+	size_t *calls);
+ssize_t faux_buf_move(faux_buf_t *dst, faux_buf_t *src, size_t len);
+ssize_t faux_buf_peek(const faux_buf_t *buf, size_t offset,
+	void *dst, size_t len);
+void *faux_buf_linearize(faux_buf_t *buf, size_t len);
+ssize_t faux_buf_find_byte(const faux_buf_t *buf, size_t offset, char byte);
+ssize_t faux_buf_find_seq(const faux_buf_t *buf, size_t offset,
+	const void *seq, size_t seq_len);
+
+faux_buf_seg_t *faux_buf_seg_new(const void *data, size_t len);
+faux_buf_seg_t *faux_buf_seg_newv(const struct iovec *iov, size_t iov_num);
+faux_buf_seg_t *faux_buf_seg_new_ref(const void *data, size_t len,
+	faux_buf_seg_free_fn free_fn, void *user_data);
+faux_buf_seg_t *faux_buf_seg_ref(faux_buf_seg_t *seg);
+void faux_buf_seg_free(faux_buf_seg_t *seg);
+const void *faux_buf_seg_data(const faux_buf_seg_t *seg);
+ssize_t faux_buf_seg_len(const faux_buf_seg_t *seg);
+ssize_t faux_buf_append_seg(faux_buf_t *buf, faux_buf_seg_t *seg);
+ssize_t faux_buf_append_ref(faux_buf_t *buf,
+	const struct iovec *iov, size_t iov_num,
+	faux_buf_seg_free_fn free_fn, void *user_data);
+
+bool_t faux_buf_set_cache_limit(faux_buf_t *buf, size_t limit);
+bool_t faux_buf_cache_stat(const faux_buf_t *buf, faux_buf_cache_stat_t *stat);
+void faux_buf_pool_set_limit(size_t limit);
+void faux_buf_pool_stat(faux_buf_cache_stat_t *stat);
+bool_t faux_buf_set_chunk_policy(faux_buf_t *buf,
+	size_t size, size_t min, size_t max);
+ssize_t faux_buf_chunk_size(const faux_buf_t *buf);
+
+faux_buf_budget_t *faux_buf_budget_new(void);
+void faux_buf_budget_free(faux_buf_budget_t *budget);
+bool_t faux_buf_budget_set_limit(faux_buf_budget_t *budget, size_t limit);
+bool_t faux_buf_budget_set_watermarks(faux_buf_budget_t *budget,
+	size_t high, size_t low);
+bool_t faux_buf_budget_set_cb(faux_buf_budget_t *budget,
+	faux_buf_budget_cb_fn cb, void *user_data);
+ssize_t faux_buf_budget_len(const faux_buf_budget_t *budget);
+bool_t faux_buf_budget_is_high(const faux_buf_budget_t *budget);
+bool_t faux_buf_budget_will_be_overflow(const faux_buf_budget_t *budget,
+	size_t add_len);
+bool_t faux_buf_set_budget(faux_buf_t *buf, faux_buf_budget_t *budget);
+bool_t faux_buf_set_watermarks(faux_buf_t *buf, size_t high, size_t low,
+	faux_buf_watermark_cb_fn cb, void *user_data);
+bool_t faux_buf_set_owner_watermarks(faux_buf_t *buf, size_t high, size_t low,
+	faux_buf_watermark_cb_fn cb, void *user_data);
 
 C_DECL_END
 
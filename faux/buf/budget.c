@@ -0,0 +1,349 @@
+/** @file budget.c
+ * @brief Memory budget shared by dynamic buffers.
+ *
+ * Budget object tracks total length of data stored within all attached
+ * buffers. The limit of single buffer (faux_buf_set_limit()) doesn't restrict
+ * memory used by many buffers. For example server with a lot of connections
+ * can consume all memory when consumers are slow. Budget can have hard limit
+ * so writing to any attached buffer fails when budget is exhausted.
+ *
+ * Budget has high and low watermarks. Callback is executed when total length
+ * reaches high watermark and then when it falls down to low watermark. So
+ * application can pause reading or shed load. While budget is above high
+ * watermark the free chunks are not retained by buffer's caches and
+ * per-thread pool. Chunks that are already cached are freed on reaching high
+ * watermark.
+ *
+ * Budget is not thread safe. All attached buffers must be used within the
+ * same thread.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "faux/faux.h"
+#include "faux/list.h"
+#include "faux/buf.h"
+
+#include "private.h"
+
+struct faux_buf_budget_s {
+	size_t len; // Total length of data within attached buffers
+	size_t limit; // Hard limit. The "0" means unlimited
+	size_t high; // High watermark. The "0" means watermarks are disabled
+	size_t low; // Low watermark
+	bool_t is_high; // Budget reached high watermark and not released yet
+	faux_buf_budget_cb_fn cb; // Watermark callback
+	void *cb_udata;
+	faux_list_t *bufs; // Attached buffers
+};
+
+
+/** @brief Creates new memory budget object.
+ *
+ * Budget is unlimited and has no watermarks by default.
+ *
+ * @return Allocated object or NULL on error.
+ */
+faux_buf_budget_t *faux_buf_budget_new(void)
+{
+	faux_buf_budget_t *budget = NULL;
+
+	budget = faux_zmalloc(sizeof(*budget));
+	assert(budget);
+	if (!budget)
+		return NULL;
+
+	// Init
+	budget->len = 0;
+	budget->limit = FAUX_BUF_UNLIMITED;
+	budget->high = 0;
+	budget->low = 0;
+	budget->is_high = BOOL_FALSE;
+	budget->cb = NULL;
+	budget->cb_udata = NULL;
+	budget->bufs = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, NULL);
+	assert(budget->bufs);
+	if (!budget->bufs) {
+		faux_free(budget);
+		return NULL;
+	}
+
+	return budget;
+}
+
+
+/** @brief Frees memory budget object.
+ *
+ * All attached buffers are detached from budget.
+ *
+ * @param [in] budget Budget object.
+ */
+void faux_buf_budget_free(faux_buf_budget_t *budget)
+{
+	faux_list_node_t *node = NULL;
+
+	if (!budget)
+		return;
+
+	while ((node = faux_list_head(budget->bufs)))
+		faux_buf_set_budget((faux_buf_t *)faux_list_data(node), NULL);
+	faux_list_free(budget->bufs);
+
+	faux_free(budget);
+}
+
+
+/** @brief Sets hard limit of budget.
+ *
+ * Write to attached buffer fails if total length of data will exceed limit.
+ * The "0" means unlimited budget.
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ * @param [in] limit Max total length of data.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_budget_set_limit(faux_buf_budget_t *budget, size_t limit)
+{
+	assert(budget);
+	if (!budget)
+		return BOOL_FALSE;
+
+	budget->limit = limit;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Checks watermarks and executes callback on state change.
+ *
+ * Static internal function.
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ */
+static void faux_buf_budget_check(faux_buf_budget_t *budget)
+{
+	faux_list_node_t *iter = NULL;
+	faux_buf_t *buf = NULL;
+
+	if (budget->is_high) {
+		if ((0 != budget->high) && (budget->len > budget->low))
+			return;
+		budget->is_high = BOOL_FALSE;
+		if (budget->cb)
+			budget->cb(budget, BOOL_FALSE, budget->cb_udata);
+		return;
+	}
+
+	if ((0 == budget->high) || (budget->len < budget->high))
+		return;
+	budget->is_high = BOOL_TRUE;
+	// Release idle memory under pressure
+	iter = faux_list_head(budget->bufs);
+	while ((buf = (faux_buf_t *)faux_list_each(&iter)))
+		faux_buf_release_idle(buf);
+	faux_buf_pool_release_idle();
+	if (budget->cb)
+		budget->cb(budget, BOOL_TRUE, budget->cb_udata);
+}
+
+
+/** @brief Sets high and low watermarks of budget.
+ *
+ * The "high" value must be greater than "low" value. The "0" high watermark
+ * disables watermarks.
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ * @param [in] high High watermark.
+ * @param [in] low Low watermark.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_budget_set_watermarks(faux_buf_budget_t *budget,
+	size_t high, size_t low)
+{
+	assert(budget);
+	if (!budget)
+		return BOOL_FALSE;
+	if ((high != 0) && (low >= high))
+		return BOOL_FALSE;
+
+	budget->high = high;
+	budget->low = low;
+	faux_buf_budget_check(budget);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Sets watermark callback.
+ *
+ * Callback is executed with "high" argument BOOL_TRUE when total length of
+ * data reaches high watermark. Then callback is executed with BOOL_FALSE when
+ * total length falls down to low watermark.
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ * @param [in] cb Callback function.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_budget_set_cb(faux_buf_budget_t *budget,
+	faux_buf_budget_cb_fn cb, void *user_data)
+{
+	assert(budget);
+	if (!budget)
+		return BOOL_FALSE;
+
+	budget->cb = cb;
+	budget->cb_udata = user_data;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets total length of data within attached buffers.
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ * @return Total length or < 0 on error.
+ */
+ssize_t faux_buf_budget_len(const faux_buf_budget_t *budget)
+{
+	assert(budget);
+	if (!budget)
+		return -1;
+
+	return budget->len;
+}
+
+
+/** @brief Checks if budget is above high watermark.
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ * @return BOOL_TRUE - high watermark is reached, BOOL_FALSE - otherwise.
+ */
+bool_t faux_buf_budget_is_high(const faux_buf_budget_t *budget)
+{
+	assert(budget);
+	if (!budget)
+		return BOOL_FALSE;
+
+	return budget->is_high;
+}
+
+
+/** @brief Checks if budget will be exhausted after writing some data.
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ * @param [in] add_len Length of data to write.
+ * @return BOOL_TRUE - it will be overflow, BOOL_FALSE - enough space.
+ */
+bool_t faux_buf_budget_will_be_overflow(const faux_buf_budget_t *budget,
+	size_t add_len)
+{
+	assert(budget);
+	if (!budget)
+		return BOOL_FALSE;
+
+	if (FAUX_BUF_UNLIMITED == budget->limit)
+		return BOOL_FALSE;
+
+	if ((budget->len + add_len) > budget->limit)
+		return BOOL_TRUE;
+
+	return BOOL_FALSE;
+}
+
+
+/** @brief Gets free space of budget.
+ *
+ * Internal function.
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ * @return Length of data that can be written or SIZE_MAX if budget is
+ * unlimited.
+ */
+FAUX_HIDDEN size_t faux_buf_budget_space(const faux_buf_budget_t *budget)
+{
+	if (FAUX_BUF_UNLIMITED == budget->limit)
+		return SIZE_MAX;
+
+	return (budget->limit > budget->len) ?
+		(budget->limit - budget->len) : 0;
+}
+
+
+/** @brief Registers buffer within budget.
+ *
+ * Internal function. Used by faux_buf_set_budget().
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ * @param [in] buf Buffer to attach.
+ * @return List node to detach buffer later or NULL on error.
+ */
+FAUX_HIDDEN faux_list_node_t *faux_buf_budget_attach(faux_buf_budget_t *budget,
+	faux_buf_t *buf)
+{
+	faux_list_node_t *node = NULL;
+
+	node = faux_list_add(budget->bufs, buf);
+	if (!node)
+		return NULL;
+	faux_buf_budget_inc(budget, faux_buf_len(buf));
+
+	return node;
+}
+
+
+/** @brief Unregisters buffer.
+ *
+ * Internal function. Used by faux_buf_set_budget().
+ *
+ * @param [in] budget Allocated and initialized budget object.
+ * @param [in] node List node returned by faux_buf_budget_attach().
+ */
+FAUX_HIDDEN void faux_buf_budget_detach(faux_buf_budget_t *budget,
+	faux_list_node_t *node)
+{
+	faux_buf_t *buf = (faux_buf_t *)faux_list_takeaway(budget->bufs, node);
+
+	faux_buf_budget_dec(budget, faux_buf_len(buf));
+}
+
+
+/** @brief Adds length of data written to attached buffer.
+ *
+ * Internal function.
+ *
+ * @param [in] budget Budget object. Can be NULL.
+ * @param [in] len Length of data.
+ */
+FAUX_HIDDEN void faux_buf_budget_inc(faux_buf_budget_t *budget, size_t len)
+{
+	if (!budget || (0 == len))
+		return;
+
+	budget->len += len;
+	faux_buf_budget_check(budget);
+}
+
+
+/** @brief Subtracts length of data removed from attached buffer.
+ *
+ * Internal function.
+ *
+ * @param [in] budget Budget object. Can be NULL.
+ * @param [in] len Length of data.
+ */
+FAUX_HIDDEN void faux_buf_budget_dec(faux_buf_budget_t *budget, size_t len)
+{
+	if (!budget || (0 == len))
+		return;
+
+	budget->len -= (len < budget->len) ? len : budget->len;
+	faux_buf_budget_check(budget);
+}
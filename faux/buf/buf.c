@@ -10,41 +10,237 @@
  * "struct iovec" array to write to. After that we unlock buffer. So we don't
  * need additional temporary buffer beetween file's read() and dynamic buffer.
  * Dynamic buffer has the same functionality for reading from it.
+ *
+ * There are two types of buffer. The default one (FAUX_BUF_CHUNKED) stores data
+ * within list of chunks. The FAUX_BUF_RING type uses fixed size ring that
+ * is mapped twice back-to-back. So any readable or writable region is a single
+ * continuous span. It's suitable for bounded buffers and protocol parsers that
+ * don't want to copy data across chunk boundaries.
+ *
+ * The shared segment (faux_buf_seg_t) is a reference counted read-only block
+ * of data. It can be appended to many chunked buffers without copying. For
+ * example the same message can be broadcasted to many connections. Segment is
+ * freed when the last buffer has read it. Segment can reference user's memory
+ * without copying. Then release callback informs user that memory is not used
+ * anymore.
+ *
+ * Many buffers can share memory budget (faux_buf_budget_t). See budget.c.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
 #include <syslog.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "faux/faux.h"
 #include "faux/str.h"
 #include "faux/buf.h"
 
+#include "private.h"
+
 // Default chunk size
 #define DATA_CHUNK 4096
 
+// Number of "struct iovec" entries allocated on stack by read/write functions
+#define LOCAL_IOV_NUM 16
+
+// Max number of "struct iovec" entries for single readv()/writev()
+#ifdef IOV_MAX
+#define FD_IOV_NUM IOV_MAX
+#else
+#define FD_IOV_NUM 1024
+#endif
+
+// Size of stack buffer for formatted string that doesn't fit into chunk
+#define SPILL_LOCAL_LEN 256
+
+// Initial number of entries within chunk array
+#define CHUNKS_MIN 8
+
+// Index of chunk that doesn't exist
+#define NO_CHUNK ((size_t)-1)
+
+// Size classes of per-thread chunk pool. Chunk sizes from 64 bytes to 1 MiB.
+// Only chunks with power-of-two size can be stored within pool.
+#define POOL_MIN_SHIFT 6
+#define POOL_MAX_SHIFT 20
+#define POOL_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+
+// Data chunk. The chunk descriptor and chunk memory are allocated as a
+// single block. Each chunk has its own read and write positions so chunks
+// can be moved between buffers as is.
+typedef struct faux_buf_chunk_s faux_buf_chunk_t;
+struct faux_buf_chunk_s {
+	char *data; // Chunk memory
+	size_t size; // Size of chunk memory
+	size_t start; // Read position. Start of data within chunk
+	size_t end; // Write position. End of data within chunk
+	faux_buf_chunk_t *next; // Link to next free chunk within cache or pool
+	faux_buf_seg_t *seg; // Shared segment. NULL if chunk owns its memory
+	bool_t pinned; // Memory is used by kernel (zero-copy send)
+	unsigned int pin; // Pin identifier. See faux_buf_dread_unlock_pin()
+};
+
+// Shared read-only segment. Segment header and data are single memory block.
+// Segment can reference user's memory. Then "free_fn" is executed on release.
+struct faux_buf_seg_s {
+	char *data;
+	size_t len;
+	unsigned int refcnt;
+	faux_buf_seg_free_fn free_fn; // Release callback for user's memory
+	void *free_udata;
+};
+
+// Set of watermarks
+typedef struct faux_buf_wm_s {
+	size_t high; // High watermark. The "0" means watermarks are disabled
+	size_t low; // Low watermark
+	bool_t is_high; // Buffer reached high watermark and not released yet
+	faux_buf_watermark_cb_fn cb; // Watermark callback
+	void *udata;
+} faux_buf_wm_t;
+
+// Indexes of watermark sets
+#define WM_USER 0 // See faux_buf_set_watermarks()
+#define WM_OWNER 1 // See faux_buf_set_owner_watermarks()
+#define WM_NUM 2
+
+// Per-thread pool of free chunks
+typedef struct faux_buf_pool_s {
+	faux_buf_chunk_t *free[POOL_CLASSES]; // Stacks of free chunks
+	size_t limit; // Max retained bytes. The "0" means pool is disabled
+	faux_buf_cache_stat_t stat;
+} faux_buf_pool_t;
+
+static __thread faux_buf_pool_t faux_buf_pool = {};
+// The key is used to free pool on thread exit
+static pthread_key_t faux_buf_pool_key;
+static pthread_once_t faux_buf_pool_once = PTHREAD_ONCE_INIT;
+
 struct faux_buf_s {
-	faux_list_t *list; // List of chunks
-	faux_list_node_t *wchunk; // Chunk to write to. NULL if list is empty
-	size_t rpos; // Read position within first chunk
-	size_t wpos; // Write position within wchunk (can be non-last chunk)
-	size_t chunk_size; // Size of chunk
+	faux_buf_chunk_t **chunks; // Circular array of chunk descriptors
+	size_t chunks_cap; // Size of array (power of two)
+	size_t chunks_head; // Array index of the first chunk
+	size_t chunks_num; // Number of chunks
+	size_t wchunk; // Index of chunk to write to. NO_CHUNK if there is no
+	size_t chunk_size; // Size of new chunks
+	size_t chunk_min; // Min chunk size for adaptive sizing
+	size_t chunk_max; // Max chunk size. Size is fixed if max <= min
 	size_t len; // Whole data length
 	size_t limit; // Overflow limit
 	size_t rlocked; // How much space is locked for reading
 	size_t wlocked; // How much space is locked for writing
+	faux_buf_chunk_t *cache; // Stack of free chunks to reuse
+	size_t cache_limit; // Max retained bytes. The "0" means no cache
+	faux_buf_cache_stat_t cache_stat;
+	char *ring; // Double-mapped ring. NULL for FAUX_BUF_CHUNKED buffer
+	size_t ring_size; // Size of ring (power of two)
+	size_t ring_rpos; // Read position within ring
+	faux_buf_budget_t *budget; // Shared memory budget. Can be NULL
+	faux_list_node_t *budget_node; // Node within budget's list of buffers
+	faux_buf_wm_t wm[WM_NUM]; // User's and owner's watermarks
+	faux_buf_chunk_t *pinned; // Queue of released but pinned chunks
+	faux_buf_chunk_t *pinned_tail; // The last chunk within pinned queue
 };
 
 
+static void faux_buf_release_chunk(faux_buf_t *buf, faux_buf_chunk_t *chunk);
+static void faux_buf_del_chunk(faux_buf_t *buf, size_t index);
+static void faux_buf_del_all_chunks(faux_buf_t *buf);
+static void faux_buf_account_add(faux_buf_t *buf, size_t len);
+static void faux_buf_account_sub(faux_buf_t *buf, size_t len);
+static void faux_buf_pool_key_create(void);
+static bool_t faux_buf_wm_set(faux_buf_t *buf, faux_buf_wm_t *wm,
+	size_t high, size_t low, faux_buf_watermark_cb_fn cb, void *user_data);
+static void faux_buf_wm_check_high(faux_buf_t *buf, faux_buf_wm_t *wm);
+static void faux_buf_wm_check_low(faux_buf_t *buf, faux_buf_wm_t *wm);
+
+
 /** @brief Create new dynamic buffer object.
  *
  * @param [in] chunk_size Chunk size. If "0" then default size will be used.
  * @return Allocated object or NULL on error.
  */
 faux_buf_t *faux_buf_new(size_t chunk_size)
+{
+	return faux_buf_new_type(chunk_size, FAUX_BUF_CHUNKED);
+}
+
+
+/** @brief Maps ring memory twice back-to-back.
+ *
+ * Static internal function. Memory is created by memfd_create(). The region
+ * of doubled size is reserved and then memory is mapped to both halves of it.
+ *
+ * @param [in] size Ring size. Must be multiple of page size.
+ * @return Pointer to mapped memory or NULL on error.
+ */
+static char *faux_buf_ring_map(size_t size)
+{
+#ifdef HAVE_MEMFD_CREATE
+	int fd = -1;
+	char *base = MAP_FAILED;
+
+	fd = memfd_create("faux_buf", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, size) < 0)
+		goto err;
+	// Reserve address space for both copies
+	base = mmap(NULL, size * 2, PROT_NONE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == base)
+		goto err;
+	if (mmap(base, size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto err;
+	if (mmap(base + size, size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto err;
+	close(fd);
+
+	return base;
+
+err:
+	if (base != MAP_FAILED)
+		munmap(base, size * 2);
+	close(fd);
+	return NULL;
+
+#else // No memfd_create()
+	size = size; // Happy compiler
+	return NULL;
+#endif
+}
+
+
+/** @brief Create new dynamic buffer object of specified type.
+ *
+ * The FAUX_BUF_CHUNKED buffer is a list of chunks. The "size" argument is a
+ * chunk size for it. If "0" then default size will be used.
+ *
+ * The FAUX_BUF_RING buffer is a fixed size ring. The "size" argument is a ring
+ * size. It will be rounded up to power of two (and page size at least). Buffer
+ * limit can't be greater than ring size. Ring type is available on systems
+ * with memfd_create() only.
+ *
+ * @param [in] size Chunk size or ring size.
+ * @param [in] type Buffer type.
+ * @return Allocated object or NULL on error.
+ */
+faux_buf_t *faux_buf_new_type(size_t size, faux_buf_type_e type)
 {
 	faux_buf_t *buf = NULL;
 
@@ -54,22 +250,53 @@ faux_buf_t *faux_buf_new(size_t chunk_size)
 		return NULL;
 
 	// Init
-	buf->chunk_size = (chunk_size != 0) ? chunk_size : DATA_CHUNK;
+	buf->chunk_size = (size != 0) ? size : DATA_CHUNK;
+	buf->chunk_min = buf->chunk_size;
+	buf->chunk_max = buf->chunk_size;
 	buf->limit = FAUX_BUF_UNLIMITED;
-	buf->list = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
-		NULL, NULL, faux_free);
-	buf->rpos = 0;
-	buf->wpos = buf->chunk_size;
+	// Array is allocated on first write
+	buf->chunks = NULL;
+	buf->chunks_cap = 0;
+	buf->chunks_head = 0;
+	buf->chunks_num = 0;
 	buf->len = 0;
-	buf->wchunk = NULL;
+	buf->wchunk = NO_CHUNK;
 	buf->rlocked = 0; // Unlocked
 	buf->wlocked = 0; // Unlocked
+	buf->cache = NULL;
+	buf->cache_limit = FAUX_BUF_CACHE_NONE;
+	buf->ring = NULL;
+	buf->ring_size = 0;
+	buf->ring_rpos = 0;
+	buf->budget = NULL;
+	buf->budget_node = NULL;
+	memset(buf->wm, 0, sizeof(buf->wm));
+	buf->pinned = NULL;
+	buf->pinned_tail = NULL;
+
+	if (FAUX_BUF_RING == type) {
+		size_t ring_size = getpagesize();
+		while (ring_size < size)
+			ring_size <<= 1;
+		buf->ring = faux_buf_ring_map(ring_size);
+		if (!buf->ring) {
+			faux_buf_free(buf);
+			return NULL;
+		}
+		buf->ring_size = ring_size;
+		buf->chunk_size = ring_size;
+		buf->limit = ring_size;
+	}
 
 	return buf;
 }
 
 
 /** @brief Free dynamic buffer object.
+ *
+ * Pinned chunks (see faux_buf_dread_unlock_pin()) must be unpinned before
+ * buffer is freed. Else they are freed while kernel can still use their
+ * memory. Such chunks are never reused by another buffer.
  *
  * @param [in] buf Buffer object.
  */
@@ -78,7 +305,22 @@ void faux_buf_free(faux_buf_t *buf)
 	if (!buf)
 		return;
 
-	faux_list_free(buf->list);
+	faux_buf_set_budget(buf, NULL);
+	faux_buf_del_all_chunks(buf);
+	faux_free(buf->chunks);
+	// Nobody will unpin chunks now. Don't give their memory to cache or
+	// pool because another buffer will overwrite unsent data at once.
+	while (buf->pinned) {
+		faux_buf_chunk_t *chunk = buf->pinned;
+		buf->pinned = chunk->next;
+		if (chunk->seg)
+			faux_buf_seg_free(chunk->seg);
+		faux_free(chunk);
+	}
+	// Give cached chunks to per-thread pool or free them
+	faux_buf_set_cache_limit(buf, FAUX_BUF_CACHE_NONE);
+	if (buf->ring)
+		munmap(buf->ring, buf->ring_size * 2);
 
 	faux_free(buf);
 }
@@ -90,6 +332,8 @@ void faux_buf_free(faux_buf_t *buf)
  */
 bool_t faux_buf_empty(faux_buf_t *buf)
 {
+	size_t len = 0;
+
 	if (!buf)
 		return BOOL_FALSE;
 
@@ -98,11 +342,12 @@ bool_t faux_buf_empty(faux_buf_t *buf)
 		faux_buf_is_wlocked(buf))
 		return BOOL_FALSE;
 
-	faux_list_del_all(buf->list);
-	buf->rpos = 0;
-	buf->wpos = buf->chunk_size;
+	faux_buf_del_all_chunks(buf);
+	buf->ring_rpos = 0;
+	len = buf->len;
 	buf->len = 0;
-	buf->wchunk = NULL;
+	buf->wchunk = NO_CHUNK;
+	faux_buf_account_sub(buf, len);
 
 	return BOOL_TRUE;
 }
@@ -135,11 +380,12 @@ FAUX_HIDDEN ssize_t faux_buf_chunk_num(const faux_buf_t *buf)
 	assert(buf);
 	if (!buf)
 		return -1;
-	assert(buf->list);
-	if (!buf->list)
-		return -1;
 
-	return faux_list_len(buf->list);
+	// Ring is a single chunk
+	if (buf->ring)
+		return 1;
+
+	return buf->chunks_num;
 }
 
 
@@ -163,7 +409,8 @@ ssize_t faux_buf_limit(const faux_buf_t *buf)
 /** @brief Set buffer length limit.
  *
  * Writing more data than this limit will lead to error. The "0" value means
- * unlimited buffer. Default is unlimited.
+ * unlimited buffer. Default is unlimited. The limit of FAUX_BUF_RING buffer
+ * can't be greater than ring size. The "0" means ring size for it.
  *
  * @param [in] buf Allocated and initialized buffer object.
  * @param [in] limit Maximum buffer length.
@@ -176,11 +423,29 @@ bool_t faux_buf_set_limit(faux_buf_t *buf, size_t limit)
 		return BOOL_FALSE;
 
 	buf->limit = limit;
+	if (buf->ring && ((FAUX_BUF_UNLIMITED == limit) ||
+		(limit > buf->ring_size)))
+		buf->limit = buf->ring_size;
 
 	return BOOL_TRUE;
 }
 
 
+/** @brief Gets chunk by index.
+ *
+ * Inernal static function. Index is a position of chunk within buffer. The
+ * first chunk has index "0".
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] index Index of chunk.
+ * @return Chunk descriptor.
+ */
+static faux_buf_chunk_t *faux_buf_chunk(const faux_buf_t *buf, size_t index)
+{
+	return buf->chunks[(buf->chunks_head + index) & (buf->chunks_cap - 1)];
+}
+
+
 /** @brief Get amount of unused space within current data chunk.
  *
  * Inernal static function. Current chunk is "wchunk".
@@ -190,14 +455,22 @@ bool_t faux_buf_set_limit(faux_buf_t *buf, size_t limit)
  */
 static ssize_t faux_buf_wavail(const faux_buf_t *buf)
 {
+	faux_buf_chunk_t *chunk = NULL;
+
 	assert(buf);
 	if (!buf)
 		return -1;
 
-	if (!buf->wchunk)
-		return 0; // Empty list
+	// Ring. Limit is never greater than ring size
+	if (buf->ring)
+		return (buf->limit - buf->len);
+
+	if (NO_CHUNK == buf->wchunk)
+		return 0; // Empty buffer
+
+	chunk = faux_buf_chunk(buf, buf->wchunk);
 
-	return (buf->chunk_size - buf->wpos);
+	return (chunk->size - chunk->end);
 }
 
 
@@ -210,6 +483,8 @@ static ssize_t faux_buf_wavail(const faux_buf_t *buf)
  */
 static ssize_t faux_buf_ravail(const faux_buf_t *buf)
 {
+	faux_buf_chunk_t *chunk = NULL;
+
 	assert(buf);
 	if (!buf)
 		return -1;
@@ -217,12 +492,12 @@ static ssize_t faux_buf_ravail(const faux_buf_t *buf)
 	// Empty list
 	if (buf->len == 0)
 		return 0;
-	// Read and write within the same chunk
-	if (faux_list_head(buf->list) == buf->wchunk)
-		return (buf->wpos - buf->rpos);
+	// Ring. Whole data is continuous
+	if (buf->ring)
+		return buf->len;
+	chunk = faux_buf_chunk(buf, 0);
 
-	// Write pointer is far away from read pointer (more than chunk)
-	return (buf->chunk_size - buf->rpos);
+	return (chunk->end - chunk->start);
 }
 
 
@@ -260,622 +535,2615 @@ size_t faux_buf_is_rlocked(const faux_buf_t *buf)
 }
 
 
-/** @brief Allocates new chunk and adds it to the end of chunk list.
+/** @brief Gets index of pool size class for specified chunk size.
+ *
+ * Static internal function. Only power-of-two sizes within supported range
+ * have size class.
+ *
+ * @param [in] size Chunk size.
+ * @return Index of size class or < 0 if chunk can't be pooled.
+ */
+static int faux_buf_pool_class(size_t size)
+{
+	unsigned int shift = 0;
+
+	// Not power of two
+	if ((0 == size) || ((size & (size - 1)) != 0))
+		return -1;
+	while ((((size_t)1) << shift) < size)
+		shift++;
+	if ((shift < POOL_MIN_SHIFT) || (shift > POOL_MAX_SHIFT))
+		return -1;
+
+	return (shift - POOL_MIN_SHIFT);
+}
+
+
+/** @brief Gets free chunk from per-thread pool.
  *
  * Static internal function.
  *
- * @param [in] buf Allocated and initialized buffer object.
- * @return Newly created list node or NULL on error.
+ * @param [in] size Chunk size.
+ * @return Free chunk or NULL if pool has no chunk of such size.
  */
-static faux_list_node_t *faux_buf_alloc_chunk(faux_buf_t *buf)
+static faux_buf_chunk_t *faux_buf_pool_get(size_t size)
 {
-	char *chunk = NULL;
+	faux_buf_pool_t *pool = &faux_buf_pool;
+	faux_buf_chunk_t *chunk = NULL;
+	int cls = 0;
 
-	assert(buf);
-	if (!buf)
+	if (FAUX_BUF_CACHE_NONE == pool->limit)
 		return NULL;
-	assert(buf->list);
-	if (!buf->list)
+	if ((cls = faux_buf_pool_class(size)) < 0)
 		return NULL;
 
-	chunk = faux_malloc(buf->chunk_size);
-	assert(chunk);
-	if (!chunk)
+	chunk = pool->free[cls];
+	if (!chunk) {
+		pool->stat.misses++;
 		return NULL;
+	}
+	pool->free[cls] = chunk->next;
+	pool->stat.retained -= size;
+	pool->stat.hits++;
 
-	return faux_list_add(buf->list, chunk);
+	return chunk;
 }
 
 
-/** @brief Checks if it will be overflow while writing some data.
+/** @brief Puts free chunk to per-thread pool.
  *
- * It uses previously set "limit" value for calculations.
+ * Static internal function.
  *
- * @param [in] buf Allocated and initialized buffer object.
- * @param [in] add_len Length of data we want to write to buffer.
- * @return BOOL_TRUE - it will be overflow, BOOL_FALSE - enough space.
+ * @param [in] chunk Chunk to put.
+ * @return BOOL_TRUE - chunk is stored, BOOL_FALSE - pool is full.
  */
-bool_t faux_buf_will_be_overflow(const faux_buf_t *buf, size_t add_len)
+static bool_t faux_buf_pool_put(faux_buf_chunk_t *chunk)
 {
-	assert(buf);
-	if (!buf)
-		return BOOL_FALSE;
+	faux_buf_pool_t *pool = &faux_buf_pool;
+	int cls = 0;
 
-	if (FAUX_BUF_UNLIMITED == buf->limit)
+	if ((pool->stat.retained + chunk->size) > pool->limit)
+		return BOOL_FALSE;
+	if ((cls = faux_buf_pool_class(chunk->size)) < 0)
 		return BOOL_FALSE;
 
-	if ((buf->len + add_len) > buf->limit)
-		return BOOL_TRUE;
+	chunk->next = pool->free[cls];
+	pool->free[cls] = chunk;
+	pool->stat.retained += chunk->size;
 
-	return BOOL_FALSE;
+	return BOOL_TRUE;
 }
 
 
-/** @brief Reads dynamic buffer data to specified linear buffer.
+/** @brief Frees extra chunks retained by per-thread pool.
  *
- * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [in] data Linear buffer to read data to.
- * @param [in] len Length of data to read.
- * @return Length of data actually readed or < 0 on error.
+ * Static internal function.
+ *
+ * @param [in] limit Amount of retained memory to keep (bytes).
  */
-ssize_t faux_buf_read(faux_buf_t *buf, void *data, size_t len)
+static void faux_buf_pool_trim(size_t limit)
 {
-	struct iovec *iov = NULL;
-	size_t iov_num = 0;
-	ssize_t total = 0;
-	char *dst = (char *)data;
-	size_t i = 0;
-
-	assert(buf);
-	if (!buf)
-		return -1;
-	assert(data);
-	if (!data)
-		return -1;
-
-	total = faux_buf_dread_lock(buf, len, &iov, &iov_num);
-	if (total <= 0)
-		return total;
-
-	for (i = 0; i < iov_num; i++) {
-		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
-		dst += iov[i].iov_len;
+	faux_buf_pool_t *pool = &faux_buf_pool;
+	unsigned int cls = 0;
+
+	for (cls = 0; cls < POOL_CLASSES; cls++) {
+		size_t size = ((size_t)1) << (cls + POOL_MIN_SHIFT);
+		while (pool->free[cls] && (pool->stat.retained > limit)) {
+			faux_buf_chunk_t *chunk = pool->free[cls];
+			pool->free[cls] = chunk->next;
+			pool->stat.retained -= size;
+			faux_free(chunk);
+		}
 	}
+}
 
-	if (faux_buf_dread_unlock(buf, total, iov) != total)
-		return -1;
 
-	return total;
+/** @brief Set limit of per-thread chunk pool.
+ *
+ * Pool is shared by all buffers used within current thread. Free chunks that
+ * can't be stored within buffer's own cache go to pool. New chunks are taken
+ * from pool before allocating memory. Only chunks with power-of-two size
+ * (64 bytes - 1 MiB) can be pooled. Default chunk size is suitable.
+ *
+ * The "0" limit disables pool and frees all retained chunks. Pool is disabled
+ * by default. Retained chunks are freed on thread exit too.
+ *
+ * @param [in] limit Maximum amount of retained memory (bytes).
+ */
+void faux_buf_pool_set_limit(size_t limit)
+{
+	faux_buf_pool.limit = limit;
+	faux_buf_pool_trim(limit);
+	if (FAUX_BUF_CACHE_NONE == limit)
+		return;
+
+	// Destructor is executed on thread exit for non-NULL value only
+	pthread_once(&faux_buf_pool_once, faux_buf_pool_key_create);
+	pthread_setspecific(faux_buf_pool_key, &faux_buf_pool);
 }
 
 
-/** @brief Gets "struct iovec" array for direct reading and locks data.
+/** @brief Frees per-thread pool on thread exit.
  *
- * The length of actually locked data can differ from length specified by user.
- * When buffer length is less than specified length then return value will be
- * equal to buffer length.
+ * Static internal function. It's a destructor of thread-specific key.
  *
- * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [in] len Length of data to read.
- * @param [out] iov_out "struct iovec" array to direct read from.
- * @param [out] iov_num_out Number of "struct iovec" array elements.
- * @return Length of data actually locked or < 0 on error.
+ * @param [in] data Thread-specific value. Not used.
  */
-ssize_t faux_buf_dread_lock(faux_buf_t *buf, size_t len,
-	struct iovec **iov_out, size_t *iov_num_out)
+static void faux_buf_pool_destroy(void *data)
 {
-	size_t vec_entries_num = 0;
-	struct iovec *iov = NULL;
-	unsigned int i = 0;
-	faux_list_node_t *iter = NULL;
-	size_t len_to_lock = 0;
-	size_t avail = 0;
-	size_t must_be_read = 0;
+	faux_buf_pool.limit = FAUX_BUF_CACHE_NONE;
+	faux_buf_pool_trim(0);
 
-	assert(buf);
-	if (!buf)
-		return -1;
-	assert(iov_out);
-	if (!iov_out)
-		return -1;
-	assert(iov_num_out);
-	if (!iov_num_out)
-		return -1;
+	data = data; // Happy compiler
+}
 
-	// Don't use already locked buffer
-	if (faux_buf_is_rlocked(buf))
-		return -1;
 
-	len_to_lock = (len < buf->len) ? len : buf->len;
-	// Nothing to lock
-	if (0 == len_to_lock) {
-		*iov_out = NULL;
-		*iov_num_out = 0;
-		return 0;
-	}
+/** @brief Creates thread-specific key to free pool on thread exit.
+ *
+ * Static internal function. It's executed once by pthread_once().
+ */
+static void faux_buf_pool_key_create(void)
+{
+	pthread_key_create(&faux_buf_pool_key, faux_buf_pool_destroy);
+}
 
-	// Calculate number of struct iovec entries
-	avail = faux_buf_ravail(buf);
-	if (avail > 0)
-		vec_entries_num++;
-	if (avail < len_to_lock) {
-		size_t l = buf->len - avail; // length w/o first chunk
-		vec_entries_num += l / buf->chunk_size;
-		if ((l % buf->chunk_size) > 0)
-			vec_entries_num++;
-	}
-	iov = faux_zmalloc(vec_entries_num * sizeof(*iov));
 
-	// Iterate chunks. Suppose list is not empty
-	must_be_read = len_to_lock;
-	iter = NULL;
-	while (must_be_read > 0) {
-		char *data = NULL;
-		off_t data_offset = 0;
-		size_t data_len = buf->chunk_size;
-		size_t p_len = 0;
+/** @brief Frees all chunks retained by per-thread pool.
+ *
+ * Internal function. It's used under memory pressure. Pool limit is not
+ * changed.
+ */
+FAUX_HIDDEN void faux_buf_pool_release_idle(void)
+{
+	faux_buf_pool_trim(0);
+}
 
-		// First chunk
-		if (!iter) {
-			iter = faux_list_head(buf->list);
-			if (avail > 0) {
-				data_offset = buf->rpos;
-				data_len = avail; // Calculated earlier
-			} else { // Empty chunk. Go to next
-				iter = faux_list_next_node(iter);
-			}
-		// Not-first chunks
-		} else {
-			iter = faux_list_next_node(iter);
-		}
 
-		data = (char *)faux_list_data(iter) + data_offset;
-		p_len = (must_be_read < data_len) ? must_be_read : data_len;
+/** @brief Get statistics of per-thread chunk pool.
+ *
+ * @param [out] stat Statistics.
+ */
+void faux_buf_pool_stat(faux_buf_cache_stat_t *stat)
+{
+	assert(stat);
+	if (!stat)
+		return;
+
+	*stat = faux_buf_pool.stat;
+}
 
-		must_be_read -= p_len;
-		iov[i].iov_base = data;
-		iov[i].iov_len = p_len;
-		i++;
+
+/** @brief Releases extra chunks from buffer's own chunk cache.
+ *
+ * Static internal function. Chunks go to per-thread pool or they are freed.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] limit Amount of retained memory to keep (bytes).
+ */
+static void faux_buf_cache_trim(faux_buf_t *buf, size_t limit)
+{
+	while (buf->cache && (buf->cache_stat.retained > limit)) {
+		faux_buf_chunk_t *chunk = buf->cache;
+		buf->cache = chunk->next;
+		buf->cache_stat.retained -= chunk->size;
+		if (!faux_buf_pool_put(chunk))
+			faux_free(chunk);
 	}
+}
 
-	*iov_out = iov;
-	*iov_num_out = vec_entries_num;
-	buf->rlocked = len_to_lock;
 
-	return len_to_lock;
+/** @brief Frees all chunks retained by buffer's own chunk cache.
+ *
+ * Internal function. It's used under memory pressure. Chunks don't go to
+ * per-thread pool. Cache limit is not changed.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ */
+FAUX_HIDDEN void faux_buf_release_idle(faux_buf_t *buf)
+{
+	while (buf->cache) {
+		faux_buf_chunk_t *chunk = buf->cache;
+		buf->cache = chunk->next;
+		buf->cache_stat.retained -= chunk->size;
+		faux_free(chunk);
+	}
 }
 
 
-/** @brief Locks data for reading.
+/** @brief Changes size of new chunks.
  *
- * The complimentary function is faux_buf_dread_unlock_easy().
- * This function has the same functionality as faux_buf_dread_lock() but
- * chooses the lentgh of locked space itself to return single continuous buffer.
+ * Static internal function. Cache contains chunks of buffer's chunk size only
+ * so cache is flushed on size change.
  *
- * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [out] data Continuous buffer for direct reading.
- * @return Length of data actually locked or < 0 on error.
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] size New chunk size.
  */
-ssize_t faux_buf_dread_lock_easy(faux_buf_t *buf, void **data)
+static void faux_buf_resize_chunks(faux_buf_t *buf, size_t size)
 {
-	struct iovec *iov = NULL;
-	size_t iov_num = 0;
-	ssize_t len_to_lock = 0;
-	ssize_t avail = 0;
-	ssize_t locked_len = 0;
+	if (size == buf->chunk_size)
+		return;
 
-	assert(buf);
-	if (!buf)
-		return -1;
-	assert(data);
-	if (!data)
-		return -1;
+	buf->chunk_size = size;
+	faux_buf_cache_trim(buf, 0);
+}
 
-	// Don't use already locked buffer
-	if (faux_buf_is_rlocked(buf))
-		return -1;
 
-	avail = faux_buf_ravail(buf);
-	if (avail < 0)
-		return -1;
-	if (0 == avail)
-		avail = buf->chunk_size; // Next chunk
+/** @brief Set chunk sizing policy.
+ *
+ * By default buffer uses fixed chunk size specified on buffer creation. The
+ * adaptive policy changes size of new chunks from "min" to "max". Chunk size
+ * is doubled when recent chunk was filled completely (data is accumulated
+ * within buffer) or when written data doesn't fit into single chunk. Chunk
+ * size is halved when buffer is drained and the last chunk was filled less
+ * than a quarter. So mostly idle buffers use small chunks and bulk transfers
+ * use large chunks. Use power-of-two sizes to allow per-thread pool to store
+ * chunks. Policy can't be set for FAUX_BUF_RING buffer.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] size Current chunk size. If "0" then current size is not changed.
+ * @param [in] min Min chunk size.
+ * @param [in] max Max chunk size. If "max" is equal to "min" or "0" then
+ * chunk size is fixed.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_set_chunk_policy(faux_buf_t *buf,
+	size_t size, size_t min, size_t max)
+{
+	assert(buf);
+	if (!buf)
+		return BOOL_FALSE;
+	if (buf->ring)
+		return BOOL_FALSE;
 
-	len_to_lock = ((size_t)avail < buf->len) ? (size_t)avail : buf->len;
-	// Nothing to lock
-	if (0 == len_to_lock) {
-		*data = NULL;
-		return 0;
+	if (0 == size)
+		size = buf->chunk_size;
+	// Fixed size
+	if ((0 == max) || (0 == min)) {
+		min = size;
+		max = size;
 	}
+	if ((min > max) || (size < min) || (size > max))
+		return BOOL_FALSE;
 
-	locked_len = faux_buf_dread_lock(buf, len_to_lock, &iov, &iov_num);
-	if (locked_len <= 0)
-		return -1;
-	if (iov_num < 1) {
-		faux_free(iov);
-		return -1;
-	}
+	buf->chunk_min = min;
+	buf->chunk_max = max;
+	faux_buf_resize_chunks(buf, size);
 
-	*data = iov[0].iov_base;
-	locked_len = iov[0].iov_len;
+	return BOOL_TRUE;
+}
 
-	faux_free(iov);
 
-	return locked_len;
+/** @brief Returns current size of new chunks.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @return Chunk size or < 0 on error.
+ */
+ssize_t faux_buf_chunk_size(const faux_buf_t *buf)
+{
+	assert(buf);
+	if (!buf)
+		return -1;
+
+	return buf->chunk_size;
 }
 
 
-/** @brief Frees "struct iovec" array and unlocks read data.
+/** @brief Grows chunk size according to adaptive policy.
  *
- * The length of actually readed data can be less than length of locked data.
- * In this case all the data will be unlocked but only actually readed length
+ * Static internal function. It's called when new chunks are needed to
+ * write data.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] need Length of data that doesn't fit into current chunk.
+ */
+static void faux_buf_chunk_grow(faux_buf_t *buf, size_t need)
+{
+	size_t size = buf->chunk_size;
+
+	if (buf->chunk_max <= buf->chunk_min)
+		return; // Fixed size
+
+	// Recent chunk was filled completely
+	if (buf->wchunk != NO_CHUNK) {
+		faux_buf_chunk_t *chunk = faux_buf_chunk(buf, buf->wchunk);
+		if (!chunk->seg && (chunk->end == chunk->size))
+			size <<= 1;
+	}
+	// Data doesn't fit into single chunk
+	while ((size < need) && (size < buf->chunk_max))
+		size <<= 1;
+	if (size > buf->chunk_max)
+		size = buf->chunk_max;
+
+	faux_buf_resize_chunks(buf, size);
+}
+
+
+/** @brief Shrinks chunk size according to adaptive policy.
+ *
+ * Static internal function. It's called when the last chunk of buffer is
+ * released.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] chunk The last chunk.
+ */
+static void faux_buf_chunk_shrink(faux_buf_t *buf,
+	const faux_buf_chunk_t *chunk)
+{
+	size_t size = buf->chunk_size;
+
+	if (buf->chunk_max <= buf->chunk_min)
+		return; // Fixed size
+	if (chunk->seg || (chunk->size != size))
+		return;
+	// Chunk is filled enough
+	if (chunk->end > (size / 4))
+		return;
+
+	size >>= 1;
+	if (size < buf->chunk_min)
+		size = buf->chunk_min;
+
+	faux_buf_resize_chunks(buf, size);
+}
+
+
+/** @brief Set limit of buffer's own chunk cache.
+ *
+ * Chunks that were completely read are not freed but are stored within cache
+ * until cache contains "limit" bytes. New chunks are taken from cache firstly.
+ * So buffer that is used for streaming doesn't allocate memory in steady state.
+ * The "0" limit disables cache. Default is FAUX_BUF_CACHE_NONE.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] limit Maximum amount of retained memory (bytes).
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_set_cache_limit(faux_buf_t *buf, size_t limit)
+{
+	assert(buf);
+	if (!buf)
+		return BOOL_FALSE;
+
+	buf->cache_limit = limit;
+	faux_buf_cache_trim(buf, limit);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Get statistics of buffer's own chunk cache.
+ *
+ * Statistics of cache includes allocation requests satisfied by per-thread
+ * pool as a misses.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [out] stat Statistics.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_cache_stat(const faux_buf_t *buf, faux_buf_cache_stat_t *stat)
+{
+	assert(buf);
+	if (!buf)
+		return BOOL_FALSE;
+	assert(stat);
+	if (!stat)
+		return BOOL_FALSE;
+
+	*stat = buf->cache_stat;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Attaches buffer to shared memory budget.
+ *
+ * Length of buffer's data is accounted by budget. Buffer is detached from
+ * previous budget if any. The NULL "budget" detaches buffer only. Budget
+ * must be freed after buffer or buffer is detached by faux_buf_budget_free().
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] budget Budget object or NULL.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_set_budget(faux_buf_t *buf, faux_buf_budget_t *budget)
+{
+	assert(buf);
+	if (!buf)
+		return BOOL_FALSE;
+
+	if (buf->budget == budget)
+		return BOOL_TRUE;
+
+	if (buf->budget) {
+		faux_buf_budget_t *old_budget = buf->budget;
+		faux_list_node_t *node = buf->budget_node;
+		buf->budget = NULL;
+		buf->budget_node = NULL;
+		faux_buf_budget_detach(old_budget, node);
+	}
+	if (!budget)
+		return BOOL_TRUE;
+
+	buf->budget_node = faux_buf_budget_attach(budget, buf);
+	if (!buf->budget_node)
+		return BOOL_FALSE;
+	buf->budget = budget;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Set high and low watermarks of buffer.
+ *
+ * Callback is executed with "high" argument BOOL_TRUE when buffer length
+ * reaches high watermark. Then callback is executed with BOOL_FALSE when
+ * buffer length falls down to low watermark. It doesn't matter who writes or
+ * reads buffer. The "high" value must be greater than "low" value. The "0"
+ * high watermark disables watermarks.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] high High watermark.
+ * @param [in] low Low watermark.
+ * @param [in] cb Callback function.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_set_watermarks(faux_buf_t *buf, size_t high, size_t low,
+	faux_buf_watermark_cb_fn cb, void *user_data)
+{
+	assert(buf);
+	if (!buf)
+		return BOOL_FALSE;
+
+	return faux_buf_wm_set(buf, &buf->wm[WM_USER], high, low,
+		cb, user_data);
+}
+
+
+/** @brief Set high and low watermarks of buffer for buffer's owner.
+ *
+ * It's like faux_buf_set_watermarks() but it's intended for objects those
+ * use buffer internally and give it to user (for example faux_async_t).
+ * Owner's watermarks and watermarks set by faux_buf_set_watermarks() are
+ * independent. So user can set own watermarks for such buffer.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] high High watermark.
+ * @param [in] low Low watermark.
+ * @param [in] cb Callback function.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_set_owner_watermarks(faux_buf_t *buf, size_t high, size_t low,
+	faux_buf_watermark_cb_fn cb, void *user_data)
+{
+	assert(buf);
+	if (!buf)
+		return BOOL_FALSE;
+
+	return faux_buf_wm_set(buf, &buf->wm[WM_OWNER], high, low,
+		cb, user_data);
+}
+
+
+/** @brief Set watermarks within specified set.
+ *
+ * Static internal function.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] wm Set of watermarks.
+ * @param [in] high High watermark.
+ * @param [in] low Low watermark.
+ * @param [in] cb Callback function.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+static bool_t faux_buf_wm_set(faux_buf_t *buf, faux_buf_wm_t *wm,
+	size_t high, size_t low, faux_buf_watermark_cb_fn cb, void *user_data)
+{
+	if ((high != 0) && (low >= high))
+		return BOOL_FALSE;
+
+	wm->high = high;
+	wm->low = low;
+	wm->is_high = BOOL_FALSE;
+	wm->cb = cb;
+	wm->udata = user_data;
+	// Current state
+	faux_buf_wm_check_high(buf, wm);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Checks high watermark of specified set.
+ *
+ * Static internal function.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] wm Set of watermarks.
+ */
+static void faux_buf_wm_check_high(faux_buf_t *buf, faux_buf_wm_t *wm)
+{
+	if (wm->is_high || (0 == wm->high) || (buf->len < wm->high))
+		return;
+	wm->is_high = BOOL_TRUE;
+	if (wm->cb)
+		wm->cb(buf, BOOL_TRUE, wm->udata);
+}
+
+
+/** @brief Checks low watermark of specified set.
+ *
+ * Static internal function.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] wm Set of watermarks.
+ */
+static void faux_buf_wm_check_low(faux_buf_t *buf, faux_buf_wm_t *wm)
+{
+	if (!wm->is_high || (buf->len > wm->low))
+		return;
+	wm->is_high = BOOL_FALSE;
+	if (wm->cb)
+		wm->cb(buf, BOOL_FALSE, wm->udata);
+}
+
+
+/** @brief Accounts data written to buffer.
+ *
+ * Static internal function. Length of buffer is already changed. Function
+ * informs shared memory budget and checks high watermarks.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] len Length of written data.
+ */
+static void faux_buf_account_add(faux_buf_t *buf, size_t len)
+{
+	unsigned int i = 0;
+
+	faux_buf_budget_inc(buf->budget, len);
+
+	for (i = 0; i < WM_NUM; i++)
+		faux_buf_wm_check_high(buf, &buf->wm[i]);
+}
+
+
+/** @brief Accounts data removed from buffer.
+ *
+ * Static internal function. Length of buffer is already changed. Function
+ * informs shared memory budget and checks low watermarks.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] len Length of removed data.
+ */
+static void faux_buf_account_sub(faux_buf_t *buf, size_t len)
+{
+	unsigned int i = 0;
+
+	faux_buf_budget_dec(buf->budget, len);
+
+	for (i = 0; i < WM_NUM; i++)
+		faux_buf_wm_check_low(buf, &buf->wm[i]);
+}
+
+
+/** @brief Releases chunk that doesn't contain data anymore.
+ *
+ * Static internal function. Chunk goes to buffer's cache, to per-thread pool
+ * or it's freed. Chunk is freed when shared memory budget is above high
+ * watermark. Only chunks of buffer's own chunk size can be cached. Chunk
+ * can have another size if it was moved from another buffer.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] chunk Chunk to release.
+ */
+static void faux_buf_release_chunk(faux_buf_t *buf, faux_buf_chunk_t *chunk)
+{
+	if (!chunk)
+		return;
+
+	// Kernel still uses chunk memory. Wait for faux_buf_unpin()
+	if (chunk->pinned) {
+		chunk->next = NULL;
+		if (buf->pinned_tail)
+			buf->pinned_tail->next = chunk;
+		else
+			buf->pinned = chunk;
+		buf->pinned_tail = chunk;
+		return;
+	}
+
+	// Shared segment. Descriptor is allocated separately
+	if (chunk->seg) {
+		faux_buf_seg_free(chunk->seg);
+		faux_free(chunk);
+		return;
+	}
+
+	// Don't retain free memory under pressure
+	if (buf->budget && faux_buf_budget_is_high(buf->budget)) {
+		faux_free(chunk);
+		return;
+	}
+
+	if ((chunk->size == buf->chunk_size) &&
+		((buf->cache_stat.retained + chunk->size) <= buf->cache_limit)) {
+		chunk->next = buf->cache;
+		buf->cache = chunk;
+		buf->cache_stat.retained += chunk->size;
+		return;
+	}
+
+	if (faux_buf_pool_put(chunk))
+		return;
+
+	faux_free(chunk);
+}
+
+
+/** @brief Removes chunk from chunk array but doesn't release it.
+ *
+ * Static internal function. Usually the first or the last chunk is removed.
+ * Other chunks are shifted to fill the gap. Index of chunk to write to is
+ * updated.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] index Index of chunk.
+ * @return Removed chunk.
+ */
+static faux_buf_chunk_t *faux_buf_takeaway_chunk(faux_buf_t *buf, size_t index)
+{
+	faux_buf_chunk_t *chunk = faux_buf_chunk(buf, index);
+	size_t mask = buf->chunks_cap - 1;
+	size_t i = 0;
+
+	// Shift preceding chunks forward
+	if (index < (buf->chunks_num / 2)) {
+		for (i = index; i > 0; i--)
+			buf->chunks[(buf->chunks_head + i) & mask] =
+				buf->chunks[(buf->chunks_head + i - 1) & mask];
+		buf->chunks_head = (buf->chunks_head + 1) & mask;
+	// Shift following chunks backward
+	} else {
+		for (i = index; i < (buf->chunks_num - 1); i++)
+			buf->chunks[(buf->chunks_head + i) & mask] =
+				buf->chunks[(buf->chunks_head + i + 1) & mask];
+	}
+	buf->chunks_num--;
+
+	if (NO_CHUNK != buf->wchunk) {
+		if (buf->wchunk == index)
+			buf->wchunk = NO_CHUNK;
+		else if (buf->wchunk > index)
+			buf->wchunk--;
+	}
+
+	return chunk;
+}
+
+
+/** @brief Removes chunk from chunk array and releases it.
+ *
+ * Static internal function.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] index Index of chunk.
+ */
+static void faux_buf_del_chunk(faux_buf_t *buf, size_t index)
+{
+	faux_buf_release_chunk(buf, faux_buf_takeaway_chunk(buf, index));
+}
+
+
+/** @brief Removes all chunks from chunk array and releases them.
+ *
+ * Static internal function.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ */
+static void faux_buf_del_all_chunks(faux_buf_t *buf)
+{
+	while (buf->chunks_num > 0)
+		faux_buf_del_chunk(buf, buf->chunks_num - 1);
+	buf->chunks_head = 0;
+}
+
+
+/** @brief Adds chunk to the end of chunk array.
+ *
+ * Static internal function. Array grows when it's full.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] chunk Chunk descriptor.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+static bool_t faux_buf_push_chunk(faux_buf_t *buf, faux_buf_chunk_t *chunk)
+{
+	// Array is full
+	if (buf->chunks_num == buf->chunks_cap) {
+		faux_buf_chunk_t **chunks = NULL;
+		size_t cap = (buf->chunks_cap > 0) ?
+			(buf->chunks_cap * 2) : CHUNKS_MIN;
+		size_t i = 0;
+
+		chunks = faux_zmalloc(cap * sizeof(*chunks));
+		assert(chunks);
+		if (!chunks)
+			return BOOL_FALSE;
+		for (i = 0; i < buf->chunks_num; i++)
+			chunks[i] = faux_buf_chunk(buf, i);
+		faux_free(buf->chunks);
+		buf->chunks = chunks;
+		buf->chunks_cap = cap;
+		buf->chunks_head = 0;
+	}
+
+	buf->chunks[(buf->chunks_head + buf->chunks_num) &
+		(buf->chunks_cap - 1)] = chunk;
+	buf->chunks_num++;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Allocates new chunk and adds it to the end of chunk array.
+ *
+ * Static internal function. Chunk is taken from buffer's cache or per-thread
+ * pool if possible. Chunk descriptor and chunk memory are allocated as a
+ * single memory block.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @return Newly created chunk or NULL on error.
+ */
+static faux_buf_chunk_t *faux_buf_alloc_chunk(faux_buf_t *buf)
+{
+	faux_buf_chunk_t *chunk = NULL;
+
+	assert(buf);
+	if (!buf)
+		return NULL;
+
+	if (buf->cache) {
+		chunk = buf->cache;
+		buf->cache = chunk->next;
+		buf->cache_stat.retained -= chunk->size;
+		buf->cache_stat.hits++;
+	} else {
+		buf->cache_stat.misses++;
+		chunk = faux_buf_pool_get(buf->chunk_size);
+		if (!chunk) {
+			chunk = faux_malloc(sizeof(*chunk) + buf->chunk_size);
+			assert(chunk);
+			if (!chunk)
+				return NULL;
+			chunk->data = (char *)(chunk + 1);
+			chunk->size = buf->chunk_size;
+		}
+	}
+	chunk->start = 0;
+	chunk->end = 0;
+	chunk->next = NULL;
+	chunk->seg = NULL;
+	chunk->pinned = BOOL_FALSE;
+
+	if (!faux_buf_push_chunk(buf, chunk)) {
+		faux_buf_release_chunk(buf, chunk);
+		return NULL;
+	}
+
+	return chunk;
+}
+
+
+/** @brief Checks if it will be overflow while writing some data.
+ *
+ * It uses previously set "limit" value for calculations. The limit of shared
+ * memory budget is checked too.
+ *
+ * @param [in] buf Allocated and initialized buffer object.
+ * @param [in] add_len Length of data we want to write to buffer.
+ * @return BOOL_TRUE - it will be overflow, BOOL_FALSE - enough space.
+ */
+bool_t faux_buf_will_be_overflow(const faux_buf_t *buf, size_t add_len)
+{
+	assert(buf);
+	if (!buf)
+		return BOOL_FALSE;
+
+	if (buf->budget && faux_buf_budget_will_be_overflow(buf->budget, add_len))
+		return BOOL_TRUE;
+
+	if (FAUX_BUF_UNLIMITED == buf->limit)
+		return BOOL_FALSE;
+
+	if ((buf->len + add_len) > buf->limit)
+		return BOOL_TRUE;
+
+	return BOOL_FALSE;
+}
+
+
+/** @brief Reads dynamic buffer data to specified linear buffer.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] data Linear buffer to read data to.
+ * @param [in] len Length of data to read.
+ * @return Length of data actually readed or < 0 on error.
+ */
+ssize_t faux_buf_read(faux_buf_t *buf, void *data, size_t len)
+{
+	ssize_t total = 0;
+	char *dst = (char *)data;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	assert(data);
+	if (!data)
+		return -1;
+
+	// Don't use already locked buffer
+	if (faux_buf_is_rlocked(buf))
+		return -1;
+
+	// Use "struct iovec" array on stack. Data is read by portions when
+	// array is not long enough.
+	while ((size_t)total < len) {
+		struct iovec iov[LOCAL_IOV_NUM];
+		size_t iov_num = LOCAL_IOV_NUM;
+		ssize_t locked_len = 0;
+		size_t i = 0;
+
+		locked_len = faux_buf_dread_lock_iov(buf, len - total,
+			iov, &iov_num);
+		if (locked_len < 0)
+			return -1;
+		if (0 == locked_len)
+			break;
+
+		for (i = 0; i < iov_num; i++) {
+			memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+			dst += iov[i].iov_len;
+		}
+
+		if (faux_buf_dread_unlock(buf, locked_len, NULL) != locked_len)
+			return -1;
+		total += locked_len;
+	}
+
+	return total;
+}
+
+
+/** @brief Gets number of "struct iovec" entries to lock data for reading.
+ *
+ * Static internal function.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] len Length of data to lock. Must not exceed buffer length.
+ * @return Number of "struct iovec" entries.
+ */
+static size_t faux_buf_dread_iov_num(const faux_buf_t *buf, size_t len)
+{
+	size_t vec_entries_num = 0;
+	size_t index = 0;
+
+	if (buf->ring)
+		return ((len > 0) ? 1 : 0);
+
+	for (index = 0; (len > 0) && (index < buf->chunks_num); index++) {
+		faux_buf_chunk_t *chunk = faux_buf_chunk(buf, index);
+		size_t avail = chunk->end - chunk->start;
+		if (avail > 0) {
+			len -= (len < avail) ? len : avail;
+			vec_entries_num++;
+		}
+	}
+
+	return vec_entries_num;
+}
+
+
+/** @brief Locks data for reading and fills user's "struct iovec" array.
+ *
+ * Function doesn't allocate memory. User gives "struct iovec" array and its
+ * length. The length of locked data is limited by buffer length, by
+ * specified length and by number of "struct iovec" entries user has. The
+ * complementary unlock function is faux_buf_dread_unlock() with NULL "iov"
+ * argument or faux_buf_dread_unlock_easy().
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] len Length of data to read.
+ * @param [in] iov User's "struct iovec" array to fill.
+ * @param [in,out] iov_num Number of array entries (in), number of filled
+ * entries (out).
+ * @return Length of data actually locked or < 0 on error.
+ */
+ssize_t faux_buf_dread_lock_iov(faux_buf_t *buf, size_t len,
+	struct iovec *iov, size_t *iov_num)
+{
+	unsigned int i = 0;
+	size_t index = 0;
+	size_t len_to_lock = 0;
+	size_t avail = 0;
+	size_t must_be_read = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	assert(iov_num);
+	if (!iov_num)
+		return -1;
+	assert(iov || (0 == *iov_num));
+	if (!iov && (*iov_num != 0))
+		return -1;
+
+	// Don't use already locked buffer
+	if (faux_buf_is_rlocked(buf))
+		return -1;
+
+	len_to_lock = (len < buf->len) ? len : buf->len;
+	// Nothing to lock
+	if ((0 == len_to_lock) || (0 == *iov_num)) {
+		*iov_num = 0;
+		return 0;
+	}
+
+	// Ring. Data is continuous because of double mapping
+	if (buf->ring) {
+		iov[0].iov_base = buf->ring + buf->ring_rpos;
+		iov[0].iov_len = len_to_lock;
+		*iov_num = 1;
+		buf->rlocked = len_to_lock;
+		return len_to_lock;
+	}
+
+	// Iterate chunks. Suppose buffer is not empty. First chunk can be
+	// empty (fully readed but not freed yet)
+	must_be_read = len_to_lock;
+	while ((must_be_read > 0) && (i < *iov_num)) {
+		faux_buf_chunk_t *chunk = faux_buf_chunk(buf, index++);
+		size_t p_len = 0;
+		avail = chunk->end - chunk->start;
+		if (0 == avail)
+			continue;
+		p_len = (must_be_read < avail) ? must_be_read : avail;
+		iov[i].iov_base = chunk->data + chunk->start;
+		iov[i].iov_len = p_len;
+		must_be_read -= p_len;
+		i++;
+	}
+
+	len_to_lock -= must_be_read; // Not enough iovec entries
+	*iov_num = i;
+	buf->rlocked = len_to_lock;
+
+	return len_to_lock;
+}
+
+
+/** @brief Gets "struct iovec" array for direct reading and locks data.
+ *
+ * The length of actually locked data can differ from length specified by user.
+ * When buffer length is less than specified length then return value will be
+ * equal to buffer length.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] len Length of data to read.
+ * @param [out] iov_out "struct iovec" array to direct read from.
+ * @param [out] iov_num_out Number of "struct iovec" array elements.
+ * @return Length of data actually locked or < 0 on error.
+ */
+ssize_t faux_buf_dread_lock(faux_buf_t *buf, size_t len,
+	struct iovec **iov_out, size_t *iov_num_out)
+{
+	size_t vec_entries_num = 0;
+	struct iovec *iov = NULL;
+	size_t len_to_lock = 0;
+	ssize_t locked_len = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	assert(iov_out);
+	if (!iov_out)
+		return -1;
+	assert(iov_num_out);
+	if (!iov_num_out)
+		return -1;
+
+	// Don't use already locked buffer
+	if (faux_buf_is_rlocked(buf))
+		return -1;
+
+	len_to_lock = (len < buf->len) ? len : buf->len;
+	// Nothing to lock
+	if (0 == len_to_lock) {
+		*iov_out = NULL;
+		*iov_num_out = 0;
+		return 0;
+	}
+
+	vec_entries_num = faux_buf_dread_iov_num(buf, len_to_lock);
+	iov = faux_zmalloc(vec_entries_num * sizeof(*iov));
+	assert(iov);
+	if (!iov)
+		return -1;
+
+	locked_len = faux_buf_dread_lock_iov(buf, len_to_lock,
+		iov, &vec_entries_num);
+	if (locked_len <= 0) {
+		faux_free(iov);
+		return locked_len;
+	}
+
+	*iov_out = iov;
+	*iov_num_out = vec_entries_num;
+
+	return locked_len;
+}
+
+
+/** @brief Locks data for reading.
+ *
+ * The complimentary function is faux_buf_dread_unlock_easy().
+ * This function has the same functionality as faux_buf_dread_lock() but
+ * chooses the lentgh of locked space itself to return single continuous buffer.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [out] data Continuous buffer for direct reading.
+ * @return Length of data actually locked or < 0 on error.
+ */
+ssize_t faux_buf_dread_lock_easy(faux_buf_t *buf, void **data)
+{
+	struct iovec iov = {};
+	size_t iov_num = 1;
+	ssize_t locked_len = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	assert(data);
+	if (!data)
+		return -1;
+
+	locked_len = faux_buf_dread_lock_iov(buf, buf->len, &iov, &iov_num);
+	if (locked_len < 0)
+		return -1;
+	// Nothing to lock
+	if (0 == locked_len) {
+		*data = NULL;
+		return 0;
+	}
+
+	*data = iov.iov_base;
+
+	return locked_len;
+}
+
+
+/** @brief Frees "struct iovec" array and unlocks read data.
+ *
+ * The length of actually readed data can be less than length of locked data.
+ * In this case all the data will be unlocked but only actually readed length
  * will be removed from buffer.
  *
  * Function gets "struct iovec" array to free it. It was previously allocated
- * by faux_dread_lock() function.
+ * by faux_dread_lock() function.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] really_readed Length of data actually read.
+ * @param [out] iov "struct iovec" array to free.
+ * @param [out] iov_num_out Number of "struct iovec" array elements.
+ * @return Length of data actually unlocked or < 0 on error.
+ */
+ssize_t faux_buf_dread_unlock(faux_buf_t *buf, size_t really_readed,
+	struct iovec *iov)
+{
+	size_t must_be_read = really_readed;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	// Can't unlock non-locked buffer
+	if (!faux_buf_is_rlocked(buf))
+		return -1;
+
+	if (buf->rlocked < really_readed)
+		return -1; // Something went wrong
+	if (buf->len < really_readed)
+		return -1; // Something went wrong
+
+	if (0 == really_readed)
+		goto unlock;
+
+	// Ring. Simply move read position
+	if (buf->ring) {
+		buf->ring_rpos = (buf->ring_rpos + really_readed) &
+			(buf->ring_size - 1);
+		buf->len -= really_readed;
+		goto unlock;
+	}
+
+	// Suppose buffer is not empty
+	while (must_be_read > 0) {
+		faux_buf_chunk_t *chunk = faux_buf_chunk(buf, 0);
+		size_t avail = chunk->end - chunk->start;
+		size_t data_to_rm = (must_be_read < avail) ? must_be_read : avail;
+
+		buf->len -= data_to_rm;
+		chunk->start += data_to_rm;
+		must_be_read -= data_to_rm;
+
+		// Current chunk was not fully readed
+		if (chunk->start != chunk->end)
+			continue;
+		// Current chunk was fully readed. So remove it.
+		// Chunk is not wchunk
+		if (buf->wchunk != 0) {
+			faux_buf_del_chunk(buf, 0);
+		// Chunk is wchunk
+		} else if (!buf->wlocked ||  // Chunk can be locked for writing
+			(chunk->end == chunk->size)) { // Chunk can be filled
+			faux_buf_chunk_shrink(buf, chunk);
+			faux_buf_del_chunk(buf, 0);
+		// Chunk is locked for writing. Leave it for writer
+		} else {
+			break;
+		}
+	}
+
+unlock:
+	// Unlock whole buffer. Not 'really readed' bytes only
+	buf->rlocked = 0;
+	faux_free(iov);
+	faux_buf_account_sub(buf, really_readed);
+
+	return really_readed;
+}
+
+
+/** @brief Unlocks read data.
+ *
+ * It's a function complementary to faux_buf_dread_lock_easy().
+ * It has the same functionality as faux_dread_unlock() but doesn't free
+ * "struct iovec" array.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] really_readed Length of data actually readed.
+ * @return Length of data actually unlocked or < 0 on error.
+ */
+ssize_t faux_buf_dread_unlock_easy(faux_buf_t *buf, size_t really_readed)
+{
+	return faux_buf_dread_unlock(buf, really_readed, NULL);
+}
+
+
+/** @brief Unlocks read data and pins memory of readed data.
+ *
+ * It's used for zero-copy send (MSG_ZEROCOPY). Kernel uses memory of sent
+ * data until it reports completion. So chunks those contain readed data are
+ * not reused or freed while they are pinned. Released chunks wait within
+ * queue for faux_buf_unpin(). Pin identifiers must increase (wrap around is
+ * allowed). The FAUX_BUF_RING buffer can't pin memory.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] really_readed Length of data actually readed.
+ * @param [in] iov Array of "struct iovec" structures to free.
+ * @param [in] pin Pin identifier.
+ * @return Length of data actually unlocked or < 0 on error.
+ */
+ssize_t faux_buf_dread_unlock_pin(faux_buf_t *buf, size_t really_readed,
+	struct iovec *iov, unsigned int pin)
+{
+	size_t must_be_pinned = really_readed;
+	size_t i = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	if (buf->ring)
+		return -1;
+	if ((buf->rlocked < really_readed) || (buf->len < really_readed))
+		return -1; // Something went wrong
+
+	for (i = 0; (must_be_pinned > 0) && (i < buf->chunks_num); i++) {
+		faux_buf_chunk_t *chunk = faux_buf_chunk(buf, i);
+		size_t avail = chunk->end - chunk->start;
+
+		// Empty chunk contains no sent data
+		if (0 == avail)
+			continue;
+		chunk->pinned = BOOL_TRUE;
+		chunk->pin = pin;
+		must_be_pinned -= (must_be_pinned < avail) ?
+			must_be_pinned : avail;
+	}
+
+	return faux_buf_dread_unlock(buf, really_readed, iov);
+}
+
+
+/** @brief Unpins memory of buffer.
+ *
+ * Function releases pinned chunks those pin identifier is less or equal to
+ * specified one. See faux_buf_dread_unlock_pin().
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] pin The last completed pin identifier.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_buf_unpin(faux_buf_t *buf, unsigned int pin)
+{
+	faux_buf_chunk_t *chunk = NULL;
+
+	assert(buf);
+	if (!buf)
+		return BOOL_FALSE;
+
+	while ((chunk = buf->pinned) && ((int)(chunk->pin - pin) <= 0)) {
+		buf->pinned = chunk->next;
+		if (!buf->pinned)
+			buf->pinned_tail = NULL;
+		chunk->pinned = BOOL_FALSE;
+		faux_buf_release_chunk(buf, chunk);
+	}
+
+	// Only the first chunk within buffer can be partially sent
+	if (buf->chunks_num > 0) {
+		chunk = faux_buf_chunk(buf, 0);
+		if (chunk->pinned && ((int)(chunk->pin - pin) <= 0))
+			chunk->pinned = BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Write data from linear buffer to dynamic buffer.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] data Linear buffer. Source of data.
+ * @param [in] len Length of data to write.
+ * @return Length of data actually written or < 0 on error.
+ */
+ssize_t faux_buf_write(faux_buf_t *buf, const void *data, size_t len)
+{
+	ssize_t total = 0;
+	const char *src = (const char *)data;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	assert(data);
+	if (!data)
+		return -1;
+
+	// Don't use already locked buffer
+	if (faux_buf_is_wlocked(buf))
+		return -1;
+
+	// It will be overflow after writing
+	if (faux_buf_will_be_overflow(buf, len))
+		return -1;
+
+	// Use "struct iovec" array on stack. Data is written by portions when
+	// array is not long enough.
+	while ((size_t)total < len) {
+		struct iovec iov[LOCAL_IOV_NUM];
+		size_t iov_num = LOCAL_IOV_NUM;
+		ssize_t locked_len = 0;
+		size_t i = 0;
+
+		locked_len = faux_buf_dwrite_lock_iov(buf, len - total,
+			iov, &iov_num);
+		if (locked_len <= 0)
+			return -1;
+
+		for (i = 0; i < iov_num; i++) {
+			memcpy(iov[i].iov_base, src, iov[i].iov_len);
+			src += iov[i].iov_len;
+		}
+
+		if (faux_buf_dwrite_unlock(buf, locked_len, NULL) != locked_len)
+			return -1;
+		total += locked_len;
+	}
+
+	return total;
+}
+
+
+/** @brief Writes formatted string to dynamic buffer.
+ *
+ * String is formatted in place within free space of the current chunk (or
+ * new chunk if current one is full). So there is no intermediate allocation
+ * and copying. Only when string doesn't fit into free space of single chunk
+ * it's formatted again into temporary memory and then written to buffer.
+ * Terminating null byte is not written.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] fmt Format string like printf() uses.
+ * @param [in] ap Arguments.
+ * @return Length of written data or < 0 on error.
+ */
+ssize_t faux_buf_vprintf(faux_buf_t *buf, const char *fmt, va_list ap)
+{
+	struct iovec iov = {};
+	size_t iov_num = 1;
+	ssize_t locked_len = 0;
+	size_t len = 0;
+	int n = 0;
+	va_list ap2;
+	char local[SPILL_LOCAL_LEN];
+	char *spill = local;
+	ssize_t ret = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	assert(fmt);
+	if (!fmt)
+		return -1;
+
+	// Don't use already locked buffer
+	if (faux_buf_is_wlocked(buf))
+		return -1;
+
+	// Free space of current chunk or the whole new chunk
+	len = faux_buf_wavail(buf);
+	if (0 == len)
+		len = buf->chunk_size;
+	if ((buf->limit != FAUX_BUF_UNLIMITED) &&
+		(len > (buf->limit - buf->len)))
+		len = buf->limit - buf->len;
+
+	// Single "struct iovec" entry means continuous space
+	if (len > 0)
+		locked_len = faux_buf_dwrite_lock_iov(buf, len, &iov, &iov_num);
+	if (locked_len > 0) {
+		va_copy(ap2, ap);
+		n = vsnprintf(iov.iov_base, locked_len, fmt, ap2);
+		va_end(ap2);
+		// String and null byte fit into locked space
+		if ((n >= 0) && (n < locked_len))
+			return faux_buf_dwrite_unlock(buf, n, NULL);
+		faux_buf_dwrite_unlock(buf, 0, NULL);
+		if (n < 0)
+			return -1;
+	} else {
+		va_copy(ap2, ap);
+		n = vsnprintf(NULL, 0, fmt, ap2);
+		va_end(ap2);
+		if (n < 0)
+			return -1;
+	}
+
+	// Spill. String crosses chunk boundary
+	if ((size_t)n >= sizeof(local)) {
+		spill = faux_malloc(n + 1);
+		assert(spill);
+		if (!spill)
+			return -1;
+	}
+	va_copy(ap2, ap);
+	vsnprintf(spill, n + 1, fmt, ap2);
+	va_end(ap2);
+	ret = faux_buf_write(buf, spill, n);
+	if (spill != local)
+		faux_free(spill);
+
+	return ret;
+}
+
+
+/** @brief Writes formatted string to dynamic buffer.
+ *
+ * @see faux_buf_vprintf().
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] fmt Format string like printf() uses.
+ * @return Length of written data or < 0 on error.
+ */
+ssize_t faux_buf_printf(faux_buf_t *buf, const char *fmt, ...)
+{
+	va_list ap;
+	ssize_t ret = 0;
+
+	va_start(ap, fmt);
+	ret = faux_buf_vprintf(buf, fmt, ap);
+	va_end(ap);
+
+	return ret;
+}
+
+
+/** @brief Gets number of "struct iovec" entries to lock space for writing.
+ *
+ * Static internal function.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] len Length of space to lock.
+ * @return Number of "struct iovec" entries.
+ */
+static size_t faux_buf_dwrite_iov_num(const faux_buf_t *buf, size_t len)
+{
+	size_t vec_entries_num = 0;
+	size_t avail = 0;
+
+	avail = faux_buf_wavail(buf);
+	if (avail > 0)
+		vec_entries_num++;
+	if (avail < len) {
+		size_t l = len - avail; // length w/o first chunk
+		vec_entries_num += l / buf->chunk_size;
+		if ((l % buf->chunk_size) > 0)
+			vec_entries_num++;
+	}
+
+	return vec_entries_num;
+}
+
+
+/** @brief Locks space for writing and fills user's "struct iovec" array.
+ *
+ * Function doesn't allocate memory for "struct iovec" array. User gives array
+ * and its length. The length of locked space is limited by specified length
+ * and by number of "struct iovec" entries user has. The complementary unlock
+ * function is faux_buf_dwrite_unlock() with NULL "iov" argument or
+ * faux_buf_dwrite_unlock_easy().
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] len Length of space to lock.
+ * @param [in] iov User's "struct iovec" array to fill.
+ * @param [in,out] iov_num Number of array entries (in), number of filled
+ * entries (out).
+ * @return Length of space actually locked or < 0 on error.
+ */
+ssize_t faux_buf_dwrite_lock_iov(faux_buf_t *buf, size_t len,
+	struct iovec *iov, size_t *iov_num)
+{
+	unsigned int i = 0;
+	size_t index = 0;
+	size_t avail = 0;
+	size_t max_len = 0;
+	size_t must_be_write = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	assert(iov_num);
+	if (!iov_num)
+		return -1;
+	assert(iov || (0 == *iov_num));
+	if (!iov && (*iov_num != 0))
+		return -1;
+
+	// Don't use already locked buffer
+	if (faux_buf_is_wlocked(buf))
+		return -1;
+
+	// It will be overflow after writing. Check it before chunk size is
+	// changed by failed request.
+	if (faux_buf_will_be_overflow(buf, len))
+		return -1;
+
+	// Adaptive chunk size
+	avail = faux_buf_wavail(buf);
+	if (!buf->ring && (avail < len))
+		faux_buf_chunk_grow(buf, len - avail);
+
+	// Limit length by number of available "struct iovec" entries
+	if (*iov_num > 0) {
+		max_len = avail + (*iov_num - ((avail > 0) ? 1 : 0)) *
+			buf->chunk_size;
+		if (len > max_len)
+			len = max_len;
+	} else {
+		len = 0;
+	}
+
+	// Nothing to lock
+	if (0 == len) {
+		*iov_num = 0;
+		return 0;
+	}
+
+	// Ring. Free space is continuous because of double mapping
+	if (buf->ring) {
+		iov[0].iov_base = buf->ring +
+			((buf->ring_rpos + buf->len) & (buf->ring_size - 1));
+		iov[0].iov_len = len;
+		*iov_num = 1;
+		buf->wlocked = len;
+		return len;
+	}
+
+	// Allocate new chunks. They are placed right after wchunk
+	index = (NO_CHUNK == buf->wchunk) ? 0 : (buf->wchunk + 1);
+	if (avail < len) {
+		size_t new_chunk_num = 0;
+		size_t l = len - avail; // length w/o first chunk
+		new_chunk_num += l / buf->chunk_size;
+		if ((l % buf->chunk_size) > 0)
+			new_chunk_num++;
+		for (i = 0; i < new_chunk_num; i++) {
+			if (!faux_buf_alloc_chunk(buf))
+				return -1;
+		}
+	}
+
+	// Write lock
+	buf->wlocked = len;
+
+	// Iterate chunks
+	must_be_write = len;
+	i = 0;
+	// Free space within current chunk
+	if (avail > 0) {
+		size_t p_len = (must_be_write < avail) ? must_be_write : avail;
+		faux_buf_chunk_t *chunk = faux_buf_chunk(buf, buf->wchunk);
+		iov[i].iov_base = chunk->data + chunk->end;
+		iov[i].iov_len = p_len;
+		must_be_write -= p_len;
+		i++;
+	}
+	// Fully free chunks
+	while (must_be_write > 0) {
+		size_t p_len = (must_be_write < buf->chunk_size) ?
+			must_be_write : buf->chunk_size;
+		iov[i].iov_base = faux_buf_chunk(buf, index++)->data;
+		iov[i].iov_len = p_len;
+		must_be_write -= p_len;
+		i++;
+	}
+
+	*iov_num = i;
+
+	return len;
+}
+
+
+/** @brief Gets "struct iovec" array for direct writing and locks data.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] len Length of data to lock.
+ * @param [out] iov_out "struct iovec" array to direct write to.
+ * @param [out] iov_num_out Number of "struct iovec" array elements.
+ * @return Length of data actually locked or < 0 on error.
+ */
+ssize_t faux_buf_dwrite_lock(faux_buf_t *buf, size_t len,
+	struct iovec **iov_out, size_t *iov_num_out)
+{
+	size_t vec_entries_num = 0;
+	struct iovec *iov = NULL;
+	ssize_t locked_len = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	assert(iov_out);
+	if (!iov_out)
+		return -1;
+	assert(iov_num_out);
+	if (!iov_num_out)
+		return -1;
+
+	// Don't use already locked buffer
+	if (faux_buf_is_wlocked(buf))
+		return -1;
+
+	// It will be overflow after writing
+	if (faux_buf_will_be_overflow(buf, len))
+		return -1;
+
+	// Nothing to lock
+	if (0 == len) {
+		*iov_out = NULL;
+		*iov_num_out = 0;
+		return 0;
+	}
+
+	vec_entries_num = faux_buf_dwrite_iov_num(buf, len);
+	iov = faux_zmalloc(vec_entries_num * sizeof(*iov));
+	assert(iov);
+	if (!iov)
+		return -1;
+
+	locked_len = faux_buf_dwrite_lock_iov(buf, len, iov, &vec_entries_num);
+	if (locked_len <= 0) {
+		faux_free(iov);
+		return locked_len;
+	}
+
+	*iov_out = iov;
+	*iov_num_out = vec_entries_num;
+
+	return locked_len;
+}
+
+
+/** @brief Gets a data buffer for direct writing and locks it.
+ *
+ * The complimentary function is faux_buf_dwrite_unlock_easy().
+ * This function has the same functionality as faux_buf_dwrite_lock() but
+ * choose the lentgh of locked space itself to return single continuous buffer.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [out] data Continuous buffer for direct writting.
+ * @return Length of data actually locked or < 0 on error.
+ */
+ssize_t faux_buf_dwrite_lock_easy(faux_buf_t *buf, void **data)
+{
+	struct iovec iov = {};
+	size_t iov_num = 1;
+	ssize_t len = 0;
+	ssize_t locked_len = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	assert(data);
+	if (!data)
+		return -1;
+
+	len = faux_buf_wavail(buf);
+	if (len < 0)
+		return -1;
+	if (0 == len)
+		len = buf->chunk_size; // It will use next chunk
+
+	locked_len = faux_buf_dwrite_lock_iov(buf, len, &iov, &iov_num);
+	if (locked_len <= 0)
+		return -1;
+
+	*data = iov.iov_base;
+
+	return locked_len;
+}
+
+
+/** @brief Frees "struct iovec" array and unlocks written data.
+ *
+ * The length of actually written data can be less than length of locked data.
+ * In this case all the data will be unlocked but only actually written length
+ * will be stored within buffer.
+ *
+ * Function gets "struct iovec" array to free it. It was previously allocated
+ * by faux_dwrite_lock() function.
  *
  * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [in] really_readed Length of data actually read.
+ * @param [in] really_written Length of data actually written.
  * @param [out] iov "struct iovec" array to free.
- * @param [out] iov_num_out Number of "struct iovec" array elements.
  * @return Length of data actually unlocked or < 0 on error.
  */
-ssize_t faux_buf_dread_unlock(faux_buf_t *buf, size_t really_readed,
-	struct iovec *iov)
+ssize_t faux_buf_dwrite_unlock(faux_buf_t *buf, size_t really_written,
+	struct iovec *iov)
+{
+	size_t must_be_write = really_written;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+	// Can't unlock non-locked buffer
+	if (!faux_buf_is_wlocked(buf))
+		return -1;
+
+	if (buf->wlocked < really_written)
+		return -1; // Something went wrong
+
+	// Ring. Data is already at place
+	if (buf->ring) {
+		buf->len += really_written;
+		goto unlock;
+	}
+
+	while (must_be_write > 0) {
+		size_t avail = 0;
+		ssize_t data_to_add = 0;
+
+		avail = faux_buf_wavail(buf);
+		// Current chunk was fully written. So move to next one
+		if (0 == avail) {
+			if (buf->wchunk != NO_CHUNK)
+				buf->wchunk++;
+			else
+				buf->wchunk = 0;
+			avail = faux_buf_wavail(buf);
+		}
+		data_to_add = (must_be_write < avail) ? must_be_write : avail;
+
+		buf->len += data_to_add;
+		faux_buf_chunk(buf, buf->wchunk)->end += data_to_add;
+		must_be_write -= data_to_add;
+	}
+
+	if (buf->wchunk != NO_CHUNK) {
+		faux_buf_chunk_t *chunk = NULL;
+		// Remove trailing empty chunks after wchunk
+		while (buf->chunks_num > (buf->wchunk + 1))
+			faux_buf_del_chunk(buf, buf->chunks_num - 1);
+		// When really_written == 0 then all data can be read after
+		// dwrite_lock() and dwrite_unlock() so chunk can be empty.
+		chunk = faux_buf_chunk(buf, buf->wchunk);
+		if ((0 == buf->wchunk) && (chunk->end == chunk->start))
+			faux_buf_del_chunk(buf, 0);
+	// Nothing was written to empty buffer. Remove all locked chunks.
+	} else {
+		faux_buf_del_all_chunks(buf);
+	}
+
+unlock:
+	// Unlock whole buffer. Not 'really written' bytes only
+	buf->wlocked = 0;
+	faux_free(iov);
+	faux_buf_account_add(buf, really_written);
+
+	return really_written;
+}
+
+
+/** @brief Unlocks written data.
+ *
+ * It's a function complementary to faux_buf_dwrite_lock_easy().
+ * It has the same functionality as faux_dwrite_unlock() but doesn't free
+ * "struct iovec" array.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] really_written Length of data actually written.
+ * @return Length of data actually unlocked or < 0 on error.
+ */
+ssize_t faux_buf_dwrite_unlock_easy(faux_buf_t *buf, size_t really_written)
+{
+	return faux_buf_dwrite_unlock(buf, really_written, NULL);
+}
+
+
+/** @brief Writes buffer data to file descriptor using writev().
+ *
+ * Function hands all locked chunks (up to IOV_MAX) to single writev() call.
+ * If all given data was written and buffer has more data (less than "len")
+ * function calls writev() again. Function stops on short write or on error.
+ * Written data is removed from buffer.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] fd File descriptor to write to.
+ * @param [in] len Maximum length of data to write.
+ * @param [out] calls Number of writev() calls is added to the counter.
+ * Can be NULL.
+ * @return Length of data actually written or < 0 on error. If buffer is
+ * already locked then errno is EBUSY. If nothing was written because of
+ * error then errno is set by writev().
+ */
+ssize_t faux_buf_write_to_fd(faux_buf_t *buf, int fd, size_t len,
+	size_t *calls)
+{
+	ssize_t total = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+
+	// Don't use already locked buffer
+	if (faux_buf_is_rlocked(buf)) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	while ((size_t)total < len) {
+		struct iovec iov[FD_IOV_NUM];
+		size_t iov_num = FD_IOV_NUM;
+		ssize_t locked_len = 0;
+		ssize_t bytes_written = 0;
+		int saved_errno = 0;
+
+		locked_len = faux_buf_dread_lock_iov(buf, len - total,
+			iov, &iov_num);
+		if (locked_len <= 0)
+			break;
+		bytes_written = writev(fd, iov, iov_num);
+		saved_errno = errno;
+		if (calls)
+			(*calls)++;
+		faux_buf_dread_unlock(buf,
+			(bytes_written > 0) ? bytes_written : 0, NULL);
+		if (bytes_written < 0) {
+			errno = saved_errno;
+			if (0 == total)
+				return -1;
+			break;
+		}
+		total += bytes_written;
+		// Short write
+		if (bytes_written < locked_len)
+			break;
+	}
+
+	return total;
+}
+
+
+/** @brief Reads data from file descriptor to buffer using readv().
+ *
+ * Function pre-reserves space for "len" bytes (it can be several chunks) and
+ * makes single readv() call. The length is limited by buffer's limit, by free
+ * space of shared budget and by IOV_MAX chunks.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] fd File descriptor to read from.
+ * @param [in] len Maximum length of data to read.
+ * @param [out] calls Number of readv() calls is added to the counter. It's
+ * untouched when function fails before readv() call. Can be NULL.
+ * @return Length of data actually readed or < 0 on error. The "0" means EOF.
+ * If buffer or budget is full then errno is ENOBUFS. If buffer is already
+ * locked then errno is EBUSY. If space can't be allocated then errno is
+ * ENOMEM. Else errno is set by readv().
+ */
+ssize_t faux_buf_read_from_fd(faux_buf_t *buf, int fd, size_t len,
+	size_t *calls)
+{
+	struct iovec iov[FD_IOV_NUM];
+	size_t iov_num = FD_IOV_NUM;
+	ssize_t locked_len = 0;
+	ssize_t bytes_readed = 0;
+	int saved_errno = 0;
+
+	assert(buf);
+	if (!buf)
+		return -1;
+
+	// Don't use already locked buffer
+	if (faux_buf_is_wlocked(buf)) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	// Don't exceed the limit
+	if (buf->limit != FAUX_BUF_UNLIMITED) {
+		size_t space = (buf->limit > buf->len) ?
+			(buf->limit - buf->len) : 0;
+		if (len > space)
+			len = space;
+	}
+	// Don't exceed the shared budget
+	if (buf->budget) {
+		size_t space = faux_buf_budget_space(buf->budget);
+		if (len > space)
+			len = space;
+	}
+	if (0 == len) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	locked_len = faux_buf_dwrite_lock_iov(buf, len, iov, &iov_num);
+	if (locked_len <= 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+	bytes_readed = readv(fd, iov, iov_num);
+	saved_errno = errno;
+	if (calls)
+		(*calls)++;
+	faux_buf_dwrite_unlock(buf, (bytes_readed > 0) ? bytes_readed : 0, NULL);
+	errno = saved_errno;
+
+	return bytes_readed;
+}
+
+
+/** @brief Moves data from one buffer to another.
+ *
+ * Function doesn't copy data when it's possible. The chunks those data must be
+ * moved completely are relinked from source buffer to destination one. The
+ * rest of data (partial tail chunk, small amount of data that fits into free
+ * space of destination's current chunk, ring buffers) is copied.
+ *
+ * Source buffer must not be locked. Destination buffer must not be locked for
+ * writing.
+ *
+ * @param [in] dst Destination buffer.
+ * @param [in] src Source buffer.
+ * @param [in] len Length of data to move.
+ * @return Length of data actually moved or < 0 on error.
+ */
+ssize_t faux_buf_move(faux_buf_t *dst, faux_buf_t *src, size_t len)
+{
+	size_t must_be_moved = 0;
+	size_t moved_len = 0;
+
+	assert(dst);
+	if (!dst)
+		return -1;
+	assert(src);
+	if (!src)
+		return -1;
+	if (dst == src)
+		return -1;
+
+	// Don't use locked buffers
+	if (faux_buf_is_rlocked(src) || faux_buf_is_wlocked(src) ||
+		faux_buf_is_wlocked(dst))
+		return -1;
+
+	must_be_moved = (len < src->len) ? len : src->len;
+	moved_len = must_be_moved;
+	// It will be overflow after moving
+	if (faux_buf_will_be_overflow(dst, must_be_moved))
+		return -1;
+
+	while (must_be_moved > 0) {
+		size_t avail = faux_buf_ravail(src);
+		struct iovec iov = {};
+		size_t iov_num = 1;
+		ssize_t locked_len = 0;
+
+		// Relink whole chunk. Chunk's data will be read from the same
+		// place and free space after data is used by destination.
+		if (!src->ring && !dst->ring && (avail <= must_be_moved) &&
+			(avail > (size_t)faux_buf_wavail(dst))) {
+			if (!faux_buf_push_chunk(dst, faux_buf_chunk(src, 0)))
+				return -1;
+			faux_buf_takeaway_chunk(src, 0);
+			src->len -= avail;
+			faux_buf_account_sub(src, avail);
+			dst->wchunk = dst->chunks_num - 1;
+			dst->len += avail;
+			faux_buf_account_add(dst, avail);
+			must_be_moved -= avail;
+			continue;
+		}
+
+		// Copy data
+		locked_len = faux_buf_dread_lock_iov(src, must_be_moved,
+			&iov, &iov_num);
+		if (locked_len <= 0)
+			return -1;
+		if (faux_buf_write(dst, iov.iov_base, locked_len) != locked_len) {
+			faux_buf_dread_unlock(src, 0, NULL);
+			return -1;
+		}
+		faux_buf_dread_unlock(src, locked_len, NULL);
+		must_be_moved -= locked_len;
+	}
+
+	return moved_len;
+}
+
+
+/** @brief Creates shared segment.
+ *
+ * Data is copied to segment once. After that segment can be appended to
+ * many buffers by faux_buf_append_seg() without copying. Segment is reference
+ * counted. The creator holds one reference and must release it by
+ * faux_buf_seg_free().
+ *
+ * @param [in] data Data to store within segment.
+ * @param [in] len Length of data.
+ * @return Allocated segment or NULL on error.
+ */
+faux_buf_seg_t *faux_buf_seg_new(const void *data, size_t len)
+{
+	struct iovec iov = {};
+
+	assert(data || (0 == len));
+	if (!data && (len != 0))
+		return NULL;
+
+	iov.iov_base = (void *)data;
+	iov.iov_len = len;
+
+	return faux_buf_seg_newv(&iov, 1);
+}
+
+
+/** @brief Creates shared segment from "struct iovec" array.
+ *
+ * The same as faux_buf_seg_new() but gathers data from "struct iovec" array.
+ *
+ * @param [in] iov "struct iovec" array.
+ * @param [in] iov_num Number of "struct iovec" array entries.
+ * @return Allocated segment or NULL on error.
+ */
+faux_buf_seg_t *faux_buf_seg_newv(const struct iovec *iov, size_t iov_num)
+{
+	faux_buf_seg_t *seg = NULL;
+	size_t len = 0;
+	size_t i = 0;
+	char *p = NULL;
+
+	assert(iov || (0 == iov_num));
+	if (!iov && (iov_num != 0))
+		return NULL;
+
+	for (i = 0; i < iov_num; i++)
+		len += iov[i].iov_len;
+
+	seg = faux_malloc(sizeof(*seg) + len);
+	assert(seg);
+	if (!seg)
+		return NULL;
+	seg->data = (char *)(seg + 1);
+	seg->len = len;
+	seg->refcnt = 1;
+	seg->free_fn = NULL;
+	seg->free_udata = NULL;
+
+	p = seg->data;
+	for (i = 0; i < iov_num; i++) {
+		if (0 == iov[i].iov_len)
+			continue;
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+
+	return seg;
+}
+
+
+/** @brief Creates shared segment that references user's memory.
+ *
+ * Data is not copied. User must keep data unchanged until release callback
+ * is executed. Callback is executed when the last reference to segment is
+ * released, i.e. all buffers have read segment's data.
+ *
+ * @param [in] data User's data.
+ * @param [in] len Data length.
+ * @param [in] free_fn Release callback. Can be NULL.
+ * @param [in] user_data User data to pass to callback.
+ * @return Allocated segment or NULL on error.
+ */
+faux_buf_seg_t *faux_buf_seg_new_ref(const void *data, size_t len,
+	faux_buf_seg_free_fn free_fn, void *user_data)
 {
-	size_t must_be_read = really_readed;
+	faux_buf_seg_t *seg = NULL;
 
-	assert(buf);
-	if (!buf)
-		return -1;
-	// Can't unlock non-locked buffer
-	if (!faux_buf_is_rlocked(buf))
-		return -1;
+	assert(data || (0 == len));
+	if (!data && (len != 0))
+		return NULL;
 
-	if (buf->rlocked < really_readed)
-		return -1; // Something went wrong
-	if (buf->len < really_readed)
-		return -1; // Something went wrong
+	seg = faux_zmalloc(sizeof(*seg));
+	assert(seg);
+	if (!seg)
+		return NULL;
+	seg->data = (char *)data;
+	seg->len = len;
+	seg->refcnt = 1;
+	seg->free_fn = free_fn;
+	seg->free_udata = user_data;
 
-	if (0 == really_readed)
-		goto unlock;
+	return seg;
+}
 
-	// Suppose list is not empty
-	while (must_be_read > 0) {
-		size_t avail = faux_buf_ravail(buf);
-		ssize_t data_to_rm = (must_be_read < avail) ? must_be_read : avail;
-		faux_list_node_t *iter = faux_list_head(buf->list);
 
-		buf->len -= data_to_rm;
-		buf->rpos += data_to_rm;
-		must_be_read -= data_to_rm;
+/** @brief Gets one more reference to shared segment.
+ *
+ * @param [in] seg Shared segment.
+ * @return The same segment.
+ */
+faux_buf_seg_t *faux_buf_seg_ref(faux_buf_seg_t *seg)
+{
+	assert(seg);
+	if (!seg)
+		return NULL;
 
-		// Current chunk was fully readed. So remove it from list.
-		// Chunk is not wchunk
-		if ((iter != buf->wchunk) &&
-			(buf->rpos == buf->chunk_size)) {
-			buf->rpos = 0; // 0 position within next chunk
-			faux_list_del(buf->list, iter);
-			if (faux_buf_chunk_num(buf) == 0) { // Empty list w/o locks
-				buf->wchunk = NULL;
-				buf->wpos = buf->chunk_size;
-			}
-		// Chunk is wchunk
-		} else if ((iter == buf->wchunk) &&
-			(buf->rpos == buf->wpos) &&
-			(!buf->wlocked ||  // Chunk can be locked for writing
-			(buf->wpos == buf->chunk_size))) { // Chunk can be filled
-			buf->rpos = 0; // 0 position within next chunk
-			buf->wchunk = NULL;
-			buf->wpos = buf->chunk_size;
-			faux_list_del(buf->list, iter);
-		}
-	}
+	__atomic_add_fetch(&seg->refcnt, 1, __ATOMIC_RELAXED);
 
-unlock:
-	// Unlock whole buffer. Not 'really readed' bytes only
-	buf->rlocked = 0;
-	faux_free(iov);
+	return seg;
+}
 
-	return really_readed;
+
+/** @brief Releases reference to shared segment.
+ *
+ * Segment is freed when the last reference is released. Release callback of
+ * segment that references user's memory is executed at this moment.
+ *
+ * @param [in] seg Shared segment.
+ */
+void faux_buf_seg_free(faux_buf_seg_t *seg)
+{
+	if (!seg)
+		return;
+
+	if (__atomic_sub_fetch(&seg->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	if (seg->free_fn)
+		seg->free_fn(seg->free_udata);
+	faux_free(seg);
 }
 
 
-/** @brief Unlocks read data.
+/** @brief Gets data of shared segment.
  *
- * It's a function complementary to faux_buf_dread_lock_easy().
- * It has the same functionality as faux_dread_unlock() but doesn't free
- * "struct iovec" array.
+ * Data must not be changed while segment is appended to any buffer.
  *
- * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [in] really_readed Length of data actually readed.
- * @return Length of data actually unlocked or < 0 on error.
+ * @param [in] seg Shared segment.
+ * @return Pointer to segment data or NULL on error.
  */
-ssize_t faux_buf_dread_unlock_easy(faux_buf_t *buf, size_t really_readed)
+const void *faux_buf_seg_data(const faux_buf_seg_t *seg)
 {
-	return faux_buf_dread_unlock(buf, really_readed, NULL);
+	assert(seg);
+	if (!seg)
+		return NULL;
+
+	return seg->data;
 }
 
 
-/** @brief Write data from linear buffer to dynamic buffer.
+/** @brief Gets length of shared segment.
+ *
+ * @param [in] seg Shared segment.
+ * @return Length of segment data or < 0 on error.
+ */
+ssize_t faux_buf_seg_len(const faux_buf_seg_t *seg)
+{
+	assert(seg);
+	if (!seg)
+		return -1;
+
+	return seg->len;
+}
+
+
+/** @brief Appends shared segment to the end of buffer.
+ *
+ * Segment is not copied. Buffer gets its own reference to segment and
+ * releases it when segment data is read completely. So caller still owns its
+ * reference. Segment is read-only so the following writes to buffer will use
+ * new chunk. The FAUX_BUF_RING buffer can't share memory so data is copied.
  *
  * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [in] data Linear buffer. Source of data.
- * @param [in] len Length of data to write.
- * @return Length of data actually written or < 0 on error.
+ * @param [in] seg Shared segment.
+ * @return Length of appended data or < 0 on error.
  */
-ssize_t faux_buf_write(faux_buf_t *buf, const void *data, size_t len)
+ssize_t faux_buf_append_seg(faux_buf_t *buf, faux_buf_seg_t *seg)
 {
-	struct iovec *iov = NULL;
-	size_t iov_num = 0;
-	ssize_t total = 0;
-	char *src = (char *)data;
-	size_t i = 0;
+	faux_buf_chunk_t *chunk = NULL;
 
 	assert(buf);
 	if (!buf)
 		return -1;
-	assert(data);
-	if (!data)
+	assert(seg);
+	if (!seg)
 		return -1;
 
-	total = faux_buf_dwrite_lock(buf, len, &iov, &iov_num);
-	if (total <= 0)
-		return total;
+	// Don't use already locked buffer
+	if (faux_buf_is_wlocked(buf))
+		return -1;
 
-	for (i = 0; i < iov_num; i++) {
-		memcpy(iov[i].iov_base, src, iov[i].iov_len);
-		src += iov[i].iov_len;
-	}
+	// It will be overflow after writing
+	if (faux_buf_will_be_overflow(buf, seg->len))
+		return -1;
+
+	if (0 == seg->len)
+		return 0;
 
-	if (faux_buf_dwrite_unlock(buf, total, iov) != total)
+	// Ring. Copy data
+	if (buf->ring)
+		return faux_buf_write(buf, seg->data, seg->len);
+
+	chunk = faux_zmalloc(sizeof(*chunk));
+	assert(chunk);
+	if (!chunk)
+		return -1;
+	chunk->data = seg->data;
+	chunk->size = seg->len;
+	chunk->start = 0;
+	chunk->end = seg->len; // Full chunk. Nobody can write to it
+	chunk->seg = faux_buf_seg_ref(seg);
+
+	if (!faux_buf_push_chunk(buf, chunk)) {
+		faux_buf_release_chunk(buf, chunk);
 		return -1;
+	}
+	buf->wchunk = buf->chunks_num - 1;
+	buf->len += seg->len;
+	faux_buf_account_add(buf, seg->len);
 
-	return total;
+	return seg->len;
 }
 
 
-/** @brief Gets "struct iovec" array for direct writing and locks data.
+/** @brief Appends user's memory to the end of buffer by reference.
+ *
+ * Data referenced by "struct iovec" array is not copied. Release callback is
+ * executed once when all data is read from buffer (or buffer is emptied).
+ * User must keep data unchanged until that moment. If iovec array contains
+ * no data then callback is executed immediately. The FAUX_BUF_RING buffer
+ * can't reference memory so data is copied and callback is executed before
+ * return.
  *
  * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [in] len Length of data to lock.
- * @param [out] iov_out "struct iovec" array to direct write to.
- * @param [out] iov_num_out Number of "struct iovec" array elements.
- * @return Length of data actually locked or < 0 on error.
+ * @param [in] iov "struct iovec" array.
+ * @param [in] iov_num Number of "struct iovec" array entries.
+ * @param [in] free_fn Release callback. Can be NULL.
+ * @param [in] user_data User data to pass to callback.
+ * @return Length of appended data or < 0 on error. Callback is not executed
+ * on error.
  */
-ssize_t faux_buf_dwrite_lock(faux_buf_t *buf, size_t len,
-	struct iovec **iov_out, size_t *iov_num_out)
+ssize_t faux_buf_append_ref(faux_buf_t *buf,
+	const struct iovec *iov, size_t iov_num,
+	faux_buf_seg_free_fn free_fn, void *user_data)
 {
-	size_t vec_entries_num = 0;
-	struct iovec *iov = NULL;
-	unsigned int i = 0;
-	faux_list_node_t *iter = NULL;
-	size_t avail = 0;
-	size_t must_be_write = len;
+	faux_buf_seg_t *seg = NULL;
+	size_t len = 0;
+	size_t i = 0;
+	size_t chunks_num = 0;
+	size_t wchunk = 0;
 
 	assert(buf);
 	if (!buf)
 		return -1;
-	assert(iov_out);
-	if (!iov_out)
-		return -1;
-	assert(iov_num_out);
-	if (!iov_num_out)
+	assert(iov || (0 == iov_num));
+	if (!iov && (iov_num != 0))
 		return -1;
 
 	// Don't use already locked buffer
 	if (faux_buf_is_wlocked(buf))
 		return -1;
 
+	for (i = 0; i < iov_num; i++)
+		len += iov[i].iov_len;
+
 	// It will be overflow after writing
 	if (faux_buf_will_be_overflow(buf, len))
 		return -1;
 
-	// Nothing to lock
-	if (0 == len) {
-		*iov_out = NULL;
-		*iov_num_out = 0;
-		return 0;
+	// Ring. Copy data
+	if (buf->ring) {
+		for (i = 0; i < iov_num; i++) {
+			if (0 == iov[i].iov_len)
+				continue;
+			if (faux_buf_write(buf, iov[i].iov_base,
+				iov[i].iov_len) < 0)
+				return -1;
+		}
+		if (free_fn)
+			free_fn(user_data);
+		return len;
 	}
 
-	// Write lock
-	buf->wlocked = len;
-
-	// Calculate number of struct iovec entries
-	avail = faux_buf_wavail(buf);
-	if (avail > 0)
-		vec_entries_num++;
-	if (avail < len) {
-		size_t i = 0;
-		size_t new_chunk_num = 0;
-		size_t l = len - avail; // length w/o first chunk
-		new_chunk_num += l / buf->chunk_size;
-		if ((l % buf->chunk_size) > 0)
-			new_chunk_num++;
-		vec_entries_num += new_chunk_num;
-		for (i = 0; i < new_chunk_num; i++)
-			faux_buf_alloc_chunk(buf);
+	// Segment is a reference counter only. Each chunk references it
+	seg = faux_buf_seg_new_ref(NULL, 0, free_fn, user_data);
+	if (!seg)
+		return -1;
+	chunks_num = buf->chunks_num;
+	wchunk = buf->wchunk;
+	for (i = 0; i < iov_num; i++) {
+		faux_buf_chunk_t *chunk = NULL;
+
+		if (0 == iov[i].iov_len)
+			continue;
+		chunk = faux_zmalloc(sizeof(*chunk));
+		assert(chunk);
+		if (!chunk)
+			goto err;
+		chunk->data = iov[i].iov_base;
+		chunk->size = iov[i].iov_len;
+		chunk->start = 0;
+		chunk->end = iov[i].iov_len; // Full chunk
+		chunk->seg = faux_buf_seg_ref(seg);
+		if (!faux_buf_push_chunk(buf, chunk)) {
+			faux_buf_seg_free(seg);
+			faux_free(chunk);
+			goto err;
+		}
 	}
-	iov = faux_zmalloc(vec_entries_num * sizeof(*iov));
-	assert(iov);
+	if (buf->chunks_num > chunks_num) {
+		buf->wchunk = buf->chunks_num - 1;
+		buf->len += len;
+		faux_buf_account_add(buf, len);
+	}
+	faux_buf_seg_free(seg);
 
-	// Iterate chunks
-	iter = buf->wchunk;
-	i = 0;
-	while ((must_be_write > 0)) {
-		char *data = NULL;
-		off_t data_offset = 0;
-		size_t data_len = buf->chunk_size;
-		size_t p_len = 0;
+	return len;
 
-		// List was empty before writing
-		if (!iter) {
-			iter = faux_list_head(buf->list);
-		// Not empty list. First element
-		} else if ((iter == buf->wchunk) && (i == 0)) {
-			size_t l = faux_buf_wavail(buf);
-			if (0 == l) { // Not enough space within current chunk
-				iter = faux_list_next_node(iter);
-			} else {
-				data_offset = buf->wpos;
-				data_len = l;
-			}
-		// Not empty list. Fully free chunk
-		} else {
-			iter = faux_list_next_node(iter);
-		}
+err:
+	// Remove already appended chunks. Callback must not be executed
+	seg->free_fn = NULL;
+	while (buf->chunks_num > chunks_num)
+		faux_buf_del_chunk(buf, buf->chunks_num - 1);
+	buf->wchunk = wchunk;
+	faux_buf_seg_free(seg);
 
-		p_len = (must_be_write < data_len) ? must_be_write : data_len;
-		data = (char *)faux_list_data(iter) + data_offset;
-		must_be_write -= p_len;
-		iov[i].iov_base = data;
-		iov[i].iov_len = p_len;
-		i++;
-	}
+	return -1;
+}
 
-	*iov_out = iov;
-	*iov_num_out = vec_entries_num;
 
-	return len;
+/** @brief Compares buffer data at specified position with sequence.
+ *
+ * Static internal function. Data can span several chunks.
+ *
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] index Index of chunk to start from.
+ * @param [in] pos Position within chunk memory.
+ * @param [in] seq Sequence to compare with.
+ * @param [in] seq_len Length of sequence.
+ * @return BOOL_TRUE - data matches sequence, BOOL_FALSE - no match.
+ */
+static bool_t faux_buf_match(const faux_buf_t *buf, size_t index, size_t pos,
+	const char *seq, size_t seq_len)
+{
+	while ((index < buf->chunks_num) && (seq_len > 0)) {
+		faux_buf_chunk_t *chunk = faux_buf_chunk(buf, index);
+		size_t avail = chunk->end - pos;
+		size_t cmp_len = (seq_len < avail) ? seq_len : avail;
+		if (memcmp(chunk->data + pos, seq, cmp_len) != 0)
+			return BOOL_FALSE;
+		seq += cmp_len;
+		seq_len -= cmp_len;
+		index++;
+		if (index < buf->chunks_num)
+			pos = faux_buf_chunk(buf, index)->start;
+	}
+
+	return ((0 == seq_len) ? BOOL_TRUE : BOOL_FALSE);
 }
 
 
-/** @brief Gets a data buffer for direct writing and locks it.
+/** @brief Finds sequence of bytes within buffer.
  *
- * The complimentary function is faux_buf_dwrite_unlock_easy().
- * This function has the same functionality as faux_buf_dwrite_lock() but
- * choose the lentgh of locked space itself to return single continuous buffer.
+ * Function searches data without consuming it. Sequence can span chunk
+ * boundaries. Search starts from specified offset so user can resume search
+ * from the last scanned position when more data arrives. For example if
+ * previous search within "len" bytes failed then next search can start
+ * from "len - seq_len + 1" offset. Function uses memchr()/memmem() that are
+ * vectorized by C library.
  *
  * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [out] data Continuous buffer for direct writting.
- * @return Length of data actually locked or < 0 on error.
+ * @param [in] offset Offset to start search from.
+ * @param [in] seq Sequence to find.
+ * @param [in] seq_len Length of sequence.
+ * @return Offset of found sequence from the beginning of data or < 0 if
+ * sequence is not found or on error.
  */
-ssize_t faux_buf_dwrite_lock_easy(faux_buf_t *buf, void **data)
+ssize_t faux_buf_find_seq(const faux_buf_t *buf, size_t offset,
+	const void *seq, size_t seq_len)
 {
-	struct iovec *iov = NULL;
-	size_t iov_num = 0;
-	ssize_t len = 0;
-	ssize_t locked_len = 0;
+	size_t index = 0;
+	size_t chunk_offset = 0; // Offset of current chunk's data
 
 	assert(buf);
 	if (!buf)
 		return -1;
-	assert(data);
-	if (!data)
+	assert(seq);
+	if (!seq)
 		return -1;
-
-	// Don't use already locked buffer
-	if (faux_buf_is_wlocked(buf))
+	if (0 == seq_len)
 		return -1;
-
-	len = faux_buf_wavail(buf);
-	if (len < 0)
+	if ((offset >= buf->len) || (seq_len > (buf->len - offset)))
 		return -1;
-	if (0 == len)
-		len = buf->chunk_size; // It will use next chunk
 
-	locked_len = faux_buf_dwrite_lock(buf, len, &iov, &iov_num);
-	if (locked_len <= 0)
-		return -1;
-	if (iov_num < 1) {
-		faux_free(iov);
-		return -1;
+	// Ring. Data is continuous
+	if (buf->ring) {
+		const char *data = buf->ring + buf->ring_rpos;
+		const char *found = NULL;
+		if (1 == seq_len)
+			found = memchr(data + offset, *(const char *)seq,
+				buf->len - offset);
+		else
+			found = memmem(data + offset, buf->len - offset,
+				seq, seq_len);
+		return (found ? (found - data) : -1);
 	}
 
-	*data = iov[0].iov_base;
-	locked_len = iov[0].iov_len;
+	for (index = 0; index < buf->chunks_num; index++) {
+		faux_buf_chunk_t *chunk = faux_buf_chunk(buf, index);
+		size_t avail = chunk->end - chunk->start;
+		size_t pos = 0;
+		const char *found = NULL;
 
-	faux_free(iov);
+		// Skip chunks before offset
+		if ((chunk_offset + avail) <= offset) {
+			chunk_offset += avail;
+			continue;
+		}
+		pos = chunk->start +
+			((offset > chunk_offset) ? (offset - chunk_offset) : 0);
+
+		// Sequence within chunk
+		if (1 == seq_len)
+			found = memchr(chunk->data + pos, *(const char *)seq,
+				chunk->end - pos);
+		else if ((chunk->end - pos) >= seq_len)
+			found = memmem(chunk->data + pos, chunk->end - pos,
+				seq, seq_len);
+		if (found)
+			return chunk_offset + (found - chunk->data) - chunk->start;
+
+		// Sequence spans chunk boundary
+		if (seq_len > 1) {
+			size_t tail = seq_len - 1;
+			if ((chunk->end - pos) > tail)
+				pos = chunk->end - tail;
+			for (; pos < chunk->end; pos++) {
+				if (chunk->data[pos] != *(const char *)seq)
+					continue;
+				if (faux_buf_match(buf, index, pos,
+					seq, seq_len))
+					return chunk_offset + pos - chunk->start;
+			}
+		}
 
-	return locked_len;
+		chunk_offset += avail;
+	}
+
+	return -1;
 }
 
 
-/** @brief Frees "struct iovec" array and unlocks written data.
+/** @brief Finds byte within buffer.
  *
- * The length of actually written data can be less than length of locked data.
- * In this case all the data will be unlocked but only actually written length
- * will be stored within buffer.
+ * The same as faux_buf_find_seq() but finds single byte. It's suitable to find
+ * delimiter of line-framed protocols.
  *
- * Function gets "struct iovec" array to free it. It was previously allocated
- * by faux_dwrite_lock() function.
+ * @param [in] buf Allocated and initialized dynamic buffer object.
+ * @param [in] offset Offset to start search from.
+ * @param [in] byte Byte to find.
+ * @return Offset of found byte from the beginning of data or < 0 if byte is
+ * not found or on error.
+ */
+ssize_t faux_buf_find_byte(const faux_buf_t *buf, size_t offset, char byte)
+{
+	return faux_buf_find_seq(buf, offset, &byte, 1);
+}
+
+
+/** @brief Copies data from buffer without consuming it.
+ *
+ * Function can be used to parse message header before the whole message is
+ * received. Buffer can be locked.
  *
  * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [in] really_written Length of data actually written.
- * @param [out] iov "struct iovec" array to free.
- * @return Length of data actually unlocked or < 0 on error.
+ * @param [in] offset Offset of data from the beginning of buffer data.
+ * @param [out] dst Destination linear buffer.
+ * @param [in] len Length of data to copy.
+ * @return Length of data actually copied or < 0 on error.
  */
-ssize_t faux_buf_dwrite_unlock(faux_buf_t *buf, size_t really_written,
-	struct iovec *iov)
+ssize_t faux_buf_peek(const faux_buf_t *buf, size_t offset,
+	void *dst, size_t len)
 {
-	size_t must_be_write = really_written;
+	size_t index = 0;
+	size_t chunk_offset = 0; // Offset of current chunk's data
+	size_t must_be_copied = 0;
+	char *p = (char *)dst;
 
 	assert(buf);
 	if (!buf)
 		return -1;
-	// Can't unlock non-locked buffer
-	if (!faux_buf_is_wlocked(buf))
+	assert(dst || (0 == len));
+	if (!dst && (len != 0))
 		return -1;
 
-	if (buf->wlocked < really_written)
-		return -1; // Something went wrong
-
-	while (must_be_write > 0) {
-		size_t avail = 0;
-		ssize_t data_to_add = 0;
-
-		avail = faux_buf_wavail(buf);
-		// Current chunk was fully written. So move to next one
-		if (0 == avail) {
-			buf->wpos = 0; // 0 position within next chunk
-			if (buf->wchunk)
-				buf->wchunk = faux_list_next_node(buf->wchunk);
-			else
-				buf->wchunk = faux_list_head(buf->list);
-			avail = faux_buf_wavail(buf);
-		}
-		data_to_add = (must_be_write < avail) ? must_be_write : avail;
-
-		buf->len += data_to_add;
-		buf->wpos += data_to_add;
-		must_be_write -= data_to_add;
+	if (offset >= buf->len)
+		return 0;
+	must_be_copied = buf->len - offset;
+	if (len < must_be_copied)
+		must_be_copied = len;
+	len = must_be_copied;
+
+	// Ring. Data is continuous
+	if (buf->ring) {
+		memcpy(dst, buf->ring + buf->ring_rpos + offset, len);
+		return len;
 	}
 
-	if (buf->wchunk) {
-		faux_list_node_t *iter = NULL;
-		// Remove trailing empty chunks after wchunk
-		while ((iter = faux_list_next_node(buf->wchunk)))
-			faux_list_del(buf->list, iter);
-		// When really_written == 0 then all data can be read after
-		// dwrite_lock() and dwrite_unlock() so chunk can be empty.
-		if ((faux_list_head(buf->list) == buf->wchunk) &&
-			(buf->wpos == buf->rpos)) {
-			faux_list_del(buf->list, buf->wchunk);
-			buf->wchunk = NULL;
-			buf->wpos = buf->chunk_size;
-			buf->rpos = 0;
+	for (index = 0; (index < buf->chunks_num) && (must_be_copied > 0);
+		index++) {
+		faux_buf_chunk_t *chunk = faux_buf_chunk(buf, index);
+		size_t avail = chunk->end - chunk->start;
+		size_t skip = 0;
+		size_t copy_len = 0;
+
+		// Skip chunks before offset
+		if ((chunk_offset + avail) <= offset) {
+			chunk_offset += avail;
+			continue;
 		}
+		skip = (offset > chunk_offset) ? (offset - chunk_offset) : 0;
+		copy_len = avail - skip;
+		if (copy_len > must_be_copied)
+			copy_len = must_be_copied;
+		memcpy(p, chunk->data + chunk->start + skip, copy_len);
+		p += copy_len;
+		must_be_copied -= copy_len;
+		chunk_offset += avail;
 	}
 
-	// Unlock whole buffer. Not 'really written' bytes only
-	buf->wlocked = 0;
-	faux_free(iov);
-
-	return really_written;
+	return len;
 }
 
 
-/** @brief Unlocks written data.
+/** @brief Makes the beginning of buffer data continuous.
  *
- * It's a function complementary to faux_buf_dwrite_lock_easy().
- * It has the same functionality as faux_dwrite_unlock() but doesn't free
- * "struct iovec" array.
+ * Function guarantees that the first "len" bytes of data are continuous and
+ * returns pointer to them. Data is not consumed. So it can be parsed in place
+ * and then read by usual functions. Data is copied only if it spans chunk
+ * boundary. In this case data is gathered into the first chunk if it's large
+ * enough or into new memory block that replaces the first chunk. Pointer is
+ * valid until buffer is changed. Buffer must not be locked.
  *
  * @param [in] buf Allocated and initialized dynamic buffer object.
- * @param [in] really_written Length of data actually written.
- * @return Length of data actually unlocked or < 0 on error.
+ * @param [in] len Length of data to make continuous.
+ * @return Pointer to continuous data or NULL on error or if buffer contains
+ * less than "len" bytes.
  */
-ssize_t faux_buf_dwrite_unlock_easy(faux_buf_t *buf, size_t really_written)
+void *faux_buf_linearize(faux_buf_t *buf, size_t len)
 {
-	return faux_buf_dwrite_unlock(buf, really_written, NULL);
+	faux_buf_chunk_t *chunk = NULL;
+	faux_buf_seg_t *seg = NULL;
+	char *dst = NULL;
+	size_t avail = 0;
+	size_t must_be_copied = 0;
+
+	assert(buf);
+	if (!buf)
+		return NULL;
+	if ((0 == len) || (len > buf->len))
+		return NULL;
+	// Don't use locked buffer
+	if (faux_buf_is_rlocked(buf) || faux_buf_is_wlocked(buf))
+		return NULL;
+
+	// Ring. Data is continuous
+	if (buf->ring)
+		return (buf->ring + buf->ring_rpos);
+
+	chunk = faux_buf_chunk(buf, 0);
+	avail = chunk->end - chunk->start;
+	// Data is continuous already
+	if (avail >= len)
+		return (chunk->data + chunk->start);
+
+	// Gather data within the first chunk or within new memory block
+	if (!chunk->seg && (chunk->size >= len)) {
+		memmove(chunk->data, chunk->data + chunk->start, avail);
+		dst = chunk->data;
+	} else {
+		seg = faux_malloc(sizeof(*seg) + len);
+		assert(seg);
+		if (!seg)
+			return NULL;
+		seg->data = (char *)(seg + 1);
+		seg->len = len;
+		seg->refcnt = 1;
+		seg->free_fn = NULL;
+		seg->free_udata = NULL;
+		memcpy(seg->data, chunk->data + chunk->start, avail);
+		dst = seg->data;
+	}
+	must_be_copied = len - avail;
+
+	// Consume data of the next chunks
+	while (must_be_copied > 0) {
+		faux_buf_chunk_t *next = faux_buf_chunk(buf, 1);
+		size_t copy_len = next->end - next->start;
+
+		if (copy_len > must_be_copied)
+			copy_len = must_be_copied;
+		memcpy(dst + len - must_be_copied,
+			next->data + next->start, copy_len);
+		next->start += copy_len;
+		must_be_copied -= copy_len;
+		if (next->start != next->end)
+			continue;
+		if (1 == buf->wchunk)
+			buf->wchunk = 0;
+		faux_buf_del_chunk(buf, 1);
+	}
+
+	// Replace memory of the first chunk. Descriptor of chunk stays the same
+	// so memory is freed on chunk release like shared segment's memory.
+	if (seg) {
+		faux_buf_seg_free(chunk->seg);
+		chunk->seg = seg;
+		chunk->data = seg->data;
+		chunk->size = len;
+	}
+	chunk->start = 0;
+	chunk->end = len;
+
+	return chunk->data;
 }
@@ -1,4 +1,15 @@
 #include "faux/faux.h"
+#include "faux/list.h"
 #include "faux/buf.h"
 
-ssize_t faux_buf_chunk_num(const faux_buf_t *buf);
+FAUX_HIDDEN ssize_t faux_buf_chunk_num(const faux_buf_t *buf);
+FAUX_HIDDEN void faux_buf_release_idle(faux_buf_t *buf);
+FAUX_HIDDEN void faux_buf_pool_release_idle(void);
+
+FAUX_HIDDEN faux_list_node_t *faux_buf_budget_attach(
+	faux_buf_budget_t *budget, faux_buf_t *buf);
+FAUX_HIDDEN void faux_buf_budget_detach(faux_buf_budget_t *budget,
+	faux_list_node_t *node);
+FAUX_HIDDEN void faux_buf_budget_inc(faux_buf_budget_t *budget, size_t len);
+FAUX_HIDDEN void faux_buf_budget_dec(faux_buf_budget_t *budget, size_t len);
+FAUX_HIDDEN size_t faux_buf_budget_space(const faux_buf_budget_t *budget);
@@ -1,9 +1,12 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "faux/str.h"
 #include "faux/buf.h"
@@ -611,3 +614,1172 @@ int testc_faux_buf_mass(void)
 
 	return 0;
 }
+
+
+int testc_faux_buf_cache(void)
+{
+	faux_buf_t *buf = NULL;
+	char *rnd = NULL;
+	char *dst = NULL;
+	faux_buf_cache_stat_t stat = {};
+	size_t len = CHUNK * 2;
+	unsigned int i = 0;
+
+	rnd = faux_testc_rnd_buf(len);
+	dst = faux_malloc(len);
+
+	printf("faux_buf_new()\n");
+	buf = faux_buf_new(CHUNK);
+	if (!buf) {
+		fprintf(stderr, "faux_buf_new() error\n");
+		return -1;
+	}
+	faux_buf_set_cache_limit(buf, CHUNK * 3);
+
+	// Streaming. Only first iteration allocates chunks
+	printf("faux_buf_write() and faux_buf_read() cycle\n");
+	for (i = 0; i < 10; i++) {
+		if (faux_buf_write(buf, rnd, len) != (ssize_t)len) {
+			fprintf(stderr, "faux_buf_write() error\n");
+			return -1;
+		}
+		if (faux_buf_read(buf, dst, len) != (ssize_t)len) {
+			fprintf(stderr, "faux_buf_read() error\n");
+			return -1;
+		}
+		if (memcmp(rnd, dst, len) != 0) {
+			fprintf(stderr, "Data is broken\n");
+			return -1;
+		}
+	}
+
+	printf("faux_buf_cache_stat()\n");
+	faux_buf_cache_stat(buf, &stat);
+	if ((stat.misses != 2) || (stat.hits != 18) ||
+		(stat.retained != CHUNK * 2)) {
+		fprintf(stderr, "Cache stat: hits=%lu, misses=%lu, retained=%lu\n",
+			stat.hits, stat.misses, stat.retained);
+		return -1;
+	}
+
+	// Shrink cache
+	printf("faux_buf_set_cache_limit()\n");
+	faux_buf_set_cache_limit(buf, CHUNK);
+	faux_buf_cache_stat(buf, &stat);
+	if (stat.retained != CHUNK) {
+		fprintf(stderr, "Retained %lu\n", stat.retained);
+		return -1;
+	}
+
+	faux_buf_free(buf);
+	faux_free(dst);
+	faux_free(rnd);
+
+	return 0;
+}
+
+
+int testc_faux_buf_pool(void)
+{
+	faux_buf_t *buf = NULL;
+	faux_buf_t *buf2 = NULL;
+	char *rnd = NULL;
+	char *dst = NULL;
+	faux_buf_cache_stat_t stat = {};
+	const size_t chunk = 128; // Power of two
+	size_t len = chunk * 2;
+
+	rnd = faux_testc_rnd_buf(len);
+	dst = faux_malloc(len);
+	faux_buf_pool_set_limit(chunk * 4);
+
+	// Chunks of the first buffer go to pool
+	printf("faux_buf_write() and faux_buf_read() to first buffer\n");
+	buf = faux_buf_new(chunk);
+	faux_buf_write(buf, rnd, len);
+	faux_buf_read(buf, dst, len);
+	faux_buf_free(buf);
+	faux_buf_pool_stat(&stat);
+	if (stat.retained != len) {
+		fprintf(stderr, "Pool retained %lu\n", stat.retained);
+		return -1;
+	}
+
+	// Second buffer takes chunks from pool
+	printf("faux_buf_write() to second buffer\n");
+	buf2 = faux_buf_new(chunk);
+	faux_buf_write(buf2, rnd, len);
+	faux_buf_pool_stat(&stat);
+	if ((stat.retained != 0) || (stat.hits != 2)) {
+		fprintf(stderr, "Pool stat: hits=%lu, misses=%lu, retained=%lu\n",
+			stat.hits, stat.misses, stat.retained);
+		return -1;
+	}
+	if ((faux_buf_read(buf2, dst, len) != (ssize_t)len) ||
+		(memcmp(rnd, dst, len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+	faux_buf_free(buf2);
+
+	printf("faux_buf_pool_set_limit() 0\n");
+	faux_buf_pool_set_limit(0);
+	faux_buf_pool_stat(&stat);
+	if (stat.retained != 0) {
+		fprintf(stderr, "Pool retained %lu\n", stat.retained);
+		return -1;
+	}
+
+	faux_free(dst);
+	faux_free(rnd);
+
+	return 0;
+}
+
+
+typedef struct {
+	size_t retained; // Retained by pool before thread exit
+	size_t retained_on_exit; // Retained by pool after its destructor
+	unsigned int calls;
+} pool_thread_t;
+
+static pthread_key_t pool_thread_key;
+
+
+static void pool_thread_exit(void *arg)
+{
+	pool_thread_t *t = (pool_thread_t *)arg;
+	faux_buf_cache_stat_t stat = {};
+
+	faux_buf_pool_stat(&stat);
+	t->retained_on_exit = stat.retained;
+	// Order of destructors is not specified. Non-NULL value makes
+	// destructor to be executed again after pool's destructor.
+	if ((stat.retained != 0) && (0 == t->calls++))
+		pthread_setspecific(pool_thread_key, t);
+}
+
+
+static void *pool_thread(void *arg)
+{
+	pool_thread_t *t = (pool_thread_t *)arg;
+	faux_buf_cache_stat_t stat = {};
+	faux_buf_t *buf = NULL;
+	char data[1024] = {};
+
+	faux_buf_pool_set_limit(sizeof(data) * 4);
+	buf = faux_buf_new(128);
+	faux_buf_write(buf, data, sizeof(data));
+	faux_buf_free(buf);
+	faux_buf_pool_stat(&stat);
+	t->retained = stat.retained;
+	pthread_setspecific(pool_thread_key, t);
+
+	// Pool is not disabled. It's freed on thread exit
+	return NULL;
+}
+
+
+int testc_faux_buf_pool_thread(void)
+{
+	pthread_t thread;
+	pool_thread_t t = {};
+	faux_buf_cache_stat_t stat = {};
+
+	printf("Thread exits with non-empty pool\n");
+	if (pthread_key_create(&pool_thread_key, pool_thread_exit) != 0)
+		return -1;
+	if (pthread_create(&thread, NULL, pool_thread, &t) != 0) {
+		fprintf(stderr, "pthread_create() error\n");
+		pthread_key_delete(pool_thread_key);
+		return -1;
+	}
+	pthread_join(thread, NULL);
+	pthread_key_delete(pool_thread_key);
+	if (0 == t.retained) {
+		fprintf(stderr, "Pool of thread was empty\n");
+		return -1;
+	}
+	if (t.retained_on_exit != 0) {
+		fprintf(stderr, "Pool retained %lu on thread exit\n",
+			t.retained_on_exit);
+		return -1;
+	}
+	// Main thread's pool is not affected
+	faux_buf_pool_stat(&stat);
+	if (stat.retained != 0) {
+		fprintf(stderr, "Pool retained %lu\n", stat.retained);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int testc_faux_buf_iov(void)
+{
+	faux_buf_t *buf = NULL;
+	char *rnd = NULL;
+	char *dst = NULL;
+	struct iovec iov[2] = {};
+	size_t iov_num = 0;
+	ssize_t locked = 0;
+	size_t len = CHUNK * 3 + 15;
+	size_t i = 0;
+	char *p = NULL;
+
+	rnd = faux_testc_rnd_buf(len);
+	dst = faux_malloc(len);
+
+	printf("faux_buf_new()\n");
+	buf = faux_buf_new(CHUNK);
+
+	// Write lock is limited by number of iovec entries
+	printf("faux_buf_dwrite_lock_iov()\n");
+	iov_num = 2;
+	if ((locked = faux_buf_dwrite_lock_iov(buf, len, iov, &iov_num)) !=
+		(CHUNK * 2)) {
+		fprintf(stderr, "faux_buf_dwrite_lock_iov() error %ld\n", locked);
+		return -1;
+	}
+	if ((iov_num != 2) || (faux_buf_chunk_num(buf) != 2)) {
+		fprintf(stderr, "iov_num=%lu, chunk_num=%ld\n",
+			iov_num, faux_buf_chunk_num(buf));
+		return -1;
+	}
+	p = rnd;
+	for (i = 0; i < iov_num; i++) {
+		memcpy(iov[i].iov_base, p, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+	printf("faux_buf_dwrite_unlock()\n");
+	if (faux_buf_dwrite_unlock(buf, locked, NULL) != locked) {
+		fprintf(stderr, "faux_buf_dwrite_unlock() error\n");
+		return -1;
+	}
+	if (faux_buf_write(buf, p, len - locked) != (ssize_t)(len - locked)) {
+		fprintf(stderr, "faux_buf_write() error\n");
+		return -1;
+	}
+
+	// Read lock is limited by number of iovec entries
+	printf("faux_buf_dread_lock_iov()\n");
+	faux_buf_read(buf, dst, 15);
+	iov_num = 2;
+	if ((locked = faux_buf_dread_lock_iov(buf, len, iov, &iov_num)) !=
+		(CHUNK * 2 - 15)) {
+		fprintf(stderr, "faux_buf_dread_lock_iov() error %ld\n", locked);
+		return -1;
+	}
+	p = dst + 15;
+	for (i = 0; i < iov_num; i++) {
+		memcpy(p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+	printf("faux_buf_dread_unlock()\n");
+	if (faux_buf_dread_unlock(buf, locked, NULL) != locked) {
+		fprintf(stderr, "faux_buf_dread_unlock() error\n");
+		return -1;
+	}
+	if (faux_buf_read(buf, p, len) != (ssize_t)(CHUNK + 15)) {
+		fprintf(stderr, "faux_buf_read() error\n");
+		return -1;
+	}
+	if (memcmp(rnd, dst, len) != 0) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+	if (faux_buf_chunk_num(buf) != 0) {
+		fprintf(stderr, "faux_buf_chunk_num() is not 0\n");
+		return -1;
+	}
+
+	faux_buf_free(buf);
+	faux_free(dst);
+	faux_free(rnd);
+
+	return 0;
+}
+
+
+int testc_faux_buf_ring(void)
+{
+	faux_buf_t *buf = NULL;
+	char *rnd = NULL;
+	char *dst = NULL;
+	void *data = NULL;
+	ssize_t locked = 0;
+	ssize_t ring_size = 0;
+
+	printf("faux_buf_new_type()\n");
+	buf = faux_buf_new_type(100, FAUX_BUF_RING);
+	if (!buf) {
+		fprintf(stderr, "faux_buf_new_type() error\n");
+		return -1;
+	}
+	ring_size = faux_buf_limit(buf);
+	if ((ring_size < 100) || ((ring_size & (ring_size - 1)) != 0)) {
+		fprintf(stderr, "Ring size %ld\n", ring_size);
+		return -1;
+	}
+	rnd = faux_testc_rnd_buf(ring_size);
+	dst = faux_malloc(ring_size);
+
+	// Move read position to the middle of ring
+	printf("faux_buf_write() and faux_buf_read()\n");
+	if (faux_buf_write(buf, rnd, ring_size / 2 + 7) != (ring_size / 2 + 7)) {
+		fprintf(stderr, "faux_buf_write() error\n");
+		return -1;
+	}
+	if (faux_buf_read(buf, dst, ring_size / 2 + 7) != (ring_size / 2 + 7)) {
+		fprintf(stderr, "faux_buf_read() error\n");
+		return -1;
+	}
+
+	// Fill the whole ring. Data wraps around the end of ring
+	printf("faux_buf_write() whole ring\n");
+	if (faux_buf_write(buf, rnd, ring_size) != ring_size) {
+		fprintf(stderr, "faux_buf_write() whole ring error\n");
+		return -1;
+	}
+	printf("faux_buf_will_be_overflow()\n");
+	if (!faux_buf_will_be_overflow(buf, 1) ||
+		(faux_buf_write(buf, rnd, 1) >= 0)) {
+		fprintf(stderr, "Ring must be full\n");
+		return -1;
+	}
+
+	// Whole data is continuous
+	printf("faux_buf_dread_lock_easy()\n");
+	if ((locked = faux_buf_dread_lock_easy(buf, &data)) != ring_size) {
+		fprintf(stderr, "faux_buf_dread_lock_easy() error %ld\n", locked);
+		return -1;
+	}
+	if (memcmp(data, rnd, ring_size) != 0) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+	faux_buf_dread_unlock_easy(buf, locked);
+	if (faux_buf_len(buf) != 0) {
+		fprintf(stderr, "Buffer is not empty\n");
+		return -1;
+	}
+
+	faux_buf_free(buf);
+	faux_free(dst);
+	faux_free(rnd);
+
+	return 0;
+}
+
+
+int testc_faux_buf_fd(void)
+{
+	faux_buf_t *buf = NULL;
+	faux_buf_t *buf2 = NULL;
+	char *rnd = NULL;
+	char *dst = NULL;
+	int pipefd[2] = {-1, -1};
+	size_t len = CHUNK * 10 + 15;
+	ssize_t res = 0;
+	size_t calls = 0;
+	void *data = NULL;
+
+	rnd = faux_testc_rnd_buf(len);
+	dst = faux_malloc(len);
+	if (pipe(pipefd) < 0) {
+		fprintf(stderr, "pipe() error\n");
+		return -1;
+	}
+
+	buf = faux_buf_new(CHUNK);
+	buf2 = faux_buf_new(CHUNK);
+	faux_buf_write(buf, rnd, len);
+	// Unaligned read position
+	faux_buf_read(buf, dst, 15);
+
+	printf("faux_buf_write_to_fd()\n");
+	if ((res = faux_buf_write_to_fd(buf, pipefd[1], len, &calls)) !=
+		(ssize_t)(len - 15)) {
+		fprintf(stderr, "faux_buf_write_to_fd() error %ld\n", res);
+		return -1;
+	}
+	if (0 == calls) {
+		fprintf(stderr, "writev() calls are not counted\n");
+		return -1;
+	}
+	if (faux_buf_len(buf) != 0) {
+		fprintf(stderr, "Buffer is not empty\n");
+		return -1;
+	}
+
+	printf("faux_buf_read_from_fd()\n");
+	faux_buf_set_limit(buf2, len - 15 - 10);
+	calls = 0;
+	if ((res = faux_buf_read_from_fd(buf2, pipefd[0], len, &calls)) !=
+		(ssize_t)(len - 15 - 10)) {
+		fprintf(stderr, "faux_buf_read_from_fd() error %ld\n", res);
+		return -1;
+	}
+	printf("faux_buf_read_from_fd() full buffer\n");
+	if (faux_buf_read_from_fd(buf2, pipefd[0], len, &calls) >= 0) {
+		fprintf(stderr, "faux_buf_read_from_fd() must fail\n");
+		return -1;
+	}
+	if (calls != 1) {
+		fprintf(stderr, "Wrong number of readv() calls: %lu\n", calls);
+		return -1;
+	}
+	faux_buf_read(buf2, dst + 15, len);
+	faux_buf_set_limit(buf2, FAUX_BUF_UNLIMITED);
+	if (faux_buf_read_from_fd(buf2, pipefd[0], len, NULL) != 10) {
+		fprintf(stderr, "faux_buf_read_from_fd() the rest error\n");
+		return -1;
+	}
+	faux_buf_read(buf2, dst + len - 10, 10);
+	if (memcmp(rnd, dst, len) != 0) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+
+	printf("faux_buf_read_from_fd() locked buffer\n");
+	faux_buf_dwrite_lock_easy(buf2, &data);
+	errno = EAGAIN;
+	if ((faux_buf_read_from_fd(buf2, pipefd[0], len, NULL) >= 0) ||
+		(errno != EBUSY)) {
+		fprintf(stderr, "faux_buf_read_from_fd() errno %d\n", errno);
+		return -1;
+	}
+	faux_buf_dwrite_unlock_easy(buf2, 0);
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+	faux_buf_free(buf);
+	faux_buf_free(buf2);
+	faux_free(dst);
+	faux_free(rnd);
+
+	return 0;
+}
+
+
+int testc_faux_buf_move(void)
+{
+	faux_buf_t *src = NULL;
+	faux_buf_t *dst = NULL;
+	faux_buf_t *ring = NULL;
+	char *rnd = NULL;
+	char *res = NULL;
+	size_t len = CHUNK * 3 + 15;
+	void *data = NULL;
+
+	rnd = faux_testc_rnd_buf(len);
+	res = faux_malloc(len);
+
+	src = faux_buf_new(CHUNK);
+	dst = faux_buf_new(CHUNK);
+	faux_buf_write(src, rnd, len);
+	faux_buf_write(dst, rnd, 10);
+	// Unaligned read position within source
+	faux_buf_read(src, res, 5);
+
+	printf("faux_buf_move() relink\n");
+	if (faux_buf_move(dst, src, CHUNK * 2) != CHUNK * 2) {
+		fprintf(stderr, "faux_buf_move() error\n");
+		return -1;
+	}
+	if ((faux_buf_len(src) != (ssize_t)(len - 5 - CHUNK * 2)) ||
+		(faux_buf_len(dst) != CHUNK * 2 + 10)) {
+		fprintf(stderr, "Wrong buffer length\n");
+		return -1;
+	}
+	// Two chunks are relinked, the tail is copied into new chunk
+	if (faux_buf_chunk_num(dst) != 4) {
+		fprintf(stderr, "Wrong number of chunks %ld\n",
+			faux_buf_chunk_num(dst));
+		return -1;
+	}
+
+	printf("faux_buf_move() locked buffer\n");
+	faux_buf_dread_lock_easy(src, &data);
+	if (faux_buf_move(dst, src, 1) >= 0) {
+		fprintf(stderr, "faux_buf_move() must fail\n");
+		return -1;
+	}
+	faux_buf_dread_unlock_easy(src, 0);
+
+	printf("faux_buf_move() overflow\n");
+	faux_buf_set_limit(dst, CHUNK * 2 + 20);
+	if (faux_buf_move(dst, src, len) >= 0) {
+		fprintf(stderr, "faux_buf_move() must fail\n");
+		return -1;
+	}
+	faux_buf_set_limit(dst, FAUX_BUF_UNLIMITED);
+
+	printf("faux_buf_move() the rest to ring\n");
+	ring = faux_buf_new_type(0, FAUX_BUF_RING);
+	if (faux_buf_move(ring, dst, len) != CHUNK * 2 + 10) {
+		fprintf(stderr, "faux_buf_move() to ring error\n");
+		return -1;
+	}
+	if (faux_buf_move(ring, src, len) != (ssize_t)(len - 5 - CHUNK * 2)) {
+		fprintf(stderr, "faux_buf_move() to ring error\n");
+		return -1;
+	}
+	if ((faux_buf_len(src) != 0) || (faux_buf_len(dst) != 0)) {
+		fprintf(stderr, "Source buffers are not empty\n");
+		return -1;
+	}
+	if ((faux_buf_chunk_num(src) != 0) || (faux_buf_chunk_num(dst) != 0)) {
+		fprintf(stderr, "Source buffers have chunks\n");
+		return -1;
+	}
+
+	faux_buf_read(ring, res, 10);
+	faux_buf_read(ring, res + 5, len - 5);
+	if (memcmp(rnd, res, 10) != 0 ||
+		memcmp(rnd + 5, res + 5, len - 5) != 0) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+
+	faux_buf_free(src);
+	faux_buf_free(dst);
+	faux_buf_free(ring);
+	faux_free(res);
+	faux_free(rnd);
+
+	return 0;
+}
+
+
+int testc_faux_buf_seg(void)
+{
+	faux_buf_t *buf = NULL;
+	faux_buf_t *buf2 = NULL;
+	faux_buf_seg_t *seg = NULL;
+	char *rnd = NULL;
+	char *res = NULL;
+	size_t len = CHUNK * 2 + 15;
+
+	rnd = faux_testc_rnd_buf(len);
+	res = faux_malloc(len + 20);
+
+	buf = faux_buf_new(CHUNK);
+	buf2 = faux_buf_new(CHUNK);
+	seg = faux_buf_seg_new(rnd, len);
+
+	printf("faux_buf_append_seg()\n");
+	faux_buf_write(buf, "0123456789", 10);
+	if (faux_buf_append_seg(buf, seg) != (ssize_t)len) {
+		fprintf(stderr, "faux_buf_append_seg() error\n");
+		return -1;
+	}
+	faux_buf_write(buf, "abcdefghij", 10);
+	if (faux_buf_append_seg(buf2, seg) != (ssize_t)len) {
+		fprintf(stderr, "faux_buf_append_seg() error\n");
+		return -1;
+	}
+	// Segment is a single chunk. Next write uses new chunk
+	if (faux_buf_chunk_num(buf) != 3) {
+		fprintf(stderr, "Wrong number of chunks %ld\n",
+			faux_buf_chunk_num(buf));
+		return -1;
+	}
+	// Creator can release its reference
+	faux_buf_seg_free(seg);
+
+	printf("faux_buf_read() shared data\n");
+	if (faux_buf_read(buf, res, len + 20) != (ssize_t)(len + 20)) {
+		fprintf(stderr, "faux_buf_read() error\n");
+		return -1;
+	}
+	if ((memcmp(res, "0123456789", 10) != 0) ||
+		(memcmp(res + 10, rnd, len) != 0) ||
+		(memcmp(res + 10 + len, "abcdefghij", 10) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+	if (faux_buf_chunk_num(buf) != 0) {
+		fprintf(stderr, "Buffer has chunks\n");
+		return -1;
+	}
+	// Segment is still used by another buffer
+	if (faux_buf_read(buf2, res, 15) != 15) {
+		fprintf(stderr, "faux_buf_read() error\n");
+		return -1;
+	}
+	if (faux_buf_read(buf2, res + 15, len) != (ssize_t)(len - 15)) {
+		fprintf(stderr, "faux_buf_read() error\n");
+		return -1;
+	}
+	if (memcmp(res, rnd, len) != 0) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+
+	faux_buf_free(buf);
+	faux_buf_free(buf2);
+	faux_free(res);
+	faux_free(rnd);
+
+	return 0;
+}
+
+
+int testc_faux_buf_adaptive(void)
+{
+	faux_buf_t *buf = NULL;
+	char *rnd = NULL;
+	char *res = NULL;
+	size_t len = CHUNK * 20;
+	size_t i = 0;
+
+	rnd = faux_testc_rnd_buf(len);
+	res = faux_malloc(len);
+
+	buf = faux_buf_new(CHUNK);
+	printf("faux_buf_set_chunk_policy() wrong args\n");
+	if (faux_buf_set_chunk_policy(buf, CHUNK, CHUNK * 2, CHUNK * 8)) {
+		fprintf(stderr, "faux_buf_set_chunk_policy() must fail\n");
+		return -1;
+	}
+	if (!faux_buf_set_chunk_policy(buf, CHUNK, CHUNK, CHUNK * 8)) {
+		fprintf(stderr, "faux_buf_set_chunk_policy() error\n");
+		return -1;
+	}
+
+	printf("Grow chunks\n");
+	// Data is accumulated within buffer
+	for (i = 0; i < len; i += 10)
+		faux_buf_write(buf, rnd + i, 10);
+	if (faux_buf_chunk_size(buf) != CHUNK * 8) {
+		fprintf(stderr, "Chunk size %ld\n", faux_buf_chunk_size(buf));
+		return -1;
+	}
+	if (faux_buf_chunk_num(buf) >= 20) {
+		fprintf(stderr, "Too many chunks %ld\n",
+			faux_buf_chunk_num(buf));
+		return -1;
+	}
+	faux_buf_read(buf, res, len);
+	if (memcmp(rnd, res, len) != 0) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+
+	printf("Shrink chunks\n");
+	// Small messages are read immediately
+	for (i = 0; i < 10; i++) {
+		faux_buf_write(buf, rnd, 10);
+		faux_buf_read(buf, res, 10);
+	}
+	if (faux_buf_chunk_size(buf) != CHUNK) {
+		fprintf(stderr, "Chunk size %ld\n", faux_buf_chunk_size(buf));
+		return -1;
+	}
+
+	faux_buf_free(buf);
+	faux_free(res);
+	faux_free(rnd);
+
+	return 0;
+}
+
+
+int testc_faux_buf_find(void)
+{
+	faux_buf_t *buf = NULL;
+	faux_buf_t *ring = NULL;
+	char *data = NULL;
+	size_t len = CHUNK * 3;
+
+	data = faux_zmalloc(len);
+	memset(data, 'a', len);
+	data[CHUNK - 2] = '\r'; // Sequence spans chunk boundary
+	data[CHUNK - 1] = '\n';
+	data[CHUNK] = 'x';
+	data[CHUNK * 2 + 10] = '\r';
+	data[CHUNK * 2 + 11] = '\n';
+
+	buf = faux_buf_new(CHUNK);
+	faux_buf_write(buf, "zz", 2);
+	faux_buf_write(buf, data, len);
+	// Unaligned read position
+	faux_buf_read(buf, data, 2);
+	ring = faux_buf_new_type(len, FAUX_BUF_RING);
+	// Ring's read position is not zero
+	faux_buf_write(ring, "abc", 3);
+	faux_buf_read(ring, data, 3);
+
+	printf("faux_buf_find_byte()\n");
+	if (faux_buf_find_byte(buf, 0, '\n') != CHUNK - 1) {
+		fprintf(stderr, "faux_buf_find_byte() error\n");
+		return -1;
+	}
+	if (faux_buf_find_byte(buf, CHUNK, '\n') != CHUNK * 2 + 11) {
+		fprintf(stderr, "faux_buf_find_byte() resume error\n");
+		return -1;
+	}
+	if (faux_buf_find_byte(buf, 0, 'q') >= 0) {
+		fprintf(stderr, "faux_buf_find_byte() must fail\n");
+		return -1;
+	}
+
+	printf("faux_buf_find_seq()\n");
+	if (faux_buf_find_seq(buf, 0, "\r\nx", 3) != CHUNK - 2) {
+		fprintf(stderr, "faux_buf_find_seq() error\n");
+		return -1;
+	}
+	if (faux_buf_find_seq(buf, CHUNK - 1, "\r\n", 2) != CHUNK * 2 + 10) {
+		fprintf(stderr, "faux_buf_find_seq() resume error\n");
+		return -1;
+	}
+	if (faux_buf_find_seq(buf, 0, "\n\n", 2) >= 0) {
+		fprintf(stderr, "faux_buf_find_seq() must fail\n");
+		return -1;
+	}
+
+	printf("faux_buf_find_seq() ring\n");
+	faux_buf_read(buf, data, len);
+	faux_buf_write(ring, data, len);
+	if (faux_buf_find_seq(ring, 0, "\r\nx", 3) != CHUNK - 2) {
+		fprintf(stderr, "faux_buf_find_seq() error\n");
+		return -1;
+	}
+
+	faux_buf_free(buf);
+	faux_buf_free(ring);
+	faux_free(data);
+
+	return 0;
+}
+
+
+int testc_faux_buf_peek(void)
+{
+	faux_buf_t *buf = NULL;
+	char *rnd = NULL;
+	char *res = NULL;
+	size_t len = CHUNK * 3;
+	char *p = NULL;
+
+	rnd = faux_testc_rnd_buf(len);
+	res = faux_malloc(len);
+
+	buf = faux_buf_new(CHUNK);
+	faux_buf_write(buf, rnd, len);
+
+	printf("faux_buf_peek()\n");
+	if (faux_buf_peek(buf, CHUNK - 5, res, 10) != 10) {
+		fprintf(stderr, "faux_buf_peek() error\n");
+		return -1;
+	}
+	if (memcmp(rnd + CHUNK - 5, res, 10) != 0) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+	if (faux_buf_peek(buf, len - 5, res, 10) != 5) {
+		fprintf(stderr, "faux_buf_peek() tail error\n");
+		return -1;
+	}
+	if (faux_buf_len(buf) != (ssize_t)len) {
+		fprintf(stderr, "Data is consumed\n");
+		return -1;
+	}
+
+	printf("faux_buf_linearize() within chunk\n");
+	faux_buf_read(buf, res, CHUNK - 5);
+	if (faux_buf_linearize(buf, 5) == NULL) {
+		fprintf(stderr, "faux_buf_linearize() error\n");
+		return -1;
+	}
+
+	printf("faux_buf_linearize() first chunk\n");
+	if (!(p = faux_buf_linearize(buf, 10)) ||
+		(memcmp(p, rnd + CHUNK - 5, 10) != 0)) {
+		fprintf(stderr, "faux_buf_linearize() error\n");
+		return -1;
+	}
+	if (faux_buf_chunk_num(buf) != 3) {
+		fprintf(stderr, "Wrong number of chunks %ld\n",
+			faux_buf_chunk_num(buf));
+		return -1;
+	}
+
+	printf("faux_buf_linearize() new memory\n");
+	if (!(p = faux_buf_linearize(buf, CHUNK * 2)) ||
+		(memcmp(p, rnd + CHUNK - 5, CHUNK * 2) != 0)) {
+		fprintf(stderr, "faux_buf_linearize() error\n");
+		return -1;
+	}
+	if (faux_buf_linearize(buf, len) != NULL) {
+		fprintf(stderr, "faux_buf_linearize() must fail\n");
+		return -1;
+	}
+
+	printf("faux_buf_linearize() the whole data\n");
+	if (!(p = faux_buf_linearize(buf, len - CHUNK + 5)) ||
+		(memcmp(p, rnd + CHUNK - 5, len - CHUNK + 5) != 0)) {
+		fprintf(stderr, "faux_buf_linearize() error\n");
+		return -1;
+	}
+	if (faux_buf_chunk_num(buf) != 1) {
+		fprintf(stderr, "Wrong number of chunks %ld\n",
+			faux_buf_chunk_num(buf));
+		return -1;
+	}
+	// Buffer is still usable
+	faux_buf_write(buf, rnd, 10);
+	if (faux_buf_read(buf, res, len) != (ssize_t)(len - CHUNK + 5 + 10)) {
+		fprintf(stderr, "faux_buf_read() error\n");
+		return -1;
+	}
+	if ((memcmp(res, rnd + CHUNK - 5, len - CHUNK + 5) != 0) ||
+		(memcmp(res + len - CHUNK + 5, rnd, 10) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+
+	faux_buf_free(buf);
+	faux_free(res);
+	faux_free(rnd);
+
+	return 0;
+}
+
+
+int testc_faux_buf_chunks(void)
+{
+	faux_buf_t *buf = NULL;
+	unsigned char t[1000] = {};
+	unsigned char valw = 0;
+	unsigned char valr = 0;
+	unsigned int n = 0;
+	ssize_t res = 0;
+	ssize_t i = 0;
+
+	buf = faux_buf_new(CHUNK);
+	if (!buf) {
+		fprintf(stderr, "faux_buf_new() error\n");
+		return -1;
+	}
+
+	// Write more than read. So chunk array grows and its head goes
+	// around the array.
+	printf("faux_buf_write() and faux_buf_read()\n");
+	for (n = 0; n < 100; n++) {
+		for (i = 0; i < 1000; i++)
+			t[i] = valw++;
+		if ((res = faux_buf_write(buf, t, 1000)) != 1000) {
+			fprintf(stderr, "faux_buf_write() error %ld\n", res);
+			return -1;
+		}
+		if ((res = faux_buf_read(buf, t, 950)) != 950) {
+			fprintf(stderr, "faux_buf_read() error %ld\n", res);
+			return -1;
+		}
+		for (i = 0; i < res; i++) {
+			if (t[i] != valr++) {
+				fprintf(stderr, "Incorrect data\n");
+				return -1;
+			}
+		}
+	}
+
+	printf("faux_buf_chunk_num()\n");
+	if (faux_buf_chunk_num(buf) != 50) {
+		fprintf(stderr, "faux_buf_chunk_num() error %ld\n",
+			faux_buf_chunk_num(buf));
+		return -1;
+	}
+
+	printf("faux_buf_read()\n");
+	while ((res = faux_buf_read(buf, t, 333)) > 0) {
+		for (i = 0; i < res; i++) {
+			if (t[i] != valr++) {
+				fprintf(stderr, "Incorrect data\n");
+				return -1;
+			}
+		}
+	}
+	if ((faux_buf_len(buf) != 0) || (valr != valw) ||
+		(faux_buf_chunk_num(buf) != 0)) {
+		fprintf(stderr, "Buffer is not empty\n");
+		return -1;
+	}
+
+	faux_buf_free(buf);
+
+	return 0;
+}
+
+
+static void budget_cb(faux_buf_budget_t *budget, bool_t high, void *user_data)
+{
+	int *state = (int *)user_data;
+
+	*state = high ? 1 : 0;
+	budget = budget; // Happy compiler
+}
+
+
+int testc_faux_buf_budget(void)
+{
+	faux_buf_budget_t *budget = NULL;
+	faux_buf_t *buf = NULL;
+	faux_buf_t *buf2 = NULL;
+	faux_buf_cache_stat_t stat = {};
+	char t[1000] = {};
+	int state = -1;
+
+	budget = faux_buf_budget_new();
+	faux_buf_budget_set_watermarks(budget, 1000, 500);
+	faux_buf_budget_set_limit(budget, 1500);
+	faux_buf_budget_set_cb(budget, budget_cb, &state);
+	buf = faux_buf_new(CHUNK);
+	buf2 = faux_buf_new(CHUNK);
+	faux_buf_set_cache_limit(buf2, 10 * CHUNK);
+	faux_buf_write(buf, t, 300);
+	faux_buf_set_budget(buf, budget);
+	faux_buf_set_budget(buf2, budget);
+
+	printf("Below high watermark\n");
+	faux_buf_write(buf2, t, 500);
+	faux_buf_read(buf2, t, 300);
+	faux_buf_write(buf, t, 300);
+	faux_buf_cache_stat(buf2, &stat);
+	if ((faux_buf_budget_len(budget) != 800) || (state != -1) ||
+		(stat.retained != (3 * CHUNK))) {
+		fprintf(stderr, "Wrong state: len=%ld state=%d retained=%lu\n",
+			faux_buf_budget_len(budget), state, stat.retained);
+		return -1;
+	}
+
+	printf("High watermark\n");
+	faux_buf_write(buf2, t, 200);
+	faux_buf_cache_stat(buf2, &stat);
+	if (!faux_buf_budget_is_high(budget) || (state != 1) ||
+		(stat.retained != 0)) {
+		fprintf(stderr, "High watermark is not reached\n");
+		return -1;
+	}
+
+	printf("Hard limit\n");
+	if (faux_buf_write(buf, t, 600) >= 0) {
+		fprintf(stderr, "Budget limit is not checked\n");
+		return -1;
+	}
+
+	printf("Low watermark\n");
+	faux_buf_read(buf, t, 400);
+	if (state != 1) {
+		fprintf(stderr, "Low watermark is reached too early\n");
+		return -1;
+	}
+	faux_buf_read(buf, t, 100);
+	if (faux_buf_budget_is_high(budget) || (state != 0)) {
+		fprintf(stderr, "Low watermark is not reached\n");
+		return -1;
+	}
+
+	printf("Detach\n");
+	faux_buf_free(buf2);
+	if (faux_buf_budget_len(budget) != 100) {
+		fprintf(stderr, "Wrong budget length %ld\n",
+			faux_buf_budget_len(budget));
+		return -1;
+	}
+	faux_buf_budget_free(budget);
+	if (faux_buf_write(buf, t, 1000) != 1000) {
+		fprintf(stderr, "Buffer is not detached\n");
+		return -1;
+	}
+	faux_buf_free(buf);
+
+	return 0;
+}
+
+
+int testc_faux_buf_printf(void)
+{
+	faux_buf_t *buf = NULL;
+	char *e = NULL;
+	char *long_str = NULL;
+	char t[1000] = {};
+	ssize_t len = 0;
+	unsigned int i = 0;
+
+	buf = faux_buf_new(CHUNK);
+	long_str = faux_testc_rnd_buf(300);
+	for (i = 0; i < 300; i++)
+		long_str[i] = 'a' + ((unsigned char)long_str[i] % 26);
+	long_str[299] = '\0';
+
+	// Formatted within single chunk
+	printf("faux_buf_printf()\n");
+	for (i = 0; i < 8; i++) {
+		if (faux_buf_printf(buf, "line %u: %s\n", i, "text") != 13) {
+			fprintf(stderr, "faux_buf_printf() error\n");
+			return -1;
+		}
+	}
+	if (faux_buf_chunk_num(buf) != 2) {
+		fprintf(stderr, "Wrong number of chunks %ld\n",
+			faux_buf_chunk_num(buf));
+		return -1;
+	}
+
+	// Spill
+	printf("faux_buf_printf() spill\n");
+	if (faux_buf_printf(buf, "<%s>", long_str) != 301) {
+		fprintf(stderr, "faux_buf_printf() error\n");
+		return -1;
+	}
+
+	e = faux_str_sprintf("line 0: text\nline 1: text\nline 2: text\n"
+		"line 3: text\nline 4: text\nline 5: text\nline 6: text\n"
+		"line 7: text\n<%s>", long_str);
+	len = strlen(e);
+	if ((faux_buf_len(buf) != len) ||
+		(faux_buf_read(buf, t, sizeof(t)) != len) ||
+		(memcmp(t, e, len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+	faux_str_free(e);
+
+	// Limit
+	printf("faux_buf_printf() with limit\n");
+	faux_buf_set_limit(buf, 10);
+	if ((faux_buf_printf(buf, "%s", "12345") != 5) ||
+		(faux_buf_printf(buf, "%s", "123456") >= 0) ||
+		(faux_buf_len(buf) != 5)) {
+		fprintf(stderr, "Limit is not checked\n");
+		return -1;
+	}
+
+	faux_free(long_str);
+	faux_buf_free(buf);
+
+	return 0;
+}
+
+
+static void release_cb(void *user_data)
+{
+	int *released = (int *)user_data;
+
+	(*released)++;
+}
+
+
+int testc_faux_buf_ref(void)
+{
+	faux_buf_t *buf = NULL;
+	char d1[] = "0123456789";
+	char d2[] = "abcdefghij";
+	struct iovec iov[2] = {};
+	char t[100] = {};
+	int released = 0;
+
+	buf = faux_buf_new(CHUNK);
+	iov[0].iov_base = d1;
+	iov[0].iov_len = 10;
+	iov[1].iov_base = d2;
+	iov[1].iov_len = 10;
+
+	printf("faux_buf_append_ref()\n");
+	faux_buf_write(buf, "<", 1);
+	if (faux_buf_append_ref(buf, iov, 2, release_cb, &released) != 20) {
+		fprintf(stderr, "faux_buf_append_ref() error\n");
+		return -1;
+	}
+	faux_buf_write(buf, ">", 1);
+	// Data is referenced. Not copied
+	d2[0] = 'A';
+
+	printf("faux_buf_read()\n");
+	if ((faux_buf_read(buf, t, 15) != 15) || (released != 0)) {
+		fprintf(stderr, "Segment is released too early\n");
+		return -1;
+	}
+	if ((faux_buf_read(buf, t + 15, 10) != 7) || (released != 1)) {
+		fprintf(stderr, "Segment is not released\n");
+		return -1;
+	}
+	if (memcmp(t, "<0123456789Abcdefghij>", 22) != 0) {
+		fprintf(stderr, "Data is broken\n");
+		return -1;
+	}
+
+	printf("faux_buf_empty()\n");
+	faux_buf_append_ref(buf, iov, 2, release_cb, &released);
+	faux_buf_empty(buf);
+	if (released != 2) {
+		fprintf(stderr, "Segment is not released\n");
+		return -1;
+	}
+
+	faux_buf_free(buf);
+
+	return 0;
+}
+
+
+int testc_faux_buf_pin(void)
+{
+	faux_buf_t *buf = NULL;
+	char src[CHUNK * 3] = {};
+	faux_buf_cache_stat_t stat = {};
+	struct iovec iov[4] = {};
+	size_t iov_num = 4;
+
+	buf = faux_buf_new(CHUNK);
+	faux_buf_set_cache_limit(buf, CHUNK * 10);
+	faux_buf_write(buf, src, sizeof(src));
+
+	printf("faux_buf_dread_unlock_pin()\n");
+	if ((faux_buf_dread_lock_iov(buf, CHUNK * 2 + 50, iov, &iov_num) !=
+		CHUNK * 2 + 50) ||
+		(faux_buf_dread_unlock_pin(buf, CHUNK * 2 + 50, NULL, 1) !=
+		CHUNK * 2 + 50)) {
+		fprintf(stderr, "faux_buf_dread_unlock_pin() error\n");
+		return -1;
+	}
+	iov_num = 4;
+	if ((faux_buf_dread_lock_iov(buf, 50, iov, &iov_num) != 50) ||
+		(faux_buf_dread_unlock_pin(buf, 50, NULL, 2) != 50)) {
+		fprintf(stderr, "faux_buf_dread_unlock_pin() error\n");
+		return -1;
+	}
+	// Chunks are released but not reused
+	faux_buf_cache_stat(buf, &stat);
+	if ((faux_buf_len(buf) != 0) || (stat.retained != 0)) {
+		fprintf(stderr, "Pinned chunks are released\n");
+		return -1;
+	}
+
+	printf("faux_buf_unpin()\n");
+	faux_buf_unpin(buf, 1);
+	faux_buf_cache_stat(buf, &stat);
+	if (stat.retained != CHUNK * 2) {
+		fprintf(stderr, "Wrong unpinned size %lu\n", stat.retained);
+		return -1;
+	}
+	faux_buf_unpin(buf, 2);
+	faux_buf_cache_stat(buf, &stat);
+	if (stat.retained != CHUNK * 3) {
+		fprintf(stderr, "Wrong unpinned size %lu\n", stat.retained);
+		return -1;
+	}
+
+	// Pinned chunks are freed with buffer
+	faux_buf_write(buf, src, sizeof(src));
+	iov_num = 4;
+	faux_buf_dread_lock_iov(buf, sizeof(src), iov, &iov_num);
+	faux_buf_dread_unlock_pin(buf, sizeof(src), NULL, 3);
+	faux_buf_free(buf);
+
+	return 0;
+}
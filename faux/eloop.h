@@ -7,6 +7,7 @@
 
 #include <poll.h>
 #include <signal.h>
+#include <sys/uio.h>
 
 #include <faux/faux.h>
 #include <faux/sched.h>
@@ -17,9 +18,26 @@ typedef enum {
 	FAUX_ELOOP_NULL = 0,
 	FAUX_ELOOP_SIGNAL = 1,
 	FAUX_ELOOP_SCHED = 2,
-	FAUX_ELOOP_FD = 3
+	FAUX_ELOOP_FD = 3,
+	FAUX_ELOOP_IO = 4,
+	FAUX_ELOOP_DEFERRED = 5
 } faux_eloop_type_e;
 
+// Mechanism to wait for events
+typedef enum {
+	FAUX_ELOOP_BACKEND_POLL = 0, // ppoll()
+	FAUX_ELOOP_BACKEND_URING = 1, // io_uring
+	FAUX_ELOOP_BACKEND_EPOLL = 2 // epoll
+} faux_eloop_backend_e;
+
+// Completion operations (io_uring backend only)
+typedef enum {
+	FAUX_ELOOP_IO_READ = 0,
+	FAUX_ELOOP_IO_WRITEV = 1,
+	FAUX_ELOOP_IO_RECV = 2, // Multishot receive to provided buffers
+	FAUX_ELOOP_IO_ACCEPT = 3 // Multishot accept
+} faux_eloop_io_e;
+
 typedef struct {
 	int ev_id;
 	faux_ev_t *ev;
@@ -34,6 +52,14 @@ typedef struct {
 	int signo;
 } faux_eloop_info_signal_t;
 
+typedef struct {
+	int fd;
+	faux_eloop_io_e op;
+	ssize_t res; // Length of data, accepted fd or -errno
+	void *data; // Received data for FAUX_ELOOP_IO_RECV
+	bool_t more; // Multishot operation is still active
+} faux_eloop_info_io_t;
+
 // Callback function prototype
 typedef bool_t (*faux_eloop_cb_fn)(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
@@ -44,6 +70,9 @@ C_DECL_BEGIN
 faux_eloop_t *faux_eloop_new(faux_eloop_cb_fn default_event_cb);
 void faux_eloop_free(faux_eloop_t *eloop);
 bool_t faux_eloop_loop(faux_eloop_t *eloop);
+bool_t faux_eloop_set_backend(faux_eloop_t *eloop,
+	faux_eloop_backend_e backend);
+faux_eloop_backend_e faux_eloop_backend(const faux_eloop_t *eloop);
 
 bool_t faux_eloop_add_fd(faux_eloop_t *eloop, int fd, short events,
 	faux_eloop_cb_fn event_cb, void *user_data);
@@ -68,9 +97,24 @@ faux_ev_t *faux_eloop_add_sched_periodic_delayed(faux_eloop_t *eloop,
 ssize_t faux_eloop_del_sched(faux_eloop_t *eloop, faux_ev_t *ev);
 ssize_t faux_eloop_del_sched_by_id(faux_eloop_t *eloop, int ev_id);
 bool_t faux_eloop_del_sched_all(faux_eloop_t *eloop);
+bool_t faux_eloop_add_deferred(faux_eloop_t *eloop,
+	faux_eloop_cb_fn event_cb, void *user_data);
+bool_t faux_eloop_del_deferred(faux_eloop_t *eloop,
+	faux_eloop_cb_fn event_cb, void *user_data);
 bool_t faux_eloop_include_fd_event(faux_eloop_t *eloop, int fd, short event);
 bool_t faux_eloop_exclude_fd_event(faux_eloop_t *eloop, int fd, short event);
 
+bool_t faux_eloop_io_read(faux_eloop_t *eloop, int fd, void *data, size_t len,
+	faux_eloop_cb_fn event_cb, void *user_data);
+bool_t faux_eloop_io_writev(faux_eloop_t *eloop, int fd,
+	const struct iovec *iov, int iovcnt,
+	faux_eloop_cb_fn event_cb, void *user_data);
+bool_t faux_eloop_io_recv(faux_eloop_t *eloop, int fd,
+	faux_eloop_cb_fn event_cb, void *user_data);
+bool_t faux_eloop_io_accept(faux_eloop_t *eloop, int fd,
+	faux_eloop_cb_fn event_cb, void *user_data);
+bool_t faux_eloop_io_cancel(faux_eloop_t *eloop, int fd);
+
 C_DECL_END
 
 #endif
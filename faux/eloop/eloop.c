@@ -10,6 +10,24 @@
  * of signal for signals, file descriptor and type of file event for file
  * descriptor events, event ID and pointer to special event object for scheduled
  * time events.
+ *
+ * Event loop uses ppoll() to wait for events by default. The io_uring backend
+ * can be chosen by faux_eloop_set_backend() if library is built with it. The
+ * io_uring backend serves the same fd events and additionally allows to post
+ * completion operations (faux_eloop_io_*() functions). Completion operation
+ * does I/O within kernel and callback gets result. So there is no separate
+ * syscall for each read or write.
+ *
+ * The epoll backend (FAUX_ELOOP_BACKEND_EPOLL) keeps fd registrations within
+ * kernel. So the cost of iteration depends on the number of ready fds but not
+ * on the total number of registered fds. It's useful for servers with a lot
+ * of connections. Registered fds are indexed by fd value so registration and
+ * event delivery don't search through the list of fds.
+ *
+ * Deferred callbacks (faux_eloop_add_deferred()) are executed once at the end
+ * of loop iteration, i.e. after all events of iteration are processed and
+ * before loop waits for new events. It allows to gather work generated by
+ * many events, for example to flush output buffers by single write.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -23,6 +41,7 @@
 #include <assert.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -41,6 +60,25 @@
 
 #define TIMESPEC_TO_MILISECONDS(t) ((t.tv_sec * 1000) + (t.tv_nsec / 1000000l))
 
+#ifdef WITH_IO_URING
+// The "user_data" of io_uring request. The completion operations use pointer
+// to faux_eloop_io_t object (aligned so two low bits are zero). Poll requests
+// use tag, fd and generation of request.
+#define URING_TAG_IO 0
+#define URING_TAG_FD 1
+#define URING_TAG_SIGNAL 2
+#define URING_TAG_IGNORE 3
+#define URING_TAG_MASK 3
+#define URING_GEN_MASK 0x3fffffff
+#define URING_DATA(tag, gen, fd) ((((uint64_t)(gen) & URING_GEN_MASK) << 34) | \
+	((uint64_t)(uint32_t)(fd) << 2) | (tag))
+#define URING_DATA_TAG(data) ((data) & URING_TAG_MASK)
+#define URING_DATA_FD(data) ((int)(uint32_t)((data) >> 2))
+#define URING_DATA_GEN(data) ((unsigned int)((data) >> 34) & URING_GEN_MASK)
+
+static void faux_eloop_uring_cancel(faux_eloop_t *eloop, int fd);
+#endif
+
 #ifdef HAVE_SIGNALFD
 #define SIGNALFD_FLAGS (SFD_NONBLOCK | SFD_CLOEXEC)
 
@@ -70,25 +108,54 @@ static void faux_eloop_static_sighandler(int signo)
 #endif
 
 
-/** @brief Callback compare function for fd list.
+/** @brief Finds registered fd entry.
+ *
+ * Static service function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] fd File descriptor.
+ * @return Entry or NULL if fd is not registered.
  */
-static int faux_eloop_fd_compare(const void *first, const void *second)
+static faux_eloop_fd_t *faux_eloop_fd_find(const faux_eloop_t *eloop, int fd)
 {
-	const faux_eloop_fd_t *f = (const faux_eloop_fd_t *)first;
-	const faux_eloop_fd_t *s = (const faux_eloop_fd_t *)second;
+	if ((fd < 0) || ((size_t)fd >= eloop->fd_map_len))
+		return NULL;
 
-	return (f->fd - s->fd);
+	return eloop->fd_map[fd];
 }
 
 
-/** @brief Callback compare function for fd list to search by key.
+/** @brief Sets entry of fd map.
+ *
+ * Static service function. Map grows if fd doesn't fit into it.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] fd File descriptor.
+ * @param [in] entry Entry or NULL to remove.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
  */
-static int faux_eloop_fd_kcompare(const void *key, const void *list_item)
+static bool_t faux_eloop_fd_map_set(faux_eloop_t *eloop, int fd,
+	faux_eloop_fd_t *entry)
 {
-	int *f = (int *)key;
-	const faux_eloop_fd_t *s = (const faux_eloop_fd_t *)list_item;
+	if ((size_t)fd >= eloop->fd_map_len) {
+		size_t len = eloop->fd_map_len ? eloop->fd_map_len : 64;
+		faux_eloop_fd_t **map = NULL;
+
+		if (!entry)
+			return BOOL_TRUE;
+		while (len <= (size_t)fd)
+			len *= 2;
+		map = realloc(eloop->fd_map, len * sizeof(*map));
+		if (!map)
+			return BOOL_FALSE;
+		memset(map + eloop->fd_map_len, 0,
+			(len - eloop->fd_map_len) * sizeof(*map));
+		eloop->fd_map = map;
+		eloop->fd_map_len = len;
+	}
+	eloop->fd_map[fd] = entry;
 
-	return (*f - s->fd);
+	return BOOL_TRUE;
 }
 
 
@@ -140,9 +207,11 @@ faux_eloop_t *faux_eloop_new(faux_eloop_cb_fn default_event_cb)
 	assert(eloop->sched);
 
 	// FD
-	eloop->fds = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
-		faux_eloop_fd_compare, faux_eloop_fd_kcompare, faux_free);
+	eloop->fds = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, faux_free);
 	assert(eloop->fds);
+	eloop->fd_map = NULL;
+	eloop->fd_map_len = 0;
 	eloop->pollfds = faux_pollfd_new();
 	assert(eloop->pollfds);
 
@@ -156,26 +225,805 @@ faux_eloop_t *faux_eloop_new(faux_eloop_cb_fn default_event_cb)
 	eloop->signal_fd = -1;
 #endif
 
+	// Deferred
+	eloop->deferred = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, faux_free);
+	assert(eloop->deferred);
+
+	// Backend
+	eloop->backend = FAUX_ELOOP_BACKEND_POLL;
+#ifdef WITH_IO_URING
+	eloop->uring = NULL;
+	eloop->signal_gen = 0;
+	eloop->ios = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, NULL);
+	assert(eloop->ios);
+	eloop->cqes = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, faux_free);
+	assert(eloop->cqes);
+#endif
+#ifdef WITH_EPOLL
+	eloop->epoll_fd = -1;
+	eloop->epoll_events = NULL;
+#endif
+
 	return eloop;
 }
 
 
-/** @brief Free event loop object.
- *
- * @param [in] Event loop object.
- */
-void faux_eloop_free(faux_eloop_t *eloop)
-{
-	if (!eloop)
-		return;
+/** @brief Free event loop object.
+ *
+ * @param [in] Event loop object.
+ */
+void faux_eloop_free(faux_eloop_t *eloop)
+{
+	if (!eloop)
+		return;
+
+	// Callbacks get -ECANCELED for operations in progress
+	faux_eloop_set_backend(eloop, FAUX_ELOOP_BACKEND_POLL);
+#ifdef WITH_IO_URING
+	faux_list_free(eloop->cqes);
+	faux_list_free(eloop->ios);
+#endif
+	faux_list_free(eloop->deferred);
+	faux_list_free(eloop->signals);
+	faux_pollfd_free(eloop->pollfds);
+	faux_list_free(eloop->fds);
+	faux_free(eloop->fd_map);
+	faux_sched_free(eloop->sched);
+
+	faux_free(eloop);
+}
+
+
+/** @brief Executes callbacks for scheduled events.
+ *
+ * Static service function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @return BOOL_FALSE if some callback wants to break the loop.
+ */
+static bool_t faux_eloop_process_sched(faux_eloop_t *eloop)
+{
+	faux_ev_t *ev = NULL;
+	bool_t retval = BOOL_TRUE;
+
+	// Some scheduled events
+	while((ev = faux_sched_pop(eloop->sched))) {
+		faux_eloop_info_sched_t info = {};
+		bool_t r = BOOL_TRUE;
+		int ev_id = faux_ev_id(ev);
+		faux_eloop_context_t *context =
+			(faux_eloop_context_t *)faux_ev_data(ev);
+		faux_eloop_cb_fn event_cb = context->event_cb;
+		void *user_data = context->user_data;
+
+		if (!faux_ev_is_busy(ev)) {
+			faux_ev_free(ev);
+			ev = NULL;
+		}
+		if (!event_cb)
+			event_cb = eloop->default_event_cb;
+		if (!event_cb) // Callback is not defined
+			continue;
+		info.ev_id = ev_id;
+		// Callback will get only rescheduled event object.
+		// If event is not scheduled, callback will get NULL.
+		info.ev = ev;
+		// Execute callback
+		r = event_cb(eloop, FAUX_ELOOP_SCHED, &info, user_data);
+		// BOOL_FALSE return value means "break the loop"
+		if (!r)
+			retval = BOOL_FALSE;
+	}
+
+	return retval;
+}
+
+
+/** @brief Executes callback for signal.
+ *
+ * Static service function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] signo Signal number.
+ * @return BOOL_FALSE if callback wants to break the loop.
+ */
+static bool_t faux_eloop_process_signal(faux_eloop_t *eloop, int signo)
+{
+	faux_eloop_info_signal_t sinfo = {};
+	faux_eloop_cb_fn event_cb = NULL;
+	faux_eloop_signal_t *sentry =
+		(faux_eloop_signal_t *)faux_list_kfind(eloop->signals, &signo);
+
+	if (!sentry) // Not registered signal. Drop it.
+		return BOOL_TRUE;
+	event_cb = sentry->context.event_cb;
+	if (!event_cb)
+		event_cb = eloop->default_event_cb;
+	if (!event_cb) // Callback is not defined
+		return BOOL_TRUE;
+	sinfo.signo = signo;
+
+	// Execute callback
+	return event_cb(eloop, FAUX_ELOOP_SIGNAL, &sinfo,
+		sentry->context.user_data);
+}
+
+
+/** @brief Executes callback for file descriptor event.
+ *
+ * Static service function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] fd File descriptor.
+ * @param [in] revents Returned events.
+ * @return BOOL_FALSE if callback wants to break the loop.
+ */
+static bool_t faux_eloop_process_fd(faux_eloop_t *eloop, int fd, short revents)
+{
+	faux_eloop_info_fd_t info = {};
+	faux_eloop_cb_fn event_cb = NULL;
+	faux_eloop_fd_t *entry = NULL;
+
+	entry = faux_eloop_fd_find(eloop, fd);
+	assert(entry);
+	if (!entry) // Something went wrong
+		return BOOL_TRUE;
+	event_cb = entry->context.event_cb;
+	if (!event_cb)
+		event_cb = eloop->default_event_cb;
+	if (!event_cb) // Callback function is not defined for this event
+		return BOOL_TRUE;
+	info.fd = fd;
+	info.revents = revents;
+
+	// Execute callback
+	return event_cb(eloop, FAUX_ELOOP_FD, &info, entry->context.user_data);
+}
+
+
+/** @brief Executes deferred callbacks.
+ *
+ * Static service function. Each callback is executed once and unregistered.
+ * Callbacks registered by deferred callbacks are executed on the next
+ * iteration. So loop can't stick here.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @return BOOL_FALSE if some callback wants to break the loop.
+ */
+static bool_t faux_eloop_process_deferred(faux_eloop_t *eloop)
+{
+	bool_t retval = BOOL_TRUE;
+	size_t num = faux_list_len(eloop->deferred);
+	faux_list_node_t *node = NULL;
+
+	while ((num-- > 0) && (node = faux_list_head(eloop->deferred))) {
+		faux_eloop_context_t *context = (faux_eloop_context_t *)
+			faux_list_takeaway(eloop->deferred, node);
+		faux_eloop_cb_fn event_cb = context->event_cb;
+		void *user_data = context->user_data;
+
+		faux_free(context);
+		if (!event_cb)
+			event_cb = eloop->default_event_cb;
+		if (!event_cb) // Callback is not defined
+			continue;
+		// BOOL_FALSE return value means "break the loop"
+		if (!event_cb(eloop, FAUX_ELOOP_DEFERRED, NULL, user_data))
+			retval = BOOL_FALSE;
+	}
+
+	return retval;
+}
+
+
+/** @brief Frees completion operation.
+ *
+ * Static service function. Operation is removed from list of operations in
+ * progress.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] io Operation.
+ */
+static void faux_eloop_io_free(faux_eloop_t *eloop, faux_eloop_io_t *io)
+{
+#ifdef WITH_IO_URING
+	faux_list_del(eloop->ios, io->node);
+#else
+	eloop = eloop; // Happy compiler
+#endif
+	faux_free(io->iov);
+	faux_free(io);
+}
+
+
+#ifdef WITH_IO_URING
+/** @brief Posts poll request for registered fd.
+ *
+ * Static service function. Single-shot poll request is used and it's posted
+ * again after callback. So fd events are level-triggered like ppoll() ones.
+ * Multishot poll is edge-triggered and callback that doesn't consume all data
+ * would never be called again.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] entry Registered fd.
+ */
+static void faux_eloop_uring_arm(faux_eloop_t *eloop, faux_eloop_fd_t *entry)
+{
+	struct io_uring_sqe *sqe = NULL;
+	unsigned int events = 0;
+
+	if (!eloop->uring || entry->armed || (0 == entry->events))
+		return;
+	sqe = faux_uring_get_sqe(eloop->uring);
+	if (!sqe)
+		return;
+	events = (unsigned short)entry->events;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	events = (events << 16) | (events >> 16);
+#endif
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = entry->fd;
+	sqe->poll32_events = events;
+	sqe->user_data = URING_DATA(URING_TAG_FD, entry->gen, entry->fd);
+	entry->armed = BOOL_TRUE;
+}
+
+
+/** @brief Removes poll request for registered fd.
+ *
+ * Static service function. Generation of request is changed so completion of
+ * removed request will be ignored.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] entry Registered fd.
+ */
+static void faux_eloop_uring_disarm(faux_eloop_t *eloop, faux_eloop_fd_t *entry)
+{
+	struct io_uring_sqe *sqe = NULL;
+
+	if (!eloop->uring || !entry->armed)
+		return;
+	sqe = faux_uring_get_sqe(eloop->uring);
+	if (sqe) {
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = URING_DATA(URING_TAG_FD, entry->gen, entry->fd);
+		sqe->user_data = URING_DATA(URING_TAG_IGNORE, 0, 0);
+	}
+	entry->armed = BOOL_FALSE;
+	entry->gen = (entry->gen + 1) & URING_GEN_MASK;
+}
+
+
+/** @brief Posts poll request for signalfd.
+ *
+ * Static service function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ */
+static void faux_eloop_uring_arm_signal(faux_eloop_t *eloop)
+{
+	struct io_uring_sqe *sqe = NULL;
+
+	sqe = faux_uring_get_sqe(eloop->uring);
+	if (!sqe)
+		return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = eloop->signal_fd;
+	sqe->poll32_events = POLLIN;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	sqe->poll32_events = POLLIN << 16;
+#endif
+	sqe->user_data = URING_DATA(URING_TAG_SIGNAL, eloop->signal_gen,
+		eloop->signal_fd);
+}
+
+
+/** @brief Posts completion operation.
+ *
+ * Static service function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] io Operation.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+static bool_t faux_eloop_uring_submit(faux_eloop_t *eloop, faux_eloop_io_t *io)
+{
+	struct io_uring_sqe *sqe = NULL;
+
+	sqe = faux_uring_get_sqe(eloop->uring);
+	if (!sqe)
+		return BOOL_FALSE;
+	sqe->fd = io->fd;
+	sqe->user_data = (uintptr_t)io;
+	switch (io->op) {
+	case FAUX_ELOOP_IO_READ:
+		sqe->opcode = IORING_OP_READ;
+		sqe->addr = (uintptr_t)io->data;
+		sqe->len = io->len;
+		sqe->off = (uint64_t)-1; // Current file position
+		break;
+	case FAUX_ELOOP_IO_WRITEV:
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->addr = (uintptr_t)io->iov;
+		sqe->len = io->iovcnt;
+		sqe->off = (uint64_t)-1; // Current file position
+		break;
+	case FAUX_ELOOP_IO_RECV:
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = FAUX_URING_BGID;
+		break;
+	case FAUX_ELOOP_IO_ACCEPT:
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		break;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Processes completion of operation.
+ *
+ * Static service function. Operation is freed on final completion.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] cqe Completion entry.
+ * @return BOOL_FALSE if callback wants to break the loop.
+ */
+static bool_t faux_eloop_uring_io(faux_eloop_t *eloop,
+	const struct io_uring_cqe *cqe)
+{
+	faux_eloop_io_t *io = (faux_eloop_io_t *)(uintptr_t)cqe->user_data;
+	faux_eloop_info_io_t info = {};
+	faux_eloop_context_t context = io->context;
+	faux_eloop_cb_fn event_cb = NULL;
+	bool_t has_buf = (cqe->flags & IORING_CQE_F_BUFFER) ?
+		BOOL_TRUE : BOOL_FALSE;
+	unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	bool_t r = BOOL_TRUE;
+
+	info.fd = io->fd;
+	info.op = io->op;
+	info.res = cqe->res;
+	info.more = (cqe->flags & IORING_CQE_F_MORE) ? BOOL_TRUE : BOOL_FALSE;
+	if (has_buf)
+		info.data = faux_uring_buf(eloop->uring, bid);
+
+	// Multishot receive stops when all provided buffers are busy. Buffers
+	// are returned after callbacks so restart it silently.
+	if (!info.more && !io->cancel && (FAUX_ELOOP_IO_RECV == io->op) &&
+		(-ENOBUFS == cqe->res) && faux_eloop_uring_submit(eloop, io))
+		return BOOL_TRUE;
+
+	if (!info.more)
+		faux_eloop_io_free(eloop, io);
+
+	event_cb = context.event_cb;
+	if (!event_cb)
+		event_cb = eloop->default_event_cb;
+	if (event_cb)
+		r = event_cb(eloop, FAUX_ELOOP_IO, &info, context.user_data);
+	if (has_buf)
+		faux_uring_put_buf(eloop->uring, bid);
+
+	return r;
+}
+
+
+/** @brief Checks if completion belongs to operation that is being canceled.
+ *
+ * Static service function.
+ *
+ * @param [in] cqe Completion entry.
+ * @return BOOL_TRUE - operation is being canceled, BOOL_FALSE - otherwise.
+ */
+static bool_t faux_eloop_uring_is_canceled(const struct io_uring_cqe *cqe)
+{
+	if (URING_DATA_TAG(cqe->user_data) != URING_TAG_IO)
+		return BOOL_FALSE;
+
+	return ((faux_eloop_io_t *)(uintptr_t)cqe->user_data)->cancel;
+}
+
+
+/** @brief Checks if some operations are still being canceled.
+ *
+ * Static service function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @return BOOL_TRUE - there are operations to wait for, BOOL_FALSE - otherwise.
+ */
+static bool_t faux_eloop_uring_canceling(faux_eloop_t *eloop)
+{
+	faux_list_node_t *iter = faux_list_head(eloop->ios);
+	faux_eloop_io_t *io = NULL;
+
+	while ((io = (faux_eloop_io_t *)faux_list_each(&iter))) {
+		if (io->cancel)
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+/** @brief Cancels completion operations and waits for their completions.
+ *
+ * Static service function. Callbacks get final results of operations. It's
+ * -ECANCELED usually but operation can be completed before cancellation.
+ * Other completions received while waiting are postponed.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] fd Cancel operations for this fd only. The "-1" means all.
+ */
+static void faux_eloop_uring_cancel(faux_eloop_t *eloop, int fd)
+{
+	faux_list_node_t *iter = NULL;
+	faux_list_node_t *node = NULL;
+	faux_eloop_io_t *io = NULL;
+
+	if (!eloop->uring)
+		return;
+
+	iter = faux_list_head(eloop->ios);
+	while ((io = (faux_eloop_io_t *)faux_list_each(&iter))) {
+		struct io_uring_sqe *sqe = NULL;
+
+		if (io->cancel || ((fd >= 0) && (io->fd != fd)))
+			continue;
+		io->cancel = BOOL_TRUE;
+		sqe = faux_uring_get_sqe(eloop->uring);
+		if (!sqe)
+			continue;
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = (uintptr_t)io;
+		sqe->user_data = URING_DATA(URING_TAG_IGNORE, 0, 0);
+	}
+
+	// Postponed completions
+	iter = faux_list_head(eloop->cqes);
+	while ((node = iter)) {
+		struct io_uring_cqe *cqe =
+			(struct io_uring_cqe *)faux_list_data(node);
+
+		iter = faux_list_next_node(node);
+		if (!faux_eloop_uring_is_canceled(cqe))
+			continue;
+		faux_list_takeaway(eloop->cqes, node);
+		faux_eloop_uring_io(eloop, cqe);
+		faux_free(cqe);
+	}
+
+	while (faux_eloop_uring_canceling(eloop)) {
+		struct io_uring_cqe cqe = {};
+		int res = faux_uring_enter(eloop->uring, 1, NULL);
+
+		if ((res < 0) && (res != -EINTR))
+			break;
+		while (faux_uring_get_cqe(eloop->uring, &cqe)) {
+			struct io_uring_cqe *copy = NULL;
+
+			if (faux_eloop_uring_is_canceled(&cqe)) {
+				faux_eloop_uring_io(eloop, &cqe);
+				continue;
+			}
+			copy = faux_zmalloc(sizeof(*copy));
+			assert(copy);
+			if (!copy)
+				continue;
+			*copy = cqe;
+			faux_list_add(eloop->cqes, copy);
+		}
+	}
+}
+
+
+/** @brief Processes completion entry.
+ *
+ * Static service function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] cqe Completion entry.
+ * @return BOOL_FALSE if callback wants to break the loop.
+ */
+static bool_t faux_eloop_uring_dispatch(faux_eloop_t *eloop,
+	const struct io_uring_cqe *cqe)
+{
+	uint64_t data = cqe->user_data;
+	int fd = URING_DATA_FD(data);
+	unsigned int gen = URING_DATA_GEN(data);
+	faux_eloop_fd_t *entry = NULL;
+	bool_t r = BOOL_TRUE;
+
+	switch (URING_DATA_TAG(data)) {
+
+	case URING_TAG_IO:
+		return faux_eloop_uring_io(eloop, cqe);
+
+	case URING_TAG_FD:
+		entry = faux_eloop_fd_find(eloop, fd);
+		if (!entry || (entry->gen != gen)) // Stale request
+			return BOOL_TRUE;
+		entry->armed = BOOL_FALSE;
+		r = faux_eloop_process_fd(eloop, fd,
+			(cqe->res < 0) ? POLLERR : (short)cqe->res);
+		// Callback can remove fd
+		entry = faux_eloop_fd_find(eloop, fd);
+		if (entry)
+			faux_eloop_uring_arm(eloop, entry);
+		return r;
+
+	case URING_TAG_SIGNAL: {
+		struct signalfd_siginfo signal_info = {};
+
+		if (gen != eloop->signal_gen) // Stale request
+			return BOOL_TRUE;
+		while (faux_read(eloop->signal_fd, &signal_info,
+			sizeof(signal_info)) == sizeof(signal_info)) {
+			if (!faux_eloop_process_signal(eloop,
+				signal_info.ssi_signo))
+				r = BOOL_FALSE;
+		}
+		faux_eloop_uring_arm_signal(eloop);
+		return r;
+	}
+
+	default:
+		break;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Event loop function for io_uring backend.
+ *
+ * Static service function. The faux_eloop_loop() prepares signals and then
+ * calls this function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @returns BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+static bool_t faux_eloop_loop_uring(faux_eloop_t *eloop)
+{
+	bool_t retval = BOOL_TRUE;
+	bool_t stop = BOOL_FALSE;
+	struct io_uring_sqe *sqe = NULL;
+
+	eloop->signal_gen = (eloop->signal_gen + 1) & URING_GEN_MASK;
+	faux_eloop_uring_arm_signal(eloop);
+
+	// Main loop
+	while (!stop) {
+		struct timespec *timeout = NULL;
+		struct timespec next_interval = {};
+		struct io_uring_cqe cqe = {};
+		faux_list_node_t *node = NULL;
+		int res = 0;
+
+		// End of previous iteration
+		if (!faux_eloop_process_deferred(eloop))
+			break;
+
+		// Postponed completions are processed without waiting
+		if (faux_list_is_empty(eloop->cqes)) {
+			// Find out next scheduled interval
+			if (faux_sched_next_interval(eloop->sched,
+				&next_interval))
+				timeout = &next_interval;
+			// Submit requests and wait for completions
+			res = faux_uring_enter(eloop->uring, 1, timeout);
+			if ((res < 0) && (res != -ETIME) && (res != -EINTR)) {
+				retval = BOOL_FALSE;
+				break;
+			}
+		}
+
+		// Scheduled event
+		if (-ETIME == res) {
+			if (!faux_eloop_process_sched(eloop))
+				stop = BOOL_TRUE;
+			continue;
+		}
+
+		while ((node = faux_list_head(eloop->cqes))) {
+			struct io_uring_cqe *copy = (struct io_uring_cqe *)
+				faux_list_takeaway(eloop->cqes, node);
+			// BOOL_FALSE return value means "break the loop"
+			if (!faux_eloop_uring_dispatch(eloop, copy))
+				stop = BOOL_TRUE;
+			faux_free(copy);
+		}
+		while (faux_uring_get_cqe(eloop->uring, &cqe)) {
+			// BOOL_FALSE return value means "break the loop"
+			if (!faux_eloop_uring_dispatch(eloop, &cqe))
+				stop = BOOL_TRUE;
+		}
+	} // Loop end
+
+	// Last iteration can leave deferred callbacks
+	faux_eloop_process_deferred(eloop);
+
+	// Remove signalfd poll request
+	sqe = faux_uring_get_sqe(eloop->uring);
+	if (sqe) {
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = URING_DATA(URING_TAG_SIGNAL, eloop->signal_gen,
+			eloop->signal_fd);
+		sqe->user_data = URING_DATA(URING_TAG_IGNORE, 0, 0);
+	}
+	eloop->signal_gen = (eloop->signal_gen + 1) & URING_GEN_MASK;
+	faux_uring_enter(eloop->uring, 0, NULL);
+
+	return retval;
+}
+#endif // WITH_IO_URING
+
+
+#ifdef WITH_EPOLL
+/** @brief Registers or modifies fd within epoll instance.
+ *
+ * Static service function. Linux uses the same values for poll() and epoll
+ * events. So event mask is passed as is. Events are level-triggered like
+ * poll() events.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] op EPOLL_CTL_ADD or EPOLL_CTL_MOD.
+ * @param [in] fd File descriptor.
+ * @param [in] events File events mask like POLLIN, POLLOUT.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+static bool_t faux_eloop_epoll_ctl(faux_eloop_t *eloop, int op,
+	int fd, short events)
+{
+	struct epoll_event ev = {};
+
+	if (eloop->epoll_fd < 0)
+		return BOOL_TRUE;
+	ev.events = (unsigned short)events;
+	ev.data.fd = fd;
+	if (epoll_ctl(eloop->epoll_fd, op, fd, &ev) < 0)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Creates epoll instance and registers all fds within it.
+ *
+ * Static service function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+static bool_t faux_eloop_epoll_init(faux_eloop_t *eloop)
+{
+	faux_list_node_t *iter = NULL;
+	faux_eloop_fd_t *entry = NULL;
+
+	eloop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (eloop->epoll_fd < 0)
+		return BOOL_FALSE;
+	eloop->epoll_events = faux_zmalloc(
+		FAUX_EPOLL_EVENTS * sizeof(*eloop->epoll_events));
+	assert(eloop->epoll_events);
+
+	// Some fds (like regular files) can't be used with epoll
+	iter = faux_list_head(eloop->fds);
+	while ((entry = (faux_eloop_fd_t *)faux_list_each(&iter))) {
+		if (!faux_eloop_epoll_ctl(eloop, EPOLL_CTL_ADD,
+			entry->fd, entry->events)) {
+			close(eloop->epoll_fd);
+			eloop->epoll_fd = -1;
+			faux_free(eloop->epoll_events);
+			eloop->epoll_events = NULL;
+			return BOOL_FALSE;
+		}
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Main loop of epoll backend.
+ *
+ * Static service function. Signal handling is initialized by
+ * faux_eloop_loop() that calls this function. Loop processes only ready fds
+ * returned by epoll_wait(). The timeout of scheduled events is rounded up to
+ * milliseconds.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @returns BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+static bool_t faux_eloop_loop_epoll(faux_eloop_t *eloop)
+{
+	bool_t retval = BOOL_TRUE;
+	bool_t stop = BOOL_FALSE;
+
+	faux_eloop_epoll_ctl(eloop, EPOLL_CTL_ADD, eloop->signal_fd, POLLIN);
+
+	// Main loop
+	while (!stop) {
+		int timeout = -1;
+		struct timespec next_interval = {};
+		int sn = 0;
+		int i = 0;
+
+		// End of previous iteration
+		if (!faux_eloop_process_deferred(eloop))
+			break;
+
+		// Find out next scheduled interval
+		if (!faux_sched_next_interval(eloop->sched, &next_interval))
+			timeout = -1;
+		else if (next_interval.tv_sec >= (INT_MAX / 1000 - 1))
+			timeout = INT_MAX;
+		else
+			timeout = next_interval.tv_sec * 1000 +
+				(next_interval.tv_nsec + 999999l) / 1000000l;
+
+		// Wait for events
+		sn = epoll_wait(eloop->epoll_fd, eloop->epoll_events,
+			FAUX_EPOLL_EVENTS, timeout);
+
+		// Error or signal
+		if (sn < 0) {
+			if (EINTR == errno)
+				continue;
+			retval = BOOL_FALSE;
+			break;
+		}
+
+		// Scheduled event
+		if (0 == sn) {
+			if (!faux_eloop_process_sched(eloop))
+				stop = BOOL_TRUE;
+			continue;
+		}
+
+		// Ready file descriptors
+		for (i = 0; i < sn; i++) {
+			int fd = eloop->epoll_events[i].data.fd;
+
+			// Read special signal file descriptor
+			if (fd == eloop->signal_fd) {
+				struct signalfd_siginfo signal_info = {};
+				while (faux_read(fd, &signal_info,
+					sizeof(signal_info)) == sizeof(signal_info)) {
+					// BOOL_FALSE return value means "break the loop"
+					if (!faux_eloop_process_signal(eloop,
+						signal_info.ssi_signo))
+						stop = BOOL_TRUE;
+				}
+				continue;
+			}
+
+			// Previous callback can remove fd
+			if (!faux_eloop_fd_find(eloop, fd))
+				continue;
+			// BOOL_FALSE return value means "break the loop"
+			if (!faux_eloop_process_fd(eloop, fd,
+				(short)eloop->epoll_events[i].events))
+				stop = BOOL_TRUE;
+		}
+	} // Loop end
+
+	// Last iteration can leave deferred callbacks
+	faux_eloop_process_deferred(eloop);
 
-	faux_list_free(eloop->signals);
-	faux_pollfd_free(eloop->pollfds);
-	faux_list_free(eloop->fds);
-	faux_sched_free(eloop->sched);
+	epoll_ctl(eloop->epoll_fd, EPOLL_CTL_DEL, eloop->signal_fd, NULL);
 
-	faux_free(eloop);
+	return retval;
 }
+#endif // WITH_EPOLL
 
 
 /** @brief Event loop function.
@@ -253,6 +1101,21 @@ bool_t faux_eloop_loop(faux_eloop_t *eloop)
 	}
 #endif // HAVE_SIGNALFD
 
+#ifdef WITH_IO_URING
+	// The io_uring backend has its own main loop
+	if (eloop->uring) {
+		retval = faux_eloop_loop_uring(eloop);
+		stop = BOOL_TRUE;
+	}
+#endif
+#ifdef WITH_EPOLL
+	// The epoll backend has its own main loop
+	if (eloop->epoll_fd >= 0) {
+		retval = faux_eloop_loop_epoll(eloop);
+		stop = BOOL_TRUE;
+	}
+#endif
+
 	// Main loop
 	while (!stop) {
 		int sn = 0;
@@ -261,6 +1124,10 @@ bool_t faux_eloop_loop(faux_eloop_t *eloop)
 		faux_pollfd_iterator_t pollfd_iter;
 		struct pollfd *pollfd = NULL;
 
+		// End of previous iteration
+		if (!faux_eloop_process_deferred(eloop))
+			break;
+
 		// Find out next scheduled interval
 		if (!faux_sched_next_interval(eloop->sched, &next_interval))
 			timeout = NULL;
@@ -290,37 +1157,8 @@ bool_t faux_eloop_loop(faux_eloop_t *eloop)
 
 		// Scheduled event
 		if (0 == sn) {
-			faux_ev_t *ev = NULL;
-
-			// Some scheduled events
-			while((ev = faux_sched_pop(eloop->sched))) {
-				faux_eloop_info_sched_t info = {};
-				bool_t r = BOOL_TRUE;
-				int ev_id = faux_ev_id(ev);
-				faux_eloop_context_t *context =
-					(faux_eloop_context_t *)faux_ev_data(ev);
-				faux_eloop_cb_fn event_cb = context->event_cb;
-				void *user_data = context->user_data;
-
-				if (!faux_ev_is_busy(ev)) {
-					faux_ev_free(ev);
-					ev = NULL;
-				}
-				if (!event_cb)
-					event_cb = eloop->default_event_cb;
-				if (!event_cb) // Callback is not defined
-					continue;
-				info.ev_id = ev_id;
-				// Callback will get only rescheduled event object.
-				// If event is not scheduled, callback will get NULL.
-				info.ev = ev;
-				// Execute callback
-				r = event_cb(eloop, FAUX_ELOOP_SCHED, &info,
-					user_data);
-				// BOOL_FALSE return value means "break the loop"
-				if (!r)
-					stop = BOOL_TRUE;
-			}
+			if (!faux_eloop_process_sched(eloop))
+				stop = BOOL_TRUE;
 			continue;
 		}
 
@@ -328,10 +1166,6 @@ bool_t faux_eloop_loop(faux_eloop_t *eloop)
 		faux_pollfd_init_iterator(eloop->pollfds, &pollfd_iter);
 		while ((pollfd = faux_pollfd_each_active(eloop->pollfds, &pollfd_iter))) {
 			int fd = pollfd->fd;
-			faux_eloop_info_fd_t info = {};
-			faux_eloop_cb_fn event_cb = NULL;
-			faux_eloop_fd_t *entry = NULL;
-			bool_t r = BOOL_TRUE;
 
 			// Read special signal file descriptor
 #ifdef HAVE_SIGNALFD
@@ -347,52 +1181,26 @@ bool_t faux_eloop_loop(faux_eloop_t *eloop)
 					sizeof(tmp)) == sizeof(tmp)) {
 					int signo = tmp;
 #endif // HAVE_SIGNALFD
-					faux_eloop_info_signal_t sinfo = {};
-					faux_eloop_signal_t *sentry =
-						(faux_eloop_signal_t *)faux_list_kfind(
-						eloop->signals, &signo);
-
-					if (!sentry) // Not registered signal. Drop it.
-						continue;
-					event_cb = sentry->context.event_cb;
-					if (!event_cb)
-						event_cb = eloop->default_event_cb;
-					if (!event_cb) // Callback is not defined
-						continue;
-					sinfo.signo = signo;
-
-					// Execute callback
-					r = event_cb(eloop, FAUX_ELOOP_SIGNAL, &sinfo,
-						sentry->context.user_data);
 					// BOOL_FALSE return value means "break the loop"
-					if (!r)
+					if (!faux_eloop_process_signal(eloop, signo))
 						stop = BOOL_TRUE;
 				}
 				continue; // Another fds are common, not signal
 			}
 
 			// File descriptor
-			entry = (faux_eloop_fd_t *)faux_list_kfind(eloop->fds, &fd);
-			assert(entry);
-			if (!entry) // Something went wrong
-				continue;
-			event_cb = entry->context.event_cb;
-			if (!event_cb)
-				event_cb = eloop->default_event_cb;
-			if (!event_cb) // Callback function is not defined for this event
-				continue;
-			info.fd = fd;
-			info.revents = pollfd->revents;
-
-			// Execute callback
-			r = event_cb(eloop, FAUX_ELOOP_FD, &info, entry->context.user_data);
 			// BOOL_FALSE return value means "break the loop"
-			if (!r)
+			if (!faux_eloop_process_fd(eloop, fd, pollfd->revents))
 				stop = BOOL_TRUE;
 		}
 
 	} // Loop end
 
+	// Last iteration can leave deferred callbacks. The io_uring backend
+	// processes them itself
+	if (FAUX_ELOOP_BACKEND_POLL == eloop->backend)
+		faux_eloop_process_deferred(eloop);
+
 #ifdef HAVE_SIGNALFD
 	// Close signal file descriptor
 	faux_pollfd_del_by_fd(eloop->pollfds, eloop->signal_fd);
@@ -426,6 +1234,119 @@ bool_t faux_eloop_loop(faux_eloop_t *eloop)
 }
 
 
+/** @brief Sets mechanism to wait for events.
+ *
+ * The FAUX_ELOOP_BACKEND_POLL backend (default) uses ppoll(). The
+ * FAUX_ELOOP_BACKEND_URING backend uses io_uring. It's available if library
+ * is built with io_uring support (see "--enable-io-uring" configure option)
+ * and kernel supports it. The io_uring backend allows to use completion
+ * operations (faux_eloop_io_*() functions). The FAUX_ELOOP_BACKEND_EPOLL
+ * backend uses epoll (see "--enable-epoll" configure option). It's suitable
+ * for a lot of fds. Note epoll doesn't accept regular files so backend can't
+ * be set while such fd is registered. Backend can't be changed within active
+ * loop. On switching from io_uring backend the completion operations are
+ * canceled.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] backend Backend.
+ * @return BOOL_TRUE - success, BOOL_FALSE - backend is not supported or error.
+ */
+bool_t faux_eloop_set_backend(faux_eloop_t *eloop,
+	faux_eloop_backend_e backend)
+{
+#if defined(WITH_IO_URING) || defined(WITH_EPOLL)
+	faux_list_node_t *iter = NULL;
+	faux_eloop_fd_t *entry = NULL;
+#endif
+
+	assert(eloop);
+	if (!eloop)
+		return BOOL_FALSE;
+	if (eloop->working) // Can't be changed within loop
+		return BOOL_FALSE;
+	if (eloop->backend == backend)
+		return BOOL_TRUE;
+
+	// Prepare new backend. Current backend stays on error
+	switch (backend) {
+	case FAUX_ELOOP_BACKEND_POLL:
+		break;
+#ifdef WITH_IO_URING
+	case FAUX_ELOOP_BACKEND_URING:
+		eloop->uring = faux_uring_new(FAUX_URING_ENTRIES);
+		if (!eloop->uring)
+			return BOOL_FALSE;
+		break;
+#endif
+#ifdef WITH_EPOLL
+	case FAUX_ELOOP_BACKEND_EPOLL:
+		if (!faux_eloop_epoll_init(eloop))
+			return BOOL_FALSE;
+		break;
+#endif
+	default:
+		return BOOL_FALSE;
+	}
+
+	// Release current backend
+#ifdef WITH_IO_URING
+	if (FAUX_ELOOP_BACKEND_URING == eloop->backend) {
+		faux_eloop_uring_cancel(eloop, -1);
+		faux_list_del_all(eloop->cqes);
+		faux_uring_free(eloop->uring);
+		eloop->uring = NULL;
+	}
+#endif
+#ifdef WITH_EPOLL
+	if (FAUX_ELOOP_BACKEND_EPOLL == eloop->backend) {
+		close(eloop->epoll_fd);
+		eloop->epoll_fd = -1;
+		faux_free(eloop->epoll_events);
+		eloop->epoll_events = NULL;
+		// The epoll backend doesn't maintain pollfd vector
+		faux_pollfd_del_all(eloop->pollfds);
+		iter = faux_list_head(eloop->fds);
+		while ((entry = (faux_eloop_fd_t *)faux_list_each(&iter)))
+			faux_pollfd_add(eloop->pollfds, entry->fd,
+				entry->events);
+	}
+#endif
+	eloop->backend = backend;
+
+#ifdef WITH_IO_URING
+	// Post poll requests for registered fds
+	if (FAUX_ELOOP_BACKEND_URING == backend) {
+		iter = faux_list_head(eloop->fds);
+		while ((entry = (faux_eloop_fd_t *)faux_list_each(&iter))) {
+			entry->armed = BOOL_FALSE;
+			faux_eloop_uring_arm(eloop, entry);
+		}
+	}
+#endif
+#ifdef WITH_EPOLL
+	if (FAUX_ELOOP_BACKEND_EPOLL == backend)
+		faux_pollfd_del_all(eloop->pollfds);
+#endif
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets mechanism to wait for events.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @return Backend.
+ */
+faux_eloop_backend_e faux_eloop_backend(const faux_eloop_t *eloop)
+{
+	assert(eloop);
+	if (!eloop)
+		return FAUX_ELOOP_BACKEND_POLL;
+
+	return eloop->backend;
+}
+
+
 /** @brief Registers file descriptor to wait for events.
  *
  * See poll() for explanation of possible file events ("events" argument).
@@ -441,11 +1362,12 @@ bool_t faux_eloop_add_fd(faux_eloop_t *eloop, int fd, short events,
 	faux_eloop_cb_fn event_cb, void *user_data)
 {
 	faux_eloop_fd_t *entry = NULL;
-	faux_list_node_t *new_node = NULL;
 
 	assert(eloop);
 	if (!eloop || (fd < 0))
 		return BOOL_FALSE;
+	if (faux_eloop_fd_find(eloop, fd)) // Already registered
+		return BOOL_FALSE;
 
 	entry = faux_zmalloc(sizeof(*entry));
 	if (!entry)
@@ -455,18 +1377,39 @@ bool_t faux_eloop_add_fd(faux_eloop_t *eloop, int fd, short events,
 	entry->context.event_cb = event_cb;
 	entry->context.user_data = user_data;
 
-	if (!(new_node = faux_list_add(eloop->fds, entry))) {
+#ifdef WITH_EPOLL
+	if (!faux_eloop_epoll_ctl(eloop, EPOLL_CTL_ADD, fd, events)) {
 		faux_free(entry);
 		return BOOL_FALSE;
 	}
-
-	if (!faux_pollfd_add(eloop->pollfds, entry->fd, entry->events)) {
-		faux_list_del(eloop->fds, new_node);
-		faux_free(entry);
-		return BOOL_FALSE;
+#endif
+	if (!faux_eloop_fd_map_set(eloop, fd, entry))
+		goto error;
+	if (!(entry->node = faux_list_add(eloop->fds, entry))) {
+		faux_eloop_fd_map_set(eloop, fd, NULL);
+		goto error;
 	}
+	// The epoll backend doesn't use pollfd vector
+	if ((eloop->backend != FAUX_ELOOP_BACKEND_EPOLL) &&
+		!faux_pollfd_add(eloop->pollfds, entry->fd, entry->events)) {
+		faux_eloop_fd_map_set(eloop, fd, NULL);
+		faux_list_del(eloop->fds, entry->node); // Frees entry
+		entry = NULL;
+		goto error;
+	}
+#ifdef WITH_IO_URING
+	faux_eloop_uring_arm(eloop, entry);
+#endif
 
 	return BOOL_TRUE;
+
+error:
+#ifdef WITH_EPOLL
+	if (eloop->epoll_fd >= 0)
+		epoll_ctl(eloop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+	faux_free(entry);
+	return BOOL_FALSE;
 }
 
 
@@ -496,9 +1439,25 @@ bool_t faux_eloop_include_fd_event(faux_eloop_t *eloop, int fd, short event)
 	if (fd < 0)
 		return BOOL_FALSE;
 
-	entry = (faux_eloop_fd_t *)faux_list_kfind(eloop->fds, &fd);
+	entry = faux_eloop_fd_find(eloop, fd);
 	if (!entry)
 		return BOOL_FALSE;
+#ifdef WITH_EPOLL
+	if (eloop->epoll_fd >= 0) {
+		if ((entry->events | event) == entry->events)
+			return BOOL_TRUE;
+		entry->events = entry->events | event;
+		return faux_eloop_epoll_ctl(eloop, EPOLL_CTL_MOD,
+			fd, entry->events);
+	}
+#endif
+#ifdef WITH_IO_URING
+	if (eloop->uring && ((entry->events | event) != entry->events)) {
+		faux_eloop_uring_disarm(eloop, entry);
+		entry->events = entry->events | event;
+		faux_eloop_uring_arm(eloop, entry);
+	}
+#endif
 	entry->events = entry->events | event;
 	faux_pollfd_del_by_fd(eloop->pollfds, fd);
 	faux_pollfd_add(eloop->pollfds, fd, entry->events);
@@ -533,9 +1492,25 @@ bool_t faux_eloop_exclude_fd_event(faux_eloop_t *eloop, int fd, short event)
 	if (fd < 0)
 		return BOOL_FALSE;
 
-	entry = (faux_eloop_fd_t *)faux_list_kfind(eloop->fds, &fd);
+	entry = faux_eloop_fd_find(eloop, fd);
 	if (!entry)
 		return BOOL_FALSE;
+#ifdef WITH_EPOLL
+	if (eloop->epoll_fd >= 0) {
+		if ((entry->events & (~event)) == entry->events)
+			return BOOL_TRUE;
+		entry->events = entry->events & (~event);
+		return faux_eloop_epoll_ctl(eloop, EPOLL_CTL_MOD,
+			fd, entry->events);
+	}
+#endif
+#ifdef WITH_IO_URING
+	if (eloop->uring && ((entry->events & (~event)) != entry->events)) {
+		faux_eloop_uring_disarm(eloop, entry);
+		entry->events = entry->events & (~event);
+		faux_eloop_uring_arm(eloop, entry);
+	}
+#endif
 	entry->events = entry->events & (~event);
 	faux_pollfd_del_by_fd(eloop->pollfds, fd);
 	faux_pollfd_add(eloop->pollfds, fd, entry->events);
@@ -552,13 +1527,27 @@ bool_t faux_eloop_exclude_fd_event(faux_eloop_t *eloop, int fd, short event)
  */
 bool_t faux_eloop_del_fd(faux_eloop_t *eloop, int fd)
 {
+	faux_eloop_fd_t *entry = NULL;
+
 	if (!eloop || (fd < 0))
 		return BOOL_FALSE;
 
-	if (!faux_list_kdel(eloop->fds, &fd))
+	entry = faux_eloop_fd_find(eloop, fd);
+	if (!entry)
 		return BOOL_FALSE;
+#ifdef WITH_IO_URING
+	faux_eloop_uring_disarm(eloop, entry);
+#endif
+#ifdef WITH_EPOLL
+	// Error is ignored because fd can be closed already
+	if (eloop->epoll_fd >= 0)
+		epoll_ctl(eloop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+	faux_eloop_fd_map_set(eloop, fd, NULL);
+	faux_list_del(eloop->fds, entry->node);
 
-	if (!faux_pollfd_del_by_fd(eloop->pollfds, fd))
+	if ((eloop->backend != FAUX_ELOOP_BACKEND_EPOLL) &&
+		!faux_pollfd_del_by_fd(eloop->pollfds, fd))
 		return BOOL_FALSE;
 
 	return BOOL_TRUE;
@@ -927,3 +1916,299 @@ ssize_t faux_eloop_del_sched_by_id(faux_eloop_t *eloop, int ev_id)
 
 	return faux_sched_del_by_id(eloop->sched, ev_id);
 }
+
+
+/** @brief Registers deferred callback.
+ *
+ * Callback is executed once at the end of current loop iteration (or at the
+ * beginning of loop if loop is not active now). Then it's unregistered
+ * automatically. Callback gets FAUX_ELOOP_DEFERRED event type and NULL
+ * associated data. The same callback can be registered many times. Caller
+ * must avoid duplicates itself if necessary.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] event_cb Callback for event.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_eloop_add_deferred(faux_eloop_t *eloop,
+	faux_eloop_cb_fn event_cb, void *user_data)
+{
+	faux_eloop_context_t *context = NULL;
+
+	assert(eloop);
+	if (!eloop)
+		return BOOL_FALSE;
+
+	context = faux_eloop_new_context(event_cb, user_data);
+	if (!context)
+		return BOOL_FALSE;
+	if (!faux_list_add(eloop->deferred, context)) {
+		faux_free(context);
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Unregisters deferred callback.
+ *
+ * All registered entries with specified callback and user data are removed.
+ * It's useful when object that uses deferred callback is freed.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] event_cb Callback for event.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - entry was found and removed, BOOL_FALSE - not found.
+ */
+bool_t faux_eloop_del_deferred(faux_eloop_t *eloop,
+	faux_eloop_cb_fn event_cb, void *user_data)
+{
+	faux_list_node_t *iter = NULL;
+	faux_list_node_t *node = NULL;
+	faux_eloop_context_t *context = NULL;
+	bool_t found = BOOL_FALSE;
+
+	assert(eloop);
+	if (!eloop)
+		return BOOL_FALSE;
+
+	iter = faux_list_head(eloop->deferred);
+	while ((node = iter)) {
+		context = (faux_eloop_context_t *)faux_list_each(&iter);
+		if ((context->event_cb != event_cb) ||
+			(context->user_data != user_data))
+			continue;
+		faux_list_del(eloop->deferred, node);
+		found = BOOL_TRUE;
+	}
+
+	return found;
+}
+
+
+/** @brief Creates completion operation.
+ *
+ * Static service function. Operation is added to list of operations in
+ * progress.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] op Operation type.
+ * @param [in] fd File descriptor.
+ * @param [in] event_cb Callback for completion.
+ * @param [in] user_data User data to pass to callback.
+ * @return Allocated operation or NULL on error.
+ */
+static faux_eloop_io_t *faux_eloop_io_new(faux_eloop_t *eloop,
+	faux_eloop_io_e op, int fd, faux_eloop_cb_fn event_cb, void *user_data)
+{
+	faux_eloop_io_t *io = NULL;
+
+	assert(eloop);
+	if (!eloop || (fd < 0))
+		return NULL;
+#ifdef WITH_IO_URING
+	if (!eloop->uring) // Completion operations need io_uring backend
+		return NULL;
+
+	io = faux_zmalloc(sizeof(*io));
+	assert(io);
+	if (!io)
+		return NULL;
+	io->op = op;
+	io->fd = fd;
+	io->cancel = BOOL_FALSE;
+	io->context.event_cb = event_cb;
+	io->context.user_data = user_data;
+	io->node = faux_list_add(eloop->ios, io);
+	if (!io->node) {
+		faux_free(io);
+		return NULL;
+	}
+#else
+	op = op; // Happy compiler
+	event_cb = event_cb; // Happy compiler
+	user_data = user_data; // Happy compiler
+#endif
+
+	return io;
+}
+
+
+/** @brief Posts completion operation.
+ *
+ * Static service function. Operation is freed on error.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] io Operation.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+static bool_t faux_eloop_io_post(faux_eloop_t *eloop, faux_eloop_io_t *io)
+{
+#ifdef WITH_IO_URING
+	if (faux_eloop_uring_submit(eloop, io))
+		return BOOL_TRUE;
+#endif
+	faux_eloop_io_free(eloop, io);
+
+	return BOOL_FALSE;
+}
+
+
+/** @brief Posts read operation.
+ *
+ * Completion operations are available with io_uring backend only (see
+ * faux_eloop_set_backend()). Kernel reads data to user's buffer and then
+ * callback is executed with FAUX_ELOOP_IO event type. The associated data is
+ * faux_eloop_info_io_t structure. The "res" field contains length of readed
+ * data, "0" on EOF or -errno on error. Buffer must be valid until
+ * completion.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] fd File descriptor to read from.
+ * @param [in] data Buffer to read to.
+ * @param [in] len Length of buffer.
+ * @param [in] event_cb Callback for completion.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_eloop_io_read(faux_eloop_t *eloop, int fd, void *data, size_t len,
+	faux_eloop_cb_fn event_cb, void *user_data)
+{
+	faux_eloop_io_t *io = NULL;
+
+	if (!data || (0 == len))
+		return BOOL_FALSE;
+	io = faux_eloop_io_new(eloop, FAUX_ELOOP_IO_READ, fd,
+		event_cb, user_data);
+	if (!io)
+		return BOOL_FALSE;
+	io->data = data;
+	io->len = len;
+
+	return faux_eloop_io_post(eloop, io);
+}
+
+
+/** @brief Posts write operation.
+ *
+ * See faux_eloop_io_read(). The "iov" array is copied but data must be valid
+ * until completion. The "res" field contains length of written data or
+ * -errno on error.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] fd File descriptor to write to.
+ * @param [in] iov Array of data blocks.
+ * @param [in] iovcnt Number of entries within array.
+ * @param [in] event_cb Callback for completion.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_eloop_io_writev(faux_eloop_t *eloop, int fd,
+	const struct iovec *iov, int iovcnt,
+	faux_eloop_cb_fn event_cb, void *user_data)
+{
+	faux_eloop_io_t *io = NULL;
+
+	if (!iov || (iovcnt <= 0))
+		return BOOL_FALSE;
+	io = faux_eloop_io_new(eloop, FAUX_ELOOP_IO_WRITEV, fd,
+		event_cb, user_data);
+	if (!io)
+		return BOOL_FALSE;
+	io->iov = faux_zmalloc(iovcnt * sizeof(*iov));
+	if (!io->iov) {
+		faux_eloop_io_free(eloop, io);
+		return BOOL_FALSE;
+	}
+	memcpy(io->iov, iov, iovcnt * sizeof(*iov));
+	io->iovcnt = iovcnt;
+
+	return faux_eloop_io_post(eloop, io);
+}
+
+
+/** @brief Posts multishot receive operation.
+ *
+ * See faux_eloop_io_read(). Operation stays active and callback is executed
+ * for each portion of received data while "more" field is BOOL_TRUE. Data is
+ * received to buffers provided by event loop. The "data" field points to
+ * received data. It's valid within callback only.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] fd Socket to receive from.
+ * @param [in] event_cb Callback for completion.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_eloop_io_recv(faux_eloop_t *eloop, int fd,
+	faux_eloop_cb_fn event_cb, void *user_data)
+{
+	faux_eloop_io_t *io = NULL;
+
+	io = faux_eloop_io_new(eloop, FAUX_ELOOP_IO_RECV, fd,
+		event_cb, user_data);
+	if (!io)
+		return BOOL_FALSE;
+#ifdef WITH_IO_URING
+	if (!faux_uring_set_bufs(eloop->uring,
+		FAUX_URING_BUF_NUM, FAUX_URING_BUF_SIZE)) {
+		faux_eloop_io_free(eloop, io);
+		return BOOL_FALSE;
+	}
+#endif
+
+	return faux_eloop_io_post(eloop, io);
+}
+
+
+/** @brief Posts multishot accept operation.
+ *
+ * See faux_eloop_io_read(). Operation stays active and callback is executed
+ * for each accepted connection while "more" field is BOOL_TRUE. The "res"
+ * field contains accepted fd or -errno on error.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] fd Listening socket.
+ * @param [in] event_cb Callback for completion.
+ * @param [in] user_data User data to pass to callback.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_eloop_io_accept(faux_eloop_t *eloop, int fd,
+	faux_eloop_cb_fn event_cb, void *user_data)
+{
+	faux_eloop_io_t *io = NULL;
+
+	io = faux_eloop_io_new(eloop, FAUX_ELOOP_IO_ACCEPT, fd,
+		event_cb, user_data);
+	if (!io)
+		return BOOL_FALSE;
+
+	return faux_eloop_io_post(eloop, io);
+}
+
+
+/** @brief Cancels completion operations for fd.
+ *
+ * Function waits for operations to complete. Callbacks are executed with
+ * final results. It's -ECANCELED usually but operation can be completed
+ * before cancellation. So buffers used by operations can be freed after
+ * this function.
+ *
+ * @param [in] eloop Allocated and initialized event loop object.
+ * @param [in] fd File descriptor.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_eloop_io_cancel(faux_eloop_t *eloop, int fd)
+{
+	assert(eloop);
+	if (!eloop || (fd < 0))
+		return BOOL_FALSE;
+
+#ifdef WITH_IO_URING
+	faux_eloop_uring_cancel(eloop, fd);
+#endif
+
+	return BOOL_TRUE;
+}
@@ -3,6 +3,28 @@
 #include "faux/net.h"
 #include "faux/vec.h"
 #include "faux/sched.h"
+#include "faux/eloop.h"
+
+#ifdef WITH_IO_URING
+#include <linux/io_uring.h>
+
+// Buffer group ID of provided buffers
+#define FAUX_URING_BGID 0
+// Number of submission queue entries
+#define FAUX_URING_ENTRIES 256
+// Number and size of provided buffers for multishot receive
+#define FAUX_URING_BUF_NUM 64
+#define FAUX_URING_BUF_SIZE 4096
+
+typedef struct faux_uring_s faux_uring_t;
+#endif
+
+#ifdef WITH_EPOLL
+#include <sys/epoll.h>
+
+// Max number of ready fds got by single epoll_wait()
+#define FAUX_EPOLL_EVENTS 256
+#endif
 
 
 struct faux_eloop_s {
@@ -10,12 +32,26 @@ struct faux_eloop_s {
 	faux_eloop_cb_fn default_event_cb; // Default callback function
 	faux_sched_t *sched; // Service shed structure
 	faux_list_t *fds; // List of registered file descriptors
+	struct faux_eloop_fd_s **fd_map; // Registered fds indexed by fd value
+	size_t fd_map_len;
 	faux_pollfd_t *pollfds; // Service object for ppoll()
 	faux_list_t *signals; // List of registered signals
 	sigset_t sig_set; // Set of registered signals (1 for interested signal)
 	sigset_t sig_mask; // Mask of registered signals (0 - interested) = not sig_set
+	faux_list_t *deferred; // One-shot callbacks for the end of iteration
 #ifdef HAVE_SIGNALFD
 	int signal_fd; // Handler for signalfd(). Valid when loop is active only
+#endif
+	faux_eloop_backend_e backend; // Mechanism to wait for fd events
+#ifdef WITH_IO_URING
+	faux_uring_t *uring; // Ring for FAUX_ELOOP_BACKEND_URING backend
+	unsigned int signal_gen; // Generation of signalfd poll request
+	faux_list_t *ios; // Completion operations in progress
+	faux_list_t *cqes; // Postponed completion entries
+#endif
+#ifdef WITH_EPOLL
+	int epoll_fd; // Handler for FAUX_ELOOP_BACKEND_EPOLL backend
+	struct epoll_event *epoll_events; // Ready list
 #endif
 };
 
@@ -29,6 +65,11 @@ typedef struct faux_eloop_fd_s {
 	int fd;
 	short events;
 	faux_eloop_context_t context;
+	faux_list_node_t *node; // Node within list of fds
+#ifdef WITH_IO_URING
+	unsigned int gen; // Generation of poll request. Detects stale entries
+	bool_t armed; // Poll request is in progress
+#endif
 } faux_eloop_fd_t;
 
 typedef struct faux_eloop_signal_s {
@@ -36,3 +77,32 @@ typedef struct faux_eloop_signal_s {
 	struct sigaction oldact;
 	faux_eloop_context_t context;
 } faux_eloop_signal_t;
+
+// Completion operation posted by faux_eloop_io_*() functions
+typedef struct faux_eloop_io_s {
+	faux_eloop_io_e op;
+	int fd;
+	void *data; // Data to read to
+	size_t len;
+	struct iovec *iov; // Copy of user's iov for writev
+	int iovcnt;
+	bool_t cancel; // Operation is being canceled
+	faux_list_node_t *node; // Node within list of operations
+	faux_eloop_context_t context;
+} faux_eloop_io_t;
+
+#ifdef WITH_IO_URING
+C_DECL_BEGIN
+
+faux_uring_t *faux_uring_new(unsigned int entries);
+void faux_uring_free(faux_uring_t *ring);
+int faux_uring_enter(faux_uring_t *ring, unsigned int wait_nr,
+	const struct timespec *timeout);
+struct io_uring_sqe *faux_uring_get_sqe(faux_uring_t *ring);
+bool_t faux_uring_get_cqe(faux_uring_t *ring, struct io_uring_cqe *cqe);
+bool_t faux_uring_set_bufs(faux_uring_t *ring, unsigned int num, size_t size);
+void *faux_uring_buf(faux_uring_t *ring, unsigned int bid);
+void faux_uring_put_buf(faux_uring_t *ring, unsigned int bid);
+
+C_DECL_END
+#endif
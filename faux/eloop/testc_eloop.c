@@ -0,0 +1,424 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "faux/str.h"
+#include "faux/eloop.h"
+#include "faux/testc_helpers.h"
+
+
+typedef struct {
+	unsigned int fd_calls;
+	unsigned int signals;
+	char data[100];
+	size_t data_len;
+	ssize_t res;
+	unsigned int ios;
+	unsigned int accepted;
+} uring_test_t;
+
+
+static bool_t uring_fd_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	uring_test_t *t = (uring_test_t *)user_data;
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	char c = '\0';
+
+	// Read single byte. Event must be level-triggered
+	if (read(info->fd, &c, 1) == 1)
+		t->fd_calls++;
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t uring_signal_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	uring_test_t *t = (uring_test_t *)user_data;
+
+	t->signals++;
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	return BOOL_FALSE; // Stop loop
+}
+
+
+static bool_t uring_kill_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	kill(getpid(), SIGUSR1);
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+	user_data = user_data; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t uring_stop_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+	user_data = user_data; // Happy compiler
+
+	return BOOL_FALSE; // Stop loop
+}
+
+
+static bool_t uring_io_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	uring_test_t *t = (uring_test_t *)user_data;
+	faux_eloop_info_io_t *info = (faux_eloop_info_io_t *)associated_data;
+
+	t->ios++;
+	t->res = info->res;
+	if ((FAUX_ELOOP_IO_RECV == info->op) && (info->res > 0) &&
+		(t->data_len + info->res <= sizeof(t->data))) {
+		memcpy(t->data + t->data_len, info->data, info->res);
+		t->data_len += info->res;
+	}
+	if ((FAUX_ELOOP_IO_ACCEPT == info->op) && (info->res >= 0)) {
+		t->accepted++;
+		close(info->res);
+	}
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static void uring_run(faux_eloop_t *eloop)
+{
+	struct timespec interval = {0, 100000000}; // 100ms
+
+	faux_eloop_add_sched_once_delayed(eloop, &interval, 1,
+		uring_stop_cb, NULL);
+	faux_eloop_loop(eloop);
+}
+
+
+int testc_faux_eloop_uring(void)
+{
+	int ret = -1; // Pessimistic return value
+	faux_eloop_t *eloop = NULL;
+	uring_test_t t = {};
+	int pipefd[2] = {-1, -1};
+	int s[2] = {-1, -1};
+	int lsock = -1;
+	int csock[2] = {-1, -1};
+	struct sockaddr_in addr = {};
+	socklen_t addr_len = sizeof(addr);
+	struct timespec interval = {0, 10000000}; // 10ms
+	struct iovec iov[2] = {};
+	char buf[10] = {};
+	unsigned int i = 0;
+
+	eloop = faux_eloop_new(NULL);
+	printf("faux_eloop_set_backend()\n");
+	if (!faux_eloop_set_backend(eloop, FAUX_ELOOP_BACKEND_URING)) {
+		printf("io_uring backend is not supported. Skip test\n");
+		ret = 0;
+		goto error;
+	}
+	if ((pipe(pipefd) < 0) ||
+		(socketpair(AF_UNIX, SOCK_STREAM, 0, s) < 0))
+		goto error;
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+	// Level-triggered fd events
+	printf("fd events\n");
+	faux_eloop_add_fd(eloop, pipefd[0], POLLIN, uring_fd_cb, &t);
+	if (write(pipefd[1], "0123456789", 10) != 10)
+		goto error;
+	uring_run(eloop);
+	if (t.fd_calls != 10) {
+		fprintf(stderr, "Wrong number of fd events: %u\n", t.fd_calls);
+		goto error;
+	}
+	// Excluded event
+	faux_eloop_exclude_fd_event(eloop, pipefd[0], POLLIN);
+	if (write(pipefd[1], "0", 1) != 1)
+		goto error;
+	uring_run(eloop);
+	if (t.fd_calls != 10) {
+		fprintf(stderr, "Excluded event is got\n");
+		goto error;
+	}
+	faux_eloop_del_fd(eloop, pipefd[0]);
+	if (read(pipefd[0], buf, sizeof(buf)) != 1)
+		goto error;
+
+	// Signal
+	printf("Signal\n");
+	faux_eloop_add_signal(eloop, SIGUSR1, uring_signal_cb, &t);
+	faux_eloop_add_sched_once_delayed(eloop, &interval, 1,
+		uring_kill_cb, NULL);
+	faux_eloop_loop(eloop);
+	faux_eloop_del_signal(eloop, SIGUSR1);
+	if (t.signals != 1) {
+		fprintf(stderr, "Signal is not got\n");
+		goto error;
+	}
+
+	// Write and read operations
+	printf("faux_eloop_io_writev() + faux_eloop_io_read()\n");
+	iov[0].iov_base = "abc";
+	iov[0].iov_len = 3;
+	iov[1].iov_base = "def";
+	iov[1].iov_len = 3;
+	if (!faux_eloop_io_writev(eloop, pipefd[1], iov, 2, uring_io_cb, &t) ||
+		!faux_eloop_io_read(eloop, pipefd[0], buf, sizeof(buf),
+		uring_io_cb, &t))
+		goto error;
+	uring_run(eloop);
+	if ((t.ios != 2) || (t.res != 6) || (memcmp(buf, "abcdef", 6) != 0)) {
+		fprintf(stderr, "Wrong read/write operations\n");
+		goto error;
+	}
+
+	// Cancel
+	printf("faux_eloop_io_cancel()\n");
+	t.ios = 0;
+	if (!faux_eloop_io_read(eloop, pipefd[0], buf, sizeof(buf),
+		uring_io_cb, &t))
+		goto error;
+	faux_eloop_io_cancel(eloop, pipefd[0]);
+	if ((t.ios != 1) || (t.res != -ECANCELED)) {
+		fprintf(stderr, "Operation is not canceled\n");
+		goto error;
+	}
+
+	// Multishot receive
+	printf("faux_eloop_io_recv()\n");
+	t.ios = 0;
+	if (!faux_eloop_io_recv(eloop, s[1], uring_io_cb, &t))
+		goto error;
+	for (i = 0; i < 3; i++) {
+		if (write(s[0], "hello", 5) != 5)
+			goto error;
+		uring_run(eloop);
+	}
+	if ((t.data_len != 15) ||
+		(memcmp(t.data, "hellohellohello", 15) != 0)) {
+		fprintf(stderr, "Wrong received data\n");
+		goto error;
+	}
+	// EOF finishes multishot operation
+	close(s[0]);
+	s[0] = -1;
+	uring_run(eloop);
+	if (t.res != 0) {
+		fprintf(stderr, "No EOF\n");
+		goto error;
+	}
+
+	// Multishot accept
+	printf("faux_eloop_io_accept()\n");
+	lsock = socket(AF_INET, SOCK_STREAM, 0);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+		(listen(lsock, 5) < 0) ||
+		(getsockname(lsock, (struct sockaddr *)&addr, &addr_len) < 0))
+		goto error;
+	if (!faux_eloop_io_accept(eloop, lsock, uring_io_cb, &t))
+		goto error;
+	for (i = 0; i < 2; i++) {
+		csock[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (connect(csock[i], (struct sockaddr *)&addr,
+			sizeof(addr)) < 0)
+			goto error;
+	}
+	uring_run(eloop);
+	if (t.accepted != 2) {
+		fprintf(stderr, "Wrong number of accepted connections: %u\n",
+			t.accepted);
+		goto error;
+	}
+
+	// Return to ppoll(). Operations are canceled
+	printf("faux_eloop_set_backend(FAUX_ELOOP_BACKEND_POLL)\n");
+	t.ios = 0;
+	if (!faux_eloop_set_backend(eloop, FAUX_ELOOP_BACKEND_POLL) ||
+		(t.ios != 1) || (t.res != -ECANCELED)) {
+		fprintf(stderr, "Can't return to ppoll()\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_eloop_free(eloop);
+	if (pipefd[0] >= 0)
+		close(pipefd[0]);
+	if (pipefd[1] >= 0)
+		close(pipefd[1]);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+	if (lsock >= 0)
+		close(lsock);
+	if (csock[0] >= 0)
+		close(csock[0]);
+	if (csock[1] >= 0)
+		close(csock[1]);
+
+	return ret;
+}
+
+
+typedef struct {
+	int fds[2];
+	unsigned int calls;
+} epoll_del_t;
+
+
+static bool_t epoll_del_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	epoll_del_t *d = (epoll_del_t *)user_data;
+
+	// Another ready fd is removed before its event is delivered
+	d->calls++;
+	faux_eloop_del_fd(eloop, d->fds[0]);
+	faux_eloop_del_fd(eloop, d->fds[1]);
+
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+int testc_faux_eloop_epoll(void)
+{
+	int ret = -1; // Pessimistic return value
+	faux_eloop_t *eloop = NULL;
+	uring_test_t t = {};
+	epoll_del_t d = {};
+	int pipefd[2] = {-1, -1};
+	int s[2] = {-1, -1};
+	struct timespec interval = {0, 10000000}; // 10ms
+	char buf[10] = {};
+
+	eloop = faux_eloop_new(NULL);
+	if ((pipe(pipefd) < 0) ||
+		(socketpair(AF_UNIX, SOCK_STREAM, 0, s) < 0))
+		goto error;
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	// Registered fd is moved to epoll instance
+	faux_eloop_add_fd(eloop, pipefd[0], POLLIN, uring_fd_cb, &t);
+	printf("faux_eloop_set_backend()\n");
+	if (!faux_eloop_set_backend(eloop, FAUX_ELOOP_BACKEND_EPOLL)) {
+		printf("epoll backend is not supported. Skip test\n");
+		ret = 0;
+		goto error;
+	}
+	if (faux_eloop_backend(eloop) != FAUX_ELOOP_BACKEND_EPOLL)
+		goto error;
+
+	// Level-triggered fd events
+	printf("fd events\n");
+	if (write(pipefd[1], "0123456789", 10) != 10)
+		goto error;
+	uring_run(eloop);
+	if (t.fd_calls != 10) {
+		fprintf(stderr, "Wrong number of fd events: %u\n", t.fd_calls);
+		goto error;
+	}
+	// Excluded event
+	faux_eloop_exclude_fd_event(eloop, pipefd[0], POLLIN);
+	if (write(pipefd[1], "0", 1) != 1)
+		goto error;
+	uring_run(eloop);
+	if (t.fd_calls != 10) {
+		fprintf(stderr, "Excluded event is got\n");
+		goto error;
+	}
+	// Included event
+	faux_eloop_include_fd_event(eloop, pipefd[0], POLLIN);
+	uring_run(eloop);
+	if (t.fd_calls != 11) {
+		fprintf(stderr, "Included event is not got\n");
+		goto error;
+	}
+
+	// Signal
+	printf("Signal\n");
+	faux_eloop_add_signal(eloop, SIGUSR1, uring_signal_cb, &t);
+	faux_eloop_add_sched_once_delayed(eloop, &interval, 1,
+		uring_kill_cb, NULL);
+	faux_eloop_loop(eloop);
+	faux_eloop_del_signal(eloop, SIGUSR1);
+	if (t.signals != 1) {
+		fprintf(stderr, "Signal is not got\n");
+		goto error;
+	}
+
+	// Both fds are ready. The first callback removes both of them
+	printf("faux_eloop_del_fd() within callback\n");
+	faux_eloop_del_fd(eloop, pipefd[0]);
+	d.fds[0] = s[0];
+	d.fds[1] = s[1];
+	faux_eloop_add_fd(eloop, s[0], POLLOUT, epoll_del_cb, &d);
+	faux_eloop_add_fd(eloop, s[1], POLLOUT, epoll_del_cb, &d);
+	uring_run(eloop);
+	if (d.calls != 1) {
+		fprintf(stderr, "Event of removed fd is got\n");
+		goto error;
+	}
+
+	// Return to ppoll()
+	printf("faux_eloop_set_backend(FAUX_ELOOP_BACKEND_POLL)\n");
+	faux_eloop_add_fd(eloop, pipefd[0], POLLIN, uring_fd_cb, &t);
+	if (!faux_eloop_set_backend(eloop, FAUX_ELOOP_BACKEND_POLL)) {
+		fprintf(stderr, "Can't return to ppoll()\n");
+		goto error;
+	}
+	if (write(pipefd[1], "0", 1) != 1)
+		goto error;
+	uring_run(eloop);
+	if ((t.fd_calls != 12) || (read(pipefd[0], buf, sizeof(buf)) >= 0)) {
+		fprintf(stderr, "Wrong fd events after switch\n");
+		goto error;
+	}
+
+	ret = 0; // success
+
+error:
+	faux_eloop_free(eloop);
+	if (pipefd[0] >= 0)
+		close(pipefd[0]);
+	if (pipefd[1] >= 0)
+		close(pipefd[1]);
+	if (s[0] >= 0)
+		close(s[0]);
+	if (s[1] >= 0)
+		close(s[1]);
+
+	return ret;
+}
@@ -0,0 +1,367 @@
+/** @file uring.c
+ * @brief Minimal io_uring ring used by event loop.
+ *
+ * The ring is created by raw io_uring_setup() and io_uring_enter() syscalls
+ * so there is no dependency on liburing. Only the things event loop needs
+ * are implemented: submission queue entries, completion queue entries, wait
+ * with timeout and a ring of provided buffers for multishot operations.
+ *
+ * The ring is not thread safe.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#ifdef WITH_IO_URING
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "faux/faux.h"
+
+#include "private.h"
+
+struct faux_uring_s {
+	int fd;
+	// Submission queue
+	void *sq_ptr;
+	size_t sq_len;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int sq_mask;
+	unsigned int sq_entries;
+	unsigned int sqe_tail; // Local tail. It's published by enter
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	// Completion queue
+	void *cq_ptr;
+	size_t cq_len;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+	// Provided buffers
+	struct io_uring_buf_ring *br;
+	size_t br_len;
+	char *br_data;
+	unsigned int br_num;
+	size_t br_size;
+	unsigned short br_tail; // Local tail of buffer ring
+};
+
+
+/** @brief Creates new ring.
+ *
+ * Ring must support features event loop relies on: single mmap of queues,
+ * waiting with timeout (IORING_FEAT_EXT_ARG) and non-blocking submission
+ * (IORING_FEAT_NODROP). So old kernels are rejected.
+ *
+ * @param [in] entries Number of submission queue entries.
+ * @return Allocated ring or NULL on error.
+ */
+faux_uring_t *faux_uring_new(unsigned int entries)
+{
+	faux_uring_t *ring = NULL;
+	struct io_uring_params p = {};
+	unsigned int *sq_array = NULL;
+	unsigned int i = 0;
+
+	ring = faux_zmalloc(sizeof(*ring));
+	assert(ring);
+	if (!ring)
+		return NULL;
+	ring->sq_ptr = MAP_FAILED;
+	ring->cq_ptr = MAP_FAILED;
+	ring->sqes = MAP_FAILED;
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0) {
+		faux_free(ring);
+		return NULL;
+	}
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+		!(p.features & IORING_FEAT_EXT_ARG) ||
+		!(p.features & IORING_FEAT_NODROP))
+		goto error;
+
+	// Queues share single mapping
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_len = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (ring->cq_len > ring->sq_len)
+		ring->sq_len = ring->cq_len;
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (MAP_FAILED == ring->sq_ptr)
+		goto error;
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (MAP_FAILED == ring->sqes)
+		goto error;
+
+	ring->sq_head = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.tail);
+	ring->sq_mask = *(unsigned int *)((char *)ring->sq_ptr +
+		p.sq_off.ring_mask);
+	ring->sq_entries = p.sq_entries;
+	ring->sqe_tail = *ring->sq_tail;
+	// Identity mapping between array and SQEs
+	sq_array = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.array);
+	for (i = 0; i < p.sq_entries; i++)
+		sq_array[i] = i;
+
+	ring->cq_head = (unsigned int *)((char *)ring->sq_ptr + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)((char *)ring->sq_ptr + p.cq_off.tail);
+	ring->cq_mask = *(unsigned int *)((char *)ring->sq_ptr +
+		p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->sq_ptr +
+		p.cq_off.cqes);
+
+	return ring;
+
+error:
+	faux_uring_free(ring);
+	return NULL;
+}
+
+
+/** @brief Frees ring.
+ *
+ * Kernel cancels all operations that are still in progress.
+ *
+ * @param [in] ring Ring.
+ */
+void faux_uring_free(faux_uring_t *ring)
+{
+	if (!ring)
+		return;
+
+	if (ring->br) {
+		struct io_uring_buf_reg reg = {};
+		reg.bgid = FAUX_URING_BGID;
+		syscall(__NR_io_uring_register, ring->fd,
+			IORING_UNREGISTER_PBUF_RING, &reg, 1);
+		munmap(ring->br, ring->br_len);
+		faux_free(ring->br_data);
+	}
+	if (ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->sq_ptr != MAP_FAILED)
+		munmap(ring->sq_ptr, ring->sq_len);
+	close(ring->fd);
+
+	faux_free(ring);
+}
+
+
+/** @brief Submits queued entries and waits for completions.
+ *
+ * @param [in] ring Ring.
+ * @param [in] wait_nr Number of completions to wait for.
+ * @param [in] timeout Max time to wait. NULL means infinite.
+ * @return Number of submitted entries or -errno on error. The -ETIME means
+ * timeout.
+ */
+int faux_uring_enter(faux_uring_t *ring, unsigned int wait_nr,
+	const struct timespec *timeout)
+{
+	unsigned int to_submit = 0;
+	unsigned int flags = 0;
+	struct io_uring_getevents_arg arg = {};
+	struct __kernel_timespec ts = {};
+	int res = 0;
+
+	assert(ring);
+	if (!ring)
+		return -EINVAL;
+
+	// Publish local tail. Kernel can consume less entries than it was
+	// asked to. So entries not consumed yet are counted from kernel's head
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+	to_submit = ring->sqe_tail -
+		__atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+	if (wait_nr > 0)
+		flags |= IORING_ENTER_GETEVENTS;
+	if (timeout) {
+		ts.tv_sec = timeout->tv_sec;
+		ts.tv_nsec = timeout->tv_nsec;
+		arg.ts = (uintptr_t)&ts;
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+	if ((0 == to_submit) && (0 == flags))
+		return 0;
+
+	res = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr, flags,
+		timeout ? (void *)&arg : NULL, timeout ? sizeof(arg) : 0);
+	if (res < 0)
+		return -errno;
+
+	return res;
+}
+
+
+/** @brief Gets free submission queue entry.
+ *
+ * Entry is cleared. Entries are submitted by faux_uring_enter(). If queue is
+ * full then queued entries are submitted at once.
+ *
+ * @param [in] ring Ring.
+ * @return Entry or NULL on error.
+ */
+struct io_uring_sqe *faux_uring_get_sqe(faux_uring_t *ring)
+{
+	struct io_uring_sqe *sqe = NULL;
+	unsigned int head = 0;
+
+	assert(ring);
+	if (!ring)
+		return NULL;
+
+	head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if ((ring->sqe_tail - head) >= ring->sq_entries) {
+		if (faux_uring_enter(ring, 0, NULL) < 0)
+			return NULL;
+		head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		if ((ring->sqe_tail - head) >= ring->sq_entries)
+			return NULL;
+	}
+	sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+	ring->sqe_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+
+	return sqe;
+}
+
+
+/** @brief Gets next completion queue entry.
+ *
+ * Entry is copied and removed from completion queue.
+ *
+ * @param [in] ring Ring.
+ * @param [out] cqe Completion entry.
+ * @return BOOL_TRUE - entry is got, BOOL_FALSE - queue is empty.
+ */
+bool_t faux_uring_get_cqe(faux_uring_t *ring, struct io_uring_cqe *cqe)
+{
+	unsigned int head = 0;
+
+	assert(ring);
+	assert(cqe);
+	if (!ring || !cqe)
+		return BOOL_FALSE;
+
+	head = *ring->cq_head;
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return BOOL_FALSE;
+	*cqe = ring->cqes[head & ring->cq_mask];
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Registers ring of provided buffers.
+ *
+ * Buffers are used by multishot operations with IOSQE_BUFFER_SELECT flag and
+ * FAUX_URING_BGID buffer group. Kernel picks buffer for each completion.
+ * Buffer must be returned by faux_uring_put_buf() when it's processed.
+ *
+ * @param [in] ring Ring.
+ * @param [in] num Number of buffers. Must be power of 2.
+ * @param [in] size Size of single buffer.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_uring_set_bufs(faux_uring_t *ring, unsigned int num, size_t size)
+{
+	struct io_uring_buf_reg reg = {};
+	unsigned int i = 0;
+
+	assert(ring);
+	if (!ring)
+		return BOOL_FALSE;
+	if (ring->br) // Already registered
+		return BOOL_TRUE;
+
+	ring->br_len = num * sizeof(struct io_uring_buf);
+	ring->br = mmap(NULL, ring->br_len, PROT_READ | PROT_WRITE,
+		MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (MAP_FAILED == ring->br) {
+		ring->br = NULL;
+		return BOOL_FALSE;
+	}
+	ring->br_data = faux_malloc(num * size);
+	if (!ring->br_data) {
+		munmap(ring->br, ring->br_len);
+		ring->br = NULL;
+		return BOOL_FALSE;
+	}
+	reg.ring_addr = (uintptr_t)ring->br;
+	reg.ring_entries = num;
+	reg.bgid = FAUX_URING_BGID;
+	if (syscall(__NR_io_uring_register, ring->fd,
+		IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		munmap(ring->br, ring->br_len);
+		faux_free(ring->br_data);
+		ring->br = NULL;
+		ring->br_data = NULL;
+		return BOOL_FALSE;
+	}
+	ring->br_num = num;
+	ring->br_size = size;
+	ring->br_tail = 0;
+	for (i = 0; i < num; i++)
+		faux_uring_put_buf(ring, i);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets provided buffer by its ID.
+ *
+ * @param [in] ring Ring.
+ * @param [in] bid Buffer ID from completion entry.
+ * @return Buffer or NULL on error.
+ */
+void *faux_uring_buf(faux_uring_t *ring, unsigned int bid)
+{
+	assert(ring);
+	if (!ring || !ring->br || (bid >= ring->br_num))
+		return NULL;
+
+	return ring->br_data + bid * ring->br_size;
+}
+
+
+/** @brief Returns provided buffer to kernel.
+ *
+ * @param [in] ring Ring.
+ * @param [in] bid Buffer ID.
+ */
+void faux_uring_put_buf(faux_uring_t *ring, unsigned int bid)
+{
+	struct io_uring_buf *b = NULL;
+
+	assert(ring);
+	if (!ring || !ring->br || (bid >= ring->br_num))
+		return;
+
+	b = &ring->br->bufs[ring->br_tail & (ring->br_num - 1)];
+	b->addr = (uintptr_t)faux_uring_buf(ring, bid);
+	b->len = ring->br_size;
+	b->bid = bid;
+	ring->br_tail++;
+	__atomic_store_n(&ring->br->tail, ring->br_tail, __ATOMIC_RELEASE);
+}
+
+#endif // WITH_IO_URING
@@ -130,6 +130,7 @@ ssize_t faux_msg_send_async(const faux_msg_t *msg, faux_async_t *async);
 faux_msg_t *faux_msg_recv(faux_net_t *faux_net);
 bool_t faux_msg_iov(const faux_msg_t *msg, struct iovec **iov_out, size_t *iov_num_out);
 bool_t faux_msg_serialize(const faux_msg_t *msg, char **buf, size_t *len);
+faux_buf_seg_t *faux_msg_seg_new(const faux_msg_t *msg);
 faux_msg_t *faux_msg_deserialize_parts(const faux_hdr_t *hdr,
 	const char *body, size_t body_len);
 faux_msg_t *faux_msg_deserialize(const char *data, size_t len);
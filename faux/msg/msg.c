@@ -754,6 +754,35 @@ ssize_t faux_msg_send_async(const faux_msg_t *msg, faux_async_t *async)
 }
 
 
+/** @brief Serializes message to shared segment.
+ *
+ * Shared segment can be sent to many async connections by
+ * faux_async_write_seg() without copying message for each connection.
+ * Segment must be freed by faux_buf_seg_free().
+ *
+ * @param [in] msg Allocated faux_msg_t object.
+ * @return Allocated shared segment or NULL on error.
+ */
+faux_buf_seg_t *faux_msg_seg_new(const faux_msg_t *msg)
+{
+	size_t vec_entries_num = 0;
+	struct iovec *iov = NULL;
+	faux_buf_seg_t *seg = NULL;
+
+	assert(msg);
+	if (!msg)
+		return NULL;
+
+	if (!faux_msg_iov(msg, &iov, &vec_entries_num))
+		return NULL;
+
+	seg = faux_buf_seg_newv(iov, vec_entries_num);
+	faux_free(iov);
+
+	return seg;
+}
+
+
 /** @brief Serializes message.
  *
  * @param [in] msg Allocated faux_msg_t object.
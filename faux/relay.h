@@ -0,0 +1,50 @@
+/** @file relay.h
+ * @brief Public interface for byte relay between two async I/O objects.
+ */
+
+#ifndef _faux_relay_h
+#define _faux_relay_h
+
+#include <faux/faux.h>
+#include <faux/async.h>
+#include <faux/eloop.h>
+
+typedef struct faux_relay_s faux_relay_t;
+
+// Relay directions
+typedef enum {
+	FAUX_RELAY_A2B = 0, // From "a" object to "b" object
+	FAUX_RELAY_B2A = 1 // From "b" object to "a" object
+} faux_relay_dir_e;
+
+// Statistics of single direction
+typedef struct {
+	size_t bytes; // Bytes written to destination
+	size_t spliced; // Bytes moved by splice() without user space copying
+	size_t mirrored; // Bytes written to mirror
+	size_t mirror_dropped; // Bytes that mirror couldn't accept
+	bool_t splice; // Direction uses splice() now
+	bool_t eof; // Source has reached end of file
+} faux_relay_stat_t;
+
+// Callback function prototype
+typedef bool_t (*faux_relay_done_cb_fn)(faux_relay_t *relay,
+	int error, void *user_data);
+
+
+C_DECL_BEGIN
+
+faux_relay_t *faux_relay_new(faux_eloop_t *eloop,
+	faux_async_t *a, faux_async_t *b);
+void faux_relay_free(faux_relay_t *relay);
+void faux_relay_set_done_cb(faux_relay_t *relay,
+	faux_relay_done_cb_fn done_cb, void *user_data);
+bool_t faux_relay_set_mirror(faux_relay_t *relay, faux_relay_dir_e dir,
+	int fd);
+bool_t faux_relay_disable_splice(faux_relay_t *relay);
+bool_t faux_relay_stat(const faux_relay_t *relay, faux_relay_dir_e dir,
+	faux_relay_stat_t *stat);
+
+C_DECL_END
+
+#endif // _faux_relay_h
@@ -0,0 +1,28 @@
+#include "faux/faux.h"
+#include "faux/async.h"
+#include "faux/eloop.h"
+#include "faux/relay.h"
+
+// Max amount of data to move by single splice() or read()
+#define RELAY_CHUNK 65536
+// Max number of read operations per single event. It prevents starvation of
+// another events
+#define RELAY_BURST 16
+
+typedef struct faux_relay_dir_s {
+	faux_async_t *src;
+	faux_async_t *dst;
+	int pipe[2]; // Intermediate pipe for splice()
+	size_t pipe_len; // Amount of data within pipe
+	int mirror; // Mirror fd. The "-1" means no mirror
+	bool_t shut; // Destination is shut down for writing
+	faux_relay_stat_t stat;
+} faux_relay_dir_t;
+
+struct faux_relay_s {
+	faux_eloop_t *eloop;
+	faux_relay_dir_t dir[2]; // Index is faux_relay_dir_e
+	faux_relay_done_cb_fn done_cb;
+	void *done_udata;
+	bool_t done; // Relay is finished
+};
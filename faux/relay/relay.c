@@ -0,0 +1,517 @@
+/** @file relay.c
+ * @brief Byte relay between two async I/O objects.
+ *
+ * Relay forwards all data received from one async I/O object to another one
+ * and vice versa. Relay registers file descriptors of both objects within
+ * event loop and does all the work itself. So relay is suitable for pure
+ * byte forwarding (proxy) with no data processing.
+ *
+ * Where it's possible relay uses splice() to move data from source fd to
+ * intermediate pipe and then from pipe to destination fd. So data doesn't
+ * enter user space at all. If splice() is not supported for some file
+ * descriptors then relay falls back to buffered mode. Data is read into
+ * destination's output buffer and then written by faux_async_out().
+ *
+ * Each direction can have a mirror - a file descriptor that gets copy of
+ * forwarded data. Mirror never blocks relay. Data that mirror can't accept
+ * immediately is dropped and counted. In splice mode tee() is used so
+ * mirror must be a pipe.
+ *
+ * When relay is finished (both sources reached EOF and all the data was
+ * written or error occured) relay unregisters file descriptors and executes
+ * "done" callback. Relay doesn't close file descriptors and doesn't free
+ * async I/O objects.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "faux/faux.h"
+#include "faux/buf.h"
+#include "faux/async.h"
+#include "faux/eloop.h"
+#include "faux/relay.h"
+
+#include "private.h"
+
+
+static bool_t faux_relay_fd_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+
+
+/** @brief Create new relay object.
+ *
+ * Relay starts to work immediately within specified event loop. File
+ * descriptors of async I/O objects must not be registered within event loop
+ * by user. Relay sets its own callbacks. Data that is already stored within
+ * input buffers or output buffers will be forwarded first.
+ *
+ * @param [in] eloop Event loop.
+ * @param [in] a The first async I/O object.
+ * @param [in] b The second async I/O object.
+ * @return Allocated relay object or NULL on error.
+ */
+faux_relay_t *faux_relay_new(faux_eloop_t *eloop,
+	faux_async_t *a, faux_async_t *b)
+{
+	faux_relay_t *relay = NULL;
+	unsigned int i = 0;
+
+	assert(eloop);
+	if (!eloop)
+		return NULL;
+	assert(a);
+	if (!a)
+		return NULL;
+	assert(b);
+	if (!b)
+		return NULL;
+	if (faux_async_fd(a) == faux_async_fd(b))
+		return NULL;
+
+	relay = faux_zmalloc(sizeof(*relay));
+	assert(relay);
+	if (!relay)
+		return NULL;
+
+	// Init
+	relay->eloop = eloop;
+	relay->done_cb = NULL;
+	relay->done_udata = NULL;
+	relay->done = BOOL_FALSE;
+	relay->dir[FAUX_RELAY_A2B].src = a;
+	relay->dir[FAUX_RELAY_A2B].dst = b;
+	relay->dir[FAUX_RELAY_B2A].src = b;
+	relay->dir[FAUX_RELAY_B2A].dst = a;
+	for (i = 0; i < 2; i++) {
+		faux_relay_dir_t *dir = &relay->dir[i];
+		dir->pipe[0] = -1;
+		dir->pipe[1] = -1;
+		dir->pipe_len = 0;
+		dir->mirror = -1;
+		dir->shut = BOOL_FALSE;
+#ifdef HAVE_SPLICE
+		if (pipe2(dir->pipe, O_NONBLOCK | O_CLOEXEC) == 0)
+			dir->stat.splice = BOOL_TRUE;
+#endif
+	}
+
+	if (!faux_eloop_add_fd(eloop, faux_async_fd(a), POLLIN,
+		faux_relay_fd_cb, relay)) {
+		faux_relay_free(relay);
+		return NULL;
+	}
+	if (!faux_eloop_add_fd(eloop, faux_async_fd(b), POLLIN,
+		faux_relay_fd_cb, relay)) {
+		faux_eloop_del_fd(eloop, faux_async_fd(a));
+		faux_relay_free(relay);
+		return NULL;
+	}
+
+	return relay;
+}
+
+
+/** @brief Free relay object.
+ *
+ * @param [in] relay Relay object.
+ */
+void faux_relay_free(faux_relay_t *relay)
+{
+	unsigned int i = 0;
+
+	if (!relay)
+		return;
+
+	if (!relay->done) {
+		faux_eloop_del_fd(relay->eloop,
+			faux_async_fd(relay->dir[FAUX_RELAY_A2B].src));
+		faux_eloop_del_fd(relay->eloop,
+			faux_async_fd(relay->dir[FAUX_RELAY_B2A].src));
+	}
+	for (i = 0; i < 2; i++) {
+		if (relay->dir[i].pipe[0] >= 0)
+			close(relay->dir[i].pipe[0]);
+		if (relay->dir[i].pipe[1] >= 0)
+			close(relay->dir[i].pipe[1]);
+	}
+
+	faux_free(relay);
+}
+
+
+/** @brief Set "done" callback.
+ *
+ * Callback is executed when relay is finished. The "error" argument is "0"
+ * when both directions reached EOF and all the data was written or errno
+ * value on error. Callback's return value is returned to event loop. So
+ * BOOL_FALSE breaks the loop. Callback can free relay object.
+ *
+ * @param [in] relay Allocated and initialized relay object.
+ * @param [in] done_cb Callback function.
+ * @param [in] user_data User defined data for callback.
+ */
+void faux_relay_set_done_cb(faux_relay_t *relay,
+	faux_relay_done_cb_fn done_cb, void *user_data)
+{
+	assert(relay);
+	if (!relay)
+		return;
+
+	relay->done_cb = done_cb;
+	relay->done_udata = user_data;
+}
+
+
+/** @brief Set mirror for specified direction.
+ *
+ * Mirror gets copy of all forwarded data. Mirror file descriptor is set to
+ * non-blocking mode. Data that mirror can't accept immediately is dropped.
+ * Mirror must be a pipe while direction uses splice().
+ *
+ * @param [in] relay Allocated and initialized relay object.
+ * @param [in] dir Direction.
+ * @param [in] fd Mirror file descriptor. The "-1" disables mirror.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_relay_set_mirror(faux_relay_t *relay, faux_relay_dir_e dir,
+	int fd)
+{
+	int fflags = 0;
+
+	assert(relay);
+	if (!relay)
+		return BOOL_FALSE;
+	if ((dir != FAUX_RELAY_A2B) && (dir != FAUX_RELAY_B2A))
+		return BOOL_FALSE;
+
+	if (fd >= 0) {
+		if ((fflags = fcntl(fd, F_GETFL)) == -1)
+			return BOOL_FALSE;
+		if (fcntl(fd, F_SETFL, fflags | O_NONBLOCK) == -1)
+			return BOOL_FALSE;
+	}
+	relay->dir[dir].mirror = fd;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Disable splice() and use buffered mode only.
+ *
+ * @param [in] relay Allocated and initialized relay object.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_relay_disable_splice(faux_relay_t *relay)
+{
+	unsigned int i = 0;
+
+	assert(relay);
+	if (!relay)
+		return BOOL_FALSE;
+
+	for (i = 0; i < 2; i++)
+		relay->dir[i].stat.splice = BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Get statistics of specified direction.
+ *
+ * @param [in] relay Allocated and initialized relay object.
+ * @param [in] dir Direction.
+ * @param [out] stat Statistics.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t faux_relay_stat(const faux_relay_t *relay, faux_relay_dir_e dir,
+	faux_relay_stat_t *stat)
+{
+	assert(relay);
+	if (!relay)
+		return BOOL_FALSE;
+	assert(stat);
+	if (!stat)
+		return BOOL_FALSE;
+	if ((dir != FAUX_RELAY_A2B) && (dir != FAUX_RELAY_B2A))
+		return BOOL_FALSE;
+
+	*stat = relay->dir[dir].stat;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Writes copy of buffered data to mirror.
+ *
+ * Static internal function.
+ *
+ * @param [in] dir Relay direction.
+ * @param [in] buf Buffer with data.
+ * @param [in] offset Offset of data within buffer.
+ * @param [in] len Length of data.
+ */
+static void faux_relay_mirror_buf(faux_relay_dir_t *dir, const faux_buf_t *buf,
+	size_t offset, size_t len)
+{
+	char data[4096];
+
+	if (dir->mirror < 0)
+		return;
+
+	while (len > 0) {
+		ssize_t data_len = faux_buf_peek(buf, offset, data,
+			(len < sizeof(data)) ? len : sizeof(data));
+		ssize_t written = 0;
+		if (data_len <= 0)
+			break;
+		written = write(dir->mirror, data, data_len);
+		if (written > 0) {
+			dir->stat.mirrored += written;
+			offset += written;
+			len -= written;
+		}
+		if (written != data_len)
+			break;
+	}
+	dir->stat.mirror_dropped += len;
+}
+
+
+/** @brief Forwards data in specified direction.
+ *
+ * Static internal function. Function works until source or destination
+ * would block or burst limit is reached.
+ *
+ * @param [in] dir Relay direction.
+ * @return 0 - success, errno value on error.
+ */
+static int faux_relay_pump(faux_relay_dir_t *dir)
+{
+	int src_fd = faux_async_fd(dir->src);
+	int dst_fd = faux_async_fd(dir->dst);
+	faux_buf_t *ibuf = faux_async_ibuf(dir->src);
+	faux_buf_t *obuf = faux_async_obuf(dir->dst);
+	unsigned int burst = 0;
+
+	// Data that was already received by async I/O object goes first
+	if ((faux_buf_len(ibuf) > 0) &&
+		(faux_buf_move(obuf, ibuf, faux_buf_len(ibuf)) < 0))
+		return ENOBUFS;
+
+	while (BOOL_TRUE) {
+		ssize_t n = 0;
+
+		// Buffered output
+		if (faux_buf_len(obuf) > 0) {
+			n = faux_async_out(dir->dst);
+			if (n < 0)
+				return errno;
+			dir->stat.bytes += n;
+			if (faux_buf_len(obuf) > 0)
+				return 0; // Wait for destination
+		}
+
+#ifdef HAVE_SPLICE
+		// Data within pipe
+		if (dir->pipe_len > 0) {
+			n = splice(dir->pipe[0], NULL, dst_fd, NULL,
+				dir->pipe_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n < 0) {
+				if (EINTR == errno)
+					continue;
+				if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+					return 0; // Wait for destination
+				if (errno != EINVAL)
+					return errno;
+				// Destination doesn't support splice(). Get
+				// data back from pipe to use buffered mode.
+				dir->stat.splice = BOOL_FALSE;
+				n = faux_buf_read_from_fd(obuf, dir->pipe[0],
+					dir->pipe_len, NULL);
+				if (n < 0)
+					return errno;
+				dir->pipe_len -= n;
+				continue;
+			}
+			dir->pipe_len -= n;
+			dir->stat.bytes += n;
+			dir->stat.spliced += n;
+			continue;
+		}
+#endif
+
+		// All the data is written
+		if (dir->stat.eof) {
+			if (!dir->shut) {
+				shutdown(dst_fd, SHUT_WR);
+				dir->shut = BOOL_TRUE;
+			}
+			return 0;
+		}
+
+		// Let another events to be processed
+		if (burst >= RELAY_BURST)
+			return 0;
+		burst++;
+
+#ifdef HAVE_SPLICE
+		if (dir->stat.splice) {
+			n = splice(src_fd, NULL, dir->pipe[1], NULL,
+				RELAY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n < 0) {
+				if (EINTR == errno)
+					continue;
+				if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+					return 0; // Wait for source
+				if ((errno != EINVAL) && (errno != ENOSYS))
+					return errno;
+				// Source doesn't support splice()
+				dir->stat.splice = BOOL_FALSE;
+				continue;
+			}
+			if (0 == n) {
+				dir->stat.eof = BOOL_TRUE;
+				continue;
+			}
+			dir->pipe_len = n;
+			// Pipe was empty so tee() gets new data only
+			if (dir->mirror >= 0) {
+				ssize_t t = tee(dir->pipe[0], dir->mirror, n,
+					SPLICE_F_NONBLOCK);
+				if (t < 0)
+					t = 0;
+				dir->stat.mirrored += t;
+				dir->stat.mirror_dropped += n - t;
+			}
+			continue;
+		}
+#endif
+
+		// Buffered mode
+		n = faux_buf_read_from_fd(obuf, src_fd, RELAY_CHUNK,
+			NULL);
+		if (n < 0) {
+			if (EINTR == errno)
+				continue;
+			if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+				return 0; // Wait for source
+			return errno;
+		}
+		if (0 == n) {
+			dir->stat.eof = BOOL_TRUE;
+			continue;
+		}
+		faux_relay_mirror_buf(dir, obuf, faux_buf_len(obuf) - n, n);
+	}
+
+	return 0;
+}
+
+
+/** @brief Checks if direction has data that is not written yet.
+ *
+ * Static internal function.
+ *
+ * @param [in] dir Relay direction.
+ * @return BOOL_TRUE - data is pending, BOOL_FALSE - no data.
+ */
+static bool_t faux_relay_pending(const faux_relay_dir_t *dir)
+{
+	if (dir->pipe_len > 0)
+		return BOOL_TRUE;
+	if (faux_buf_len(faux_async_obuf(dir->dst)) > 0)
+		return BOOL_TRUE;
+
+	return BOOL_FALSE;
+}
+
+
+/** @brief Finishes relay.
+ *
+ * Static internal function.
+ *
+ * @param [in] relay Relay object.
+ * @param [in] error Error code.
+ * @return Return value of "done" callback.
+ */
+static bool_t faux_relay_finish(faux_relay_t *relay, int error)
+{
+	relay->done = BOOL_TRUE;
+	faux_eloop_del_fd(relay->eloop,
+		faux_async_fd(relay->dir[FAUX_RELAY_A2B].src));
+	faux_eloop_del_fd(relay->eloop,
+		faux_async_fd(relay->dir[FAUX_RELAY_B2A].src));
+
+	if (!relay->done_cb)
+		return BOOL_TRUE;
+
+	return relay->done_cb(relay, error, relay->done_udata);
+}
+
+
+/** @brief Event loop callback for relay's file descriptors.
+ *
+ * Static internal function. Any event on file descriptor can unblock both
+ * directions because fd is a source for one direction and destination for
+ * another one. The source is not polled for reading while destination
+ * has unwritten data. So relay doesn't buffer more than single portion of
+ * data per direction.
+ */
+static bool_t faux_relay_fd_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	faux_relay_t *relay = (faux_relay_t *)user_data;
+	unsigned int i = 0;
+	bool_t finished = BOOL_TRUE;
+
+	if (relay->done)
+		return BOOL_TRUE;
+	if (info->revents & POLLNVAL)
+		return faux_relay_finish(relay, EBADF);
+
+	for (i = 0; i < 2; i++) {
+		int error = faux_relay_pump(&relay->dir[i]);
+		if (error != 0)
+			return faux_relay_finish(relay, error);
+	}
+
+	for (i = 0; i < 2; i++) {
+		faux_relay_dir_t *dir = &relay->dir[i];
+		int src_fd = faux_async_fd(dir->src);
+		int dst_fd = faux_async_fd(dir->dst);
+		bool_t pending = faux_relay_pending(dir);
+
+		if (!dir->stat.eof && !pending)
+			faux_eloop_include_fd_event(eloop, src_fd, POLLIN);
+		else
+			faux_eloop_exclude_fd_event(eloop, src_fd, POLLIN);
+		if (pending)
+			faux_eloop_include_fd_event(eloop, dst_fd, POLLOUT);
+		else
+			faux_eloop_exclude_fd_event(eloop, dst_fd, POLLOUT);
+		if (!dir->stat.eof || pending)
+			finished = BOOL_FALSE;
+	}
+
+	if (finished)
+		return faux_relay_finish(relay, 0);
+
+	type = type; // Happy compiler
+
+	return BOOL_TRUE;
+}
@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "faux/str.h"
+#include "faux/async.h"
+#include "faux/eloop.h"
+#include "faux/relay.h"
+#include "faux/testc_helpers.h"
+
+
+static bool_t done_cb(faux_relay_t *relay, int error, void *user_data)
+{
+	int *result = (int *)user_data;
+
+	*result = error;
+	relay = relay; // Happy compiler
+
+	return BOOL_FALSE; // Break the loop
+}
+
+
+static int testc_faux_relay_generic(bool_t use_splice, bool_t use_uring)
+{
+	int ret = -1; // Pessimistic return value
+	size_t len = 50000; // Fits into socket and pipe buffers
+	char *rnd = NULL;
+	char *res = NULL;
+	int sa[2] = {-1, -1};
+	int sb[2] = {-1, -1};
+	int mirror[2] = {-1, -1};
+	faux_eloop_t *eloop = NULL;
+	faux_async_t *a = NULL;
+	faux_async_t *b = NULL;
+	faux_relay_t *relay = NULL;
+	faux_relay_stat_t stat = {};
+	int result = -1;
+	ssize_t readed = 0;
+
+	rnd = faux_testc_rnd_buf(len);
+	res = faux_malloc(len);
+	if ((socketpair(AF_UNIX, SOCK_STREAM, 0, sa) < 0) ||
+		(socketpair(AF_UNIX, SOCK_STREAM, 0, sb) < 0) ||
+		(pipe(mirror) < 0)) {
+		fprintf(stderr, "Can't create socket pair\n");
+		goto error;
+	}
+
+	// Client -> sa[0] -> sa[1] (a) -> relay -> sb[0] (b) -> sb[1] -> Server
+	a = faux_async_new(sa[1]);
+	b = faux_async_new(sb[0]);
+	eloop = faux_eloop_new(NULL);
+	if (use_uring &&
+		!faux_eloop_set_backend(eloop, FAUX_ELOOP_BACKEND_URING)) {
+		printf("io_uring backend is not supported. Skip test\n");
+		ret = 0;
+		goto error;
+	}
+	relay = faux_relay_new(eloop, a, b);
+	if (!relay) {
+		fprintf(stderr, "faux_relay_new() error\n");
+		goto error;
+	}
+	faux_relay_set_done_cb(relay, done_cb, &result);
+	faux_relay_set_mirror(relay, FAUX_RELAY_A2B, mirror[1]);
+	if (!use_splice)
+		faux_relay_disable_splice(relay);
+
+	// Prepare data and EOF for both directions
+	if (write(sa[0], rnd, len) != (ssize_t)len) {
+		fprintf(stderr, "write() error\n");
+		goto error;
+	}
+	shutdown(sa[0], SHUT_WR);
+	shutdown(sb[1], SHUT_WR);
+
+	printf("faux_eloop_loop()\n");
+	faux_eloop_loop(eloop);
+	if (result != 0) {
+		fprintf(stderr, "Relay error %d\n", result);
+		goto error;
+	}
+
+	printf("Check data\n");
+	while (readed < (ssize_t)len) {
+		ssize_t r = read(sb[1], res + readed, len - readed);
+		if (r <= 0)
+			break;
+		readed += r;
+	}
+	if ((readed != (ssize_t)len) || (memcmp(rnd, res, len) != 0)) {
+		fprintf(stderr, "Data is broken\n");
+		goto error;
+	}
+	// EOF is forwarded too
+	if (read(sb[1], res, len) != 0) {
+		fprintf(stderr, "No EOF\n");
+		goto error;
+	}
+
+	printf("Check mirror\n");
+	memset(res, 0, len);
+	readed = 0;
+	while (readed < (ssize_t)len) {
+		ssize_t r = read(mirror[0], res + readed, len - readed);
+		if (r <= 0)
+			break;
+		readed += r;
+	}
+	if ((readed != (ssize_t)len) || (memcmp(rnd, res, len) != 0)) {
+		fprintf(stderr, "Mirror data is broken\n");
+		goto error;
+	}
+
+	printf("faux_relay_stat()\n");
+	faux_relay_stat(relay, FAUX_RELAY_A2B, &stat);
+	if ((stat.bytes != len) || !stat.eof || (stat.mirrored != len)) {
+		fprintf(stderr, "Wrong statistics\n");
+		goto error;
+	}
+	if (use_splice && (stat.spliced != len)) {
+		fprintf(stderr, "Spliced %lu bytes\n", stat.spliced);
+		goto error;
+	}
+	if (!use_splice && (stat.spliced != 0)) {
+		fprintf(stderr, "Spliced %lu bytes\n", stat.spliced);
+		goto error;
+	}
+	faux_relay_stat(relay, FAUX_RELAY_B2A, &stat);
+	if ((stat.bytes != 0) || !stat.eof) {
+		fprintf(stderr, "Wrong statistics\n");
+		goto error;
+	}
+
+	ret = 0;
+error:
+	faux_relay_free(relay);
+	faux_eloop_free(eloop);
+	faux_async_free(a);
+	faux_async_free(b);
+	close(sa[0]);
+	close(sa[1]);
+	close(sb[0]);
+	close(sb[1]);
+	close(mirror[0]);
+	close(mirror[1]);
+	faux_free(rnd);
+	faux_free(res);
+
+	return ret;
+}
+
+
+int testc_faux_relay(void)
+{
+	return testc_faux_relay_generic(BOOL_TRUE, BOOL_FALSE);
+}
+
+
+int testc_faux_relay_buffered(void)
+{
+	return testc_faux_relay_generic(BOOL_FALSE, BOOL_FALSE);
+}
+
+
+int testc_faux_relay_uring(void)
+{
+	return testc_faux_relay_generic(BOOL_TRUE, BOOL_TRUE);
+}
@@ -49,6 +49,20 @@ const char *testc_module[][2] = {
 	// async
 	{"testc_faux_async_write", "Async write operations"},
 	{"testc_faux_async_read", "Async read operations"},
+	{"testc_faux_async_burst", "Async direct write and write burst"},
+	{"testc_faux_async_writev_ref", "Async write by reference"},
+	{"testc_faux_async_sendfile", "Async sendfile ordered with buffered data"},
+	{"testc_faux_async_zerocopy", "Async zero-copy send"},
+	{"testc_faux_async_zerocopy_free", "Free async object with pending zero-copy sends"},
+	{"testc_faux_async_dgram", "Async datagram mode"},
+	{"testc_faux_async_dgram_empty", "Async zero-length datagram keeps order"},
+	{"testc_faux_async_stat", "Async I/O statistics"},
+	{"testc_faux_async_read_queued", "Async reads sized by FIONREAD"},
+	{"testc_faux_async_budget", "Async read with nearly full memory budget"},
+	{"testc_faux_async_frame", "Async frame decoders"},
+	{"testc_faux_async_eloop", "Async read backpressure with event loop"},
+	{"testc_faux_async_deferred", "Async deferred flush with event loop"},
+	{"testc_faux_async_uring", "Async completion operations of io_uring event loop"},
 
 	// buf
 	{"testc_faux_buf", "Dynamic buffer"},
@@ -56,6 +70,31 @@ const char *testc_module[][2] = {
 	{"testc_faux_buf_direct", "Dynamic buffer. Direct access"},
 	{"testc_faux_buf_dwrite_unlock0", "Dynamic buffer. Chunk removing"},
 	{"testc_faux_buf_mass", "Massive write and read"},
+	{"testc_faux_buf_cache", "Dynamic buffer. Chunk cache"},
+	{"testc_faux_buf_pool", "Dynamic buffer. Per-thread chunk pool"},
+	{"testc_faux_buf_pool_thread", "Dynamic buffer. Chunk pool is freed on thread exit"},
+	{"testc_faux_buf_iov", "Dynamic buffer. Direct access with user's iovec"},
+	{"testc_faux_buf_ring", "Dynamic buffer. Double-mapped ring"},
+	{"testc_faux_buf_fd", "Dynamic buffer. Vectored I/O with fd"},
+	{"testc_faux_buf_move", "Dynamic buffer. Move data between buffers"},
+	{"testc_faux_buf_seg", "Dynamic buffer. Shared segments"},
+	{"testc_faux_buf_adaptive", "Dynamic buffer. Adaptive chunk size"},
+	{"testc_faux_buf_find", "Dynamic buffer. Find data"},
+	{"testc_faux_buf_peek", "Dynamic buffer. Peek and linearize data"},
+	{"testc_faux_buf_chunks", "Dynamic buffer. Chunk array wraps around"},
+	{"testc_faux_buf_budget", "Dynamic buffer. Shared memory budget"},
+	{"testc_faux_buf_printf", "Dynamic buffer. Formatted write"},
+	{"testc_faux_buf_ref", "Dynamic buffer. Append by reference"},
+	{"testc_faux_buf_pin", "Dynamic buffer. Pinned chunks"},
+
+	// eloop
+	{"testc_faux_eloop_uring", "Event loop with io_uring backend"},
+	{"testc_faux_eloop_epoll", "Event loop with epoll backend"},
+
+	// relay
+	{"testc_faux_relay", "Relay data between async objects (splice)"},
+	{"testc_faux_relay_buffered", "Relay data between async objects (buffered)"},
+	{"testc_faux_relay_uring", "Relay data between async objects (io_uring event loop)"},
 
 	// End of list
 	{NULL, NULL}